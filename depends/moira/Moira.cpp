@@ -12,6 +12,7 @@
 #include <cmath>
 #include <bit>
 #include <vector>
+#include <mutex>
 #include <stdexcept>
 
 namespace moira {
@@ -27,21 +28,20 @@ namespace moira {
 
 Moira::Moira()
 {
-    if (BUILD_INSTR_INFO_TABLE) info = new InstrInfo[65536];
-    if (ENABLE_DASM) dasm = new DasmPtr[65536];
-    
     createJumpTable();
 }
 
 Moira::~Moira()
 {
-    if (info) delete [] info;
-    if (dasm) delete [] dasm;
 }
 
 void
 Moira::setModel(Model model)
 {
+    if (SPECIALIZE_68010 && model != M68010) {
+        throw std::runtime_error("This build of Moira only supports the 68010");
+    }
+
     if (this->model != model) {
         
         this->model = model;
@@ -147,12 +147,20 @@ Moira::cacrMask() const
 void
 Moira::reset()
 {
+#if SPECIALIZE_68010 == true
+
+    reset<C68010>();
+
+#else
+
     switch (model) {
 
         case M68000:    reset<C68000>(); break;
         case M68010:    reset<C68010>(); break;
         default:        reset<C68020>(); break;
     }
+
+#endif
 }
 
 template <Core C> void
@@ -735,6 +743,7 @@ Moira::disassemble(u32 addr, char *str, DasmStyle core)
     
     StrWriter writer(str, style, numberFormat);
     
+    if (!dasm) dasm = sharedDasmTable(model).dasm;
     (this->*dasm[opcode])(writer, pc, opcode);
     writer << Finish{};
     
@@ -843,6 +852,7 @@ Moira::getInfo(u16 op)
         return InstrInfo { ILLEGAL, MODE_IP, (Size)0 };
     }
     
+    if (!info) info = sharedDasmTable(model).info;
     return info[op];
 }
 
@@ -37,7 +37,7 @@ public:
 protected:
     
     // The emulated CPU model
-    Model model = M68000;
+    Model model = SPECIALIZE_68010 ? M68010 : M68000;
     
     // The interrupt mode of this CPU
     IrqMode irqMode = IRQ_AUTO;
@@ -132,19 +132,47 @@ protected:
     
     // Jump table holding the instruction handlers
     typedef void (Moira::*ExecPtr)(u16);
-    ExecPtr exec[65536];
+    
+    // Instruction handler tables of a single CPU model
+    struct JumpTable {
+        ExecPtr exec[65536];
+        ExecPtr loop[65536];
+    };
+
+#if SPECIALIZE_68010 == true
+
+    // Jump tables generated at compile time
+    static const JumpTable jumpTable;
+
+    static constexpr const ExecPtr *exec = jumpTable.exec;
     
     // Jump table holding the instruction handlers for the 68010 loop mode
-    ExecPtr loop[65536];
+    static constexpr const ExecPtr *loop = jumpTable.loop;
+
+#else
+
+    // Jump tables shared by all instances emulating the same model
+    const ExecPtr *exec = nullptr;
     
-    // Jump table holding the disassebler handlers
+    // Jump table holding the instruction handlers for the 68010 loop mode
+    const ExecPtr *loop = nullptr;
+
+#endif
+    
+    // Jump table holding the disassebler handlers (set up on first use)
     typedef void (Moira::*DasmPtr)(StrWriter&, u32&, u16);
-    DasmPtr *dasm = nullptr;
+    const DasmPtr *dasm = nullptr;
     
 private:
     
-    // Table holding instruction infos
-    InstrInfo *info = nullptr;
+    // Table holding instruction infos (set up on first use)
+    const InstrInfo *info = nullptr;
+    
+    // Disassembler and instruction info tables of a single CPU model
+    struct DasmTable {
+        DasmPtr dasm[65536];
+        InstrInfo info[65536];
+    };
     
     
     //
@@ -167,12 +195,27 @@ public:
     
 protected:
     
-    // Creates the generic jump table
+    // Points the instance at the shared jump tables of the selected model
     void createJumpTable();
     
 private:
     
-    template <Core C> void createJumpTable();
+#if SPECIALIZE_68010 == false
+    
+    // Returns the process-wide jump tables for a model (built on first use)
+    static const JumpTable &sharedJumpTable(Model model);
+
+#endif
+    
+    // Returns the process-wide disassembler tables for a model (built on first use)
+    static const DasmTable &sharedDasmTable(Model model);
+    
+    // Fills in the given jump tables (each of which may be nullptr)
+    template <Core C> static constexpr void createJumpTable(Model model,
+                                                            ExecPtr *exec,
+                                                            ExecPtr *loop,
+                                                            DasmPtr *dasm,
+                                                            InstrInfo *info);
 
 
     //
@@ -7,6 +7,21 @@
 
 #pragma once
 
+/* Set to true to specialize Moira for the 68010 at compile time.
+ *
+ * If enabled, the 68010 is the only supported CPU model. Instruction handlers
+ * are only instantiated for the 68010 core, and the instruction handler jump
+ * tables are generated as constant data at compile time instead of being
+ * filled in when a Moira object is created. Selecting any other model with
+ * 'setModel' throws an exception.
+ *
+ * Enable to gain speed and to reduce the memory footprint, disable to emulate
+ * other CPU models.
+ */
+#ifndef SPECIALIZE_68010
+#define SPECIALIZE_68010 true
+#endif
+
 /* Set to true to enable precise timing mode (68000 and 68010 only).
  *
  * If disabled, Moira calls function 'sync' at the end of each instruction
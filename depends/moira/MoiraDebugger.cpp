@@ -370,7 +370,7 @@ void
 Debugger::jump(u32 addr)
 {
     moira.reg.pc = addr;
-    moira.fullPrefetch<C68000, POLLIPL>();
+    moira.fullPrefetch<SPECIALIZE_68010 ? C68010 : C68000, POLLIPL>();
 }
 
 }
@@ -168,12 +168,20 @@ Moira::execAddressError(StackFrame frame, int delay)
 void
 Moira::execException(ExceptionType exc, int nr)
 {
+#if SPECIALIZE_68010 == true
+
+    execException<C68010>(exc, nr);
+
+#else
+
     switch (model) {
 
         case M68000:    execException<C68000>(exc, nr); break;
         case M68010:    execException<C68010>(exc, nr); break;
         default:        execException<C68020>(exc, nr); break;
     }
+
+#endif
 }
 
 template <Core C> void
@@ -310,12 +318,20 @@ Moira::execException(ExceptionType exc, int nr)
 void
 Moira::execInterrupt(u8 level)
 {
+#if SPECIALIZE_68010 == true
+
+    execInterrupt<C68010>(level);
+
+#else
+
     switch (model) {
 
         case M68000:    execInterrupt<C68000>(level); break;
         case M68010:    execInterrupt<C68010>(level); break;
         default:        execInterrupt<C68020>(level); break;
     }
+
+#endif
 }
 
 template <Core C> void
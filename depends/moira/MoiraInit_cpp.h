@@ -11,15 +11,17 @@
 
 // Registers an instruction handler
 #define CIMS(id,name,I,M,S) { \
-exec[id] = EXEC_HANDLER(name,C,I,M,S); \
+if (exec) exec[id] = EXEC_HANDLER(name,C,I,M,S); \
 if (dasm) dasm[id] = DASM_HANDLER(name,I,M,S); \
 if (info) info[id] = InstrInfo {I,M,S}; \
 }
 
 // Registers a special loop-mode instruction handler
 #define CIMSloop(id,name,I,M,S) { \
+if (loop) { \
 assert(loop[id] == nullptr); \
 loop[id] = EXEC_HANDLER(name,C68010,I##_LOOP,M,S); \
+} \
 }
 
 // Registers an instruction in one of the standard instruction formats:
@@ -145,40 +147,110 @@ parse(const char *s, int sum = 0)
 void
 Moira::createJumpTable()
 {
-    switch (model) {
+    // The disassembler tables are looked up on first use
+    dasm = nullptr;
+    info = nullptr;
 
-        case M68000:
+#if SPECIALIZE_68010 == false
 
-            createJumpTable<C68000>();
-            break;
+    // The instruction handlers are shared with all other instances
+    const JumpTable &table = sharedJumpTable(model);
+    exec = table.exec;
+    loop = table.loop;
 
-        case M68010:
+#endif
+}
 
-            createJumpTable<C68010>();
-            break;
+#if SPECIALIZE_68010 == false
 
-        case M68EC020:
-        case M68020:
-        case M68EC030:
-        case M68030:
+const Moira::JumpTable &
+Moira::sharedJumpTable(Model model)
+{
+    static std::once_flag built[M68040 + 1];
+    static const JumpTable *tables[M68040 + 1];
 
-            createJumpTable<C68020>();
-            break;
+    assert(model >= M68000 && model <= M68040);
 
-        case M68EC040:
-        case M68LC040:
-        case M68040:
+    std::call_once(built[model], [model] {
 
-            createJumpTable<C68020>();
-            break;
+        // Never freed, the tables live as long as the process
+        auto table = new JumpTable;
 
-        default:
-            fatalError;
-    }
+        switch (model) {
+
+            case M68000:
+
+                createJumpTable<C68000>(model, table->exec, table->loop, nullptr, nullptr);
+                break;
+
+            case M68010:
+
+                createJumpTable<C68010>(model, table->exec, table->loop, nullptr, nullptr);
+                break;
+
+            default:
+
+                createJumpTable<C68020>(model, table->exec, table->loop, nullptr, nullptr);
+                break;
+        }
+
+        tables[model] = table;
+    });
+
+    return *tables[model];
 }
 
-template <Core C> void
-Moira::createJumpTable()
+#endif
+
+const Moira::DasmTable &
+Moira::sharedDasmTable(Model model)
+{
+    static std::once_flag built[M68040 + 1];
+    static const DasmTable *tables[M68040 + 1];
+
+    assert(model >= M68000 && model <= M68040);
+
+    std::call_once(built[model], [model] {
+
+        // Never freed, the tables live as long as the process
+        auto table = new DasmTable;
+        auto dasm = ENABLE_DASM ? table->dasm : nullptr;
+        auto info = BUILD_INSTR_INFO_TABLE ? table->info : nullptr;
+
+#if SPECIALIZE_68010 == true
+
+        createJumpTable<C68010>(model, nullptr, nullptr, dasm, info);
+
+#else
+
+        switch (model) {
+
+            case M68000:
+
+                createJumpTable<C68000>(model, nullptr, nullptr, dasm, info);
+                break;
+
+            case M68010:
+
+                createJumpTable<C68010>(model, nullptr, nullptr, dasm, info);
+                break;
+
+            default:
+
+                createJumpTable<C68020>(model, nullptr, nullptr, dasm, info);
+                break;
+        }
+
+#endif
+
+        tables[model] = table;
+    });
+
+    return *tables[model];
+}
+
+template <Core C> constexpr void
+Moira::createJumpTable(Model model, ExecPtr *exec, ExecPtr *loop, DasmPtr *dasm, InstrInfo *info)
 {
     u16 opcode;
     
@@ -188,8 +260,10 @@ Moira::createJumpTable()
     
     XXXXXXXXXXXXXXXX(ILLEGAL, MODE_IP, (Size)0, Illegal, CIMS)
     
-    for (int i = 0; i < 0x10000; i++) {
-        loop[i] = nullptr;
+    if (loop) {
+        for (int i = 0; i < 0x10000; i++) {
+            loop[i] = nullptr;
+        }
     }
     
     
@@ -1895,7 +1969,7 @@ Moira::createJumpTable()
         // Coprocessor interface
         //
 
-        if (hasCPI()) {
+        if (model == M68EC020 || model == M68020 || model == M68EC030 || model == M68030) {
 
             opcode = parse("1111 ---0 10-- ----");
             ____XXX___XXXXXX(opcode, cpBcc, MODE_IP, Word, CpBcc, CIMS)
@@ -2028,3 +2102,14 @@ Moira::createJumpTable()
         }
     }
 }
+
+#if SPECIALIZE_68010 == true
+
+constinit const Moira::JumpTable Moira::jumpTable = [] {
+
+    JumpTable table { };
+    createJumpTable<C68010>(M68010, table.exec, table.loop, nullptr, nullptr);
+    return table;
+}();
+
+#endif
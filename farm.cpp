@@ -0,0 +1,148 @@
+#include "machine/machine_farm.hpp"
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+}
+
+#define FARM_DEFAULT_ROM    "./rom/bootrom"
+#define FARM_DEFAULT_BUDGET 1000000000ULL
+
+static void farmUsage(const char* name) {
+  printf("usage: %s [options] [program ...]\n", name);
+  printf("  -r rom        ROM for programs given on the command line (default " FARM_DEFAULT_ROM ")\n");
+  printf("  -i input      file sent to serial port A after each program given on the command line\n");
+  printf("  -c cycles     cycle budget for each program given on the command line (default %llu)\n", FARM_DEFAULT_BUDGET);
+  printf("  -x regions    expansion memory map for every job, ex: ram:0x100000:3M\n");
+  printf("  -b            baud-accurate serial timing for every job (default: instant)\n");
+  printf("  -t            turbo program upload for every job: skip the loader's byte-by-byte read loop\n");
+  printf("  -m manifest   also run every job listed in manifest, one per line:\n");
+  printf("                  <rom> <program> <input> <cycles>   ('-' for no program/input, '#' starts a comment)\n");
+  printf("  -j threads    worker threads (default: one per hardware thread)\n");
+  printf("  -H pages      host pages for guest memory: normal (default), transparent, or explicit (hugetlbfs)\n");
+  printf("  -o directory  write serial output of job N to directory/N.out, instead of stdout\n");
+}
+
+static bool farmReadManifest(MachineFarm* farm, const char* manifest_path, const char* memory_map, bool baud_accurate, bool turbo_upload) {
+  FILE* manifest = fopen(manifest_path, "r");
+  if(!manifest) {
+    printf("error opening manifest %s\n", manifest_path);
+    return false;
+  }
+
+  char line[4096];
+  uint32_t line_number = 0;
+  while(fgets(line, sizeof(line), manifest)) {
+    ++line_number;
+    char* comment = strchr(line, '#');
+    if(comment) { *comment = 0x00; }
+
+    char rom[1024], program[1024], input[1024];
+    unsigned long long cycles;
+    int fields = sscanf(line, "%1023s %1023s %1023s %llu", rom, program, input, &cycles);
+    if(fields <= 0) { continue; }
+    if(fields != 4) {
+      printf("%s:%u: expected <rom> <program> <input> <cycles>\n", manifest_path, line_number);
+      fclose(manifest);
+      return false;
+    }
+
+    machine_farm_job job;
+    job.rom_path      = rom;
+    job.program_path  = strcmp(program, "-") ? program : "";
+    job.input_path    = strcmp(input,   "-") ? input   : "";
+    job.cycle_budget  = cycles;
+    job.memory_map    = memory_map;
+    job.baud_accurate = baud_accurate;
+    job.turbo_upload  = turbo_upload;
+    farm->addJob(&job);
+  }
+
+  fclose(manifest);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  const char* rom_path      = FARM_DEFAULT_ROM;
+  const char* input_path    = "";
+  const char* manifest_path = NULL;
+  const char* output_path   = NULL;
+  const char* memory_map    = "";
+  uint64_t    cycle_budget  = FARM_DEFAULT_BUDGET;
+  uint32_t    thread_count  = 0;
+  bool        baud_accurate = false;
+  bool        turbo_upload  = false;
+
+  int option;
+  while((option = getopt(argc, argv, "r:i:c:x:btm:j:o:H:h")) != -1) {
+    switch(option) {
+      case 'r': rom_path      = optarg; break;
+      case 'i': input_path    = optarg; break;
+      case 'c': cycle_budget  = strtoull(optarg, NULL, 0); break;
+      case 'x': memory_map    = optarg; break;
+      case 'b': baud_accurate = true;   break;
+      case 't': turbo_upload  = true;   break;
+      case 'm': manifest_path = optarg; break;
+      case 'j': thread_count  = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'o': output_path   = optarg; break;
+      case 'H':
+        if(!strcmp(optarg, "normal"))           { GuestMemory::setPages(GUEST_MEMORY_PAGES_NORMAL);      }
+        else if(!strcmp(optarg, "transparent")) { GuestMemory::setPages(GUEST_MEMORY_PAGES_TRANSPARENT); }
+        else if(!strcmp(optarg, "explicit"))    { GuestMemory::setPages(GUEST_MEMORY_PAGES_EXPLICIT);    }
+        else { farmUsage(argv[0]); return 2; }
+        break;
+      default:  farmUsage(argv[0]); return (option == 'h') ? 0 : 2;
+    }
+  }
+
+  MachineFarm farm(thread_count);
+  if(manifest_path && !farmReadManifest(&farm, manifest_path, memory_map, baud_accurate, turbo_upload)) { return 2; }
+  for(int index=optind; index<argc; ++index) {
+    machine_farm_job job;
+    job.rom_path      = rom_path;
+    job.program_path  = argv[index];
+    job.input_path    = input_path;
+    job.cycle_budget  = cycle_budget;
+    job.memory_map    = memory_map;
+    job.baud_accurate = baud_accurate;
+    job.turbo_upload  = turbo_upload;
+    farm.addJob(&job);
+  }
+  if(farm.jobCount() == 0) {
+    farmUsage(argv[0]);
+    return 2;
+  }
+
+  farm.run();
+
+  // one summary line per job; exit status is 0 only if every guest exited with D0 == 0
+  int exit_status = 0;
+  for(uint32_t index=0; index<farm.jobCount(); ++index) {
+    const machine_farm_result* result = farm.result(index);
+    if((result->status != MACHINE_FARM_EXITED) || (result->exit_code != 0)) { exit_status = 1; }
+
+    printf("%u %s %u %llu", index, MachineFarm::statusName(result->status), result->exit_code, (unsigned long long)result->cycles);
+    if(result->status == MACHINE_FARM_ERROR) { printf(" (%s)", result->error.c_str()); }
+    printf("\n");
+
+    if(output_path) {
+      char serial_path[4096];
+      snprintf(serial_path, sizeof(serial_path), "%s/%u.out", output_path, index);
+      FILE* serial_file = fopen(serial_path, "wb");
+      if(!serial_file) {
+        printf("error writing %s\n", serial_path);
+        exit_status = 1;
+        continue;
+      }
+      fwrite(result->serial_output.data(), 1, result->serial_output.size(), serial_file);
+      fclose(serial_file);
+    } else if(!result->serial_output.empty()) {
+      fwrite(result->serial_output.data(), 1, result->serial_output.size(), stdout);
+      printf("\n");
+    }
+  }
+
+  return exit_status;
+}
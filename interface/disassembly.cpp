@@ -3,6 +3,7 @@
 
 InterfaceDisassembly::InterfaceDisassembly(RoscoM68K* rosco, uint8_t ins_count_previous, uint8_t ins_count_future, int x, int y, int width) {
   this->rosco = rosco;
+  this->symbols = NULL;
   this->x = x;
   this->y = y;
 
@@ -33,6 +34,10 @@ InterfaceDisassembly::~InterfaceDisassembly() {
   }
 }
 
+void InterfaceDisassembly::setSymbols(const SymbolIndex* symbols) {
+  this->symbols = symbols;
+}
+
 void InterfaceDisassembly::update() {
   static char disassembly_buffer[128];
   static char printing_buffer[128];
@@ -42,6 +47,12 @@ void InterfaceDisassembly::update() {
   helper_draw_box(this->x, this->y, this->width, height, this->color_border, this->color_border, this->color_background, true);
 
   int max_string_width = this->width - 4;
+
+  // current symbol, in the top border
+  if(this->symbols && this->symbols->format(rosco->getPC(), printing_buffer, max_string_width - 2)) {
+    tb_printf(this->x + 2, this->y, this->color_border, this->color_background, " %s ", printing_buffer);
+  }
+
   // draw previous lines
   int y_offset = this->y + 1;
   for(int idx=this->line_previous_count-1; idx>=0; --idx) {
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include "../machine/rosco_m68k.hpp"
+#include "../machine/symbol_index.hpp"
 
 extern "C" {
 #define TB_OPT_TRUECOLOR
@@ -15,6 +16,7 @@ public:
   ~InterfaceDisassembly();
 
   void update();
+  void setSymbols(const SymbolIndex* symbols); // shows where the PC is, by symbol; NULL for none
   uintattr_t color_background;
   uintattr_t color_border;
   uintattr_t color_fg_previous;
@@ -23,6 +25,7 @@ public:
 
 private:
   RoscoM68K* rosco;
+  const SymbolIndex* symbols;
   int x, y;
   int width;
   uint8_t line_previous_count;
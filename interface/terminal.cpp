@@ -40,7 +40,7 @@ InterfaceTerminal::~InterfaceTerminal() {
   vterm_free(this->vterm);
 }
 
-void InterfaceTerminal::input(uint8_t* data, uint32_t length) {
+void InterfaceTerminal::input(const uint8_t* data, uint32_t length) {
   vterm_input_write(this->vterm, (const char*)data, (size_t)length);
   this->update();
 }
@@ -15,7 +15,7 @@ public:
   InterfaceTerminal(int x, int y, int width, int height);
   ~InterfaceTerminal();
 
-  void input(uint8_t* data, uint32_t length);
+  void input(const uint8_t* data, uint32_t length);
   void update();
   bool handleEvent(struct tb_event* event);
   void setEventForwarder(terminalEventForwarder forwarder, void* forwarder_callback_data);
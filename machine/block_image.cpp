@@ -0,0 +1,296 @@
+#include "block_image.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define BLOCK_IMAGE_IO_URING
+#endif
+}
+
+BlockImage* BlockImage::open(const char* image_path, uint32_t block_size, bool use_io_uring) {
+  if(!block_size) { throw "invalid disk image block size"; }
+  BlockImage* image = new BlockImage(block_size);
+
+  image->image_file = ::open(image_path, O_RDWR | O_CLOEXEC);
+  if((image->image_file < 0) && ((errno == EACCES) || (errno == EROFS) || (errno == EPERM))) {
+    image->image_file = ::open(image_path, O_RDONLY | O_CLOEXEC);
+    image->read_only  = true;
+  }
+  if(image->image_file < 0) { delete image; throw "error opening disk image"; }
+
+  struct stat image_stat;
+  if(fstat(image->image_file, &image_stat) != 0) { delete image; throw "error opening disk image"; }
+  image->block_count = (uint64_t)image_stat.st_size / block_size;
+  if(!image->block_count) { delete image; throw "disk image smaller than one block"; }
+
+  if(!use_io_uring || !image->ringSetup()) {
+    for(uint32_t index=0; index<BLOCK_IMAGE_THREADS; ++index) { image->workers.emplace_back(&BlockImage::workerThread, image); }
+  }
+  return image;
+}
+
+BlockImage::BlockImage(uint32_t block_size) {
+  this->image_file       = -1;
+  this->block_size       = block_size;
+  this->block_count      = 0;
+  this->read_only        = false;
+  this->in_flight        = 0;
+  this->ring_file        = -1;
+  this->workers_stopping = false;
+}
+
+BlockImage::~BlockImage() {
+  // buffers are the submitters', and the kernel (or a worker) may still be using them
+  block_image_completion completion;
+  while(this->in_flight && this->collect(&completion, true)) {}
+
+  {
+    std::lock_guard<std::mutex> lock(this->worker_lock);
+    this->workers_stopping = true;
+  }
+  this->worker_wake.notify_all();
+  for(std::thread& worker : this->workers) { worker.join(); }
+
+  this->ringTeardown();
+  if(this->image_file >= 0) { close(this->image_file); }
+}
+
+uint64_t BlockImage::blockCount() {
+  return this->block_count;
+}
+
+bool BlockImage::readOnly() {
+  return this->read_only;
+}
+
+const char* BlockImage::backend() {
+  return (this->ring_file >= 0) ? "io_uring" : "threads";
+}
+
+bool BlockImage::submitRead(uint64_t block, uint32_t count, uint8_t* buffer, uint64_t tag) {
+  return this->submit(false, block, count, buffer, tag);
+}
+
+bool BlockImage::submitWrite(uint64_t block, uint32_t count, const uint8_t* buffer, uint64_t tag) {
+  if(this->read_only) { return false; }
+  return this->submit(true, block, count, (uint8_t*)buffer, tag);
+}
+
+bool BlockImage::poll(block_image_completion* completion) {
+  return this->collect(completion, false);
+}
+
+bool BlockImage::wait(block_image_completion* completion) {
+  return this->collect(completion, true);
+}
+
+uint32_t BlockImage::pending() {
+  return this->in_flight;
+}
+
+bool BlockImage::submit(bool write, uint64_t block, uint32_t count, uint8_t* buffer, uint64_t tag) {
+  if(!count || (block >= this->block_count) || (count > (this->block_count - block))) { return false; }
+  if(this->in_flight >= BLOCK_IMAGE_QUEUE_DEPTH) { return false; }
+
+  block_request request = {
+    .write  = write,
+    .result = 0,
+    .tag    = tag,
+    .offset = block * this->block_size,
+    .buffer = buffer,
+    .length = (size_t)count * this->block_size,
+  };
+  if(this->ring_file >= 0) {
+    if(!this->ringSubmit(&request)) { return false; }
+  } else {
+    {
+      std::lock_guard<std::mutex> lock(this->worker_lock);
+      this->worker_queue.push_back(request);
+    }
+    this->worker_wake.notify_one();
+  }
+  ++(this->in_flight);
+  return true;
+}
+
+bool BlockImage::collect(block_image_completion* completion, bool wait) {
+  if(!this->in_flight) { return false; }
+
+  if(this->ring_file >= 0) {
+    if(!this->ringCollect(completion, wait)) { return false; }
+  } else {
+    std::unique_lock<std::mutex> lock(this->worker_lock);
+    if(wait) { this->worker_done.wait(lock, [this]() { return !this->worker_finished.empty(); }); }
+    if(this->worker_finished.empty()) { return false; }
+    block_request* request = &(this->worker_finished.front());
+    completion->tag    = request->tag;
+    completion->result = request->result;
+    this->worker_finished.pop_front();
+  }
+  --(this->in_flight);
+  return true;
+}
+
+void BlockImage::workerThread() {
+  while(true) {
+    block_request request;
+    {
+      std::unique_lock<std::mutex> lock(this->worker_lock);
+      this->worker_wake.wait(lock, [this]() { return this->workers_stopping || !this->worker_queue.empty(); });
+      if(this->worker_queue.empty()) { return; }
+      request = this->worker_queue.front();
+      this->worker_queue.pop_front();
+    }
+
+    size_t done = 0;
+    request.result = 0;
+    while(done < request.length) {
+      ssize_t moved = request.write ?
+        pwrite(this->image_file, request.buffer + done, request.length - done, (off_t)(request.offset + done)) :
+        pread (this->image_file, request.buffer + done, request.length - done, (off_t)(request.offset + done));
+      if(moved < 0) {
+        if(errno == EINTR) { continue; }
+        request.result = -errno;
+        break;
+      }
+      if(moved == 0) { request.result = -EIO; break; } // image shrank underneath us
+      done += (size_t)moved;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->worker_lock);
+      this->worker_finished.push_back(request);
+    }
+    this->worker_done.notify_all();
+  }
+}
+
+#if defined(BLOCK_IMAGE_IO_URING)
+
+static int ioUringSetup(uint32_t entries, struct io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int ring_file, uint32_t submit, uint32_t complete, uint32_t flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_file, submit, complete, flags, NULL, 0);
+}
+
+bool BlockImage::ringSetup() {
+  this->ring_submit_map   = MAP_FAILED;
+  this->ring_complete_map = MAP_FAILED;
+  this->ring_entries_map  = MAP_FAILED;
+
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  this->ring_file = ioUringSetup(BLOCK_IMAGE_QUEUE_DEPTH, &params);
+  if(this->ring_file < 0) { return false; } // not supported, or not permitted (ex: seccomp); threads it is
+  // IORING_OP_READ/WRITE came with 5.6; FAST_POLL with 5.7, so it's a safe sign of them
+  if(!(params.features & IORING_FEAT_FAST_POLL)) { this->ringTeardown(); return false; }
+
+  this->ring_submit_map_length   = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+  this->ring_complete_map_length = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+  this->ring_entries_map_length  = params.sq_entries * sizeof(struct io_uring_sqe);
+  bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if(single_map && (this->ring_complete_map_length > this->ring_submit_map_length)) { this->ring_submit_map_length = this->ring_complete_map_length; }
+
+  this->ring_submit_map = mmap(NULL, this->ring_submit_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_file, IORING_OFF_SQ_RING);
+  if(this->ring_submit_map == MAP_FAILED) { this->ringTeardown(); return false; }
+  if(!single_map) {
+    this->ring_complete_map = mmap(NULL, this->ring_complete_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_file, IORING_OFF_CQ_RING);
+    if(this->ring_complete_map == MAP_FAILED) { this->ringTeardown(); return false; }
+  }
+  this->ring_entries_map = mmap(NULL, this->ring_entries_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_file, IORING_OFF_SQES);
+  if(this->ring_entries_map == MAP_FAILED) { this->ringTeardown(); return false; }
+
+  uint8_t* submit   = (uint8_t*)this->ring_submit_map;
+  uint8_t* complete = single_map ? submit : (uint8_t*)this->ring_complete_map;
+  this->ring_submit_head   = (uint32_t*)(submit + params.sq_off.head);
+  this->ring_submit_tail   = (uint32_t*)(submit + params.sq_off.tail);
+  this->ring_submit_mask   = *(uint32_t*)(submit + params.sq_off.ring_mask);
+  this->ring_submit_array  = (uint32_t*)(submit + params.sq_off.array);
+  this->ring_complete_head = (uint32_t*)(complete + params.cq_off.head);
+  this->ring_complete_tail = (uint32_t*)(complete + params.cq_off.tail);
+  this->ring_complete_mask = *(uint32_t*)(complete + params.cq_off.ring_mask);
+  this->ring_completions   = complete + params.cq_off.cqes;
+  this->ring_entries       = this->ring_entries_map;
+
+  this->ring_requests.resize(BLOCK_IMAGE_QUEUE_DEPTH);
+  for(uint32_t slot=BLOCK_IMAGE_QUEUE_DEPTH; slot>0; --slot) { this->ring_free.push_back(slot - 1); }
+  return true;
+}
+
+void BlockImage::ringTeardown() {
+  if(this->ring_file < 0) { return; }
+  if(this->ring_entries_map  != MAP_FAILED) { munmap(this->ring_entries_map,  this->ring_entries_map_length);  }
+  if(this->ring_complete_map != MAP_FAILED) { munmap(this->ring_complete_map, this->ring_complete_map_length); }
+  if(this->ring_submit_map   != MAP_FAILED) { munmap(this->ring_submit_map,   this->ring_submit_map_length);   }
+  close(this->ring_file);
+  this->ring_file = -1;
+}
+
+bool BlockImage::ringSubmit(block_request* request) {
+  if(this->ring_free.empty()) { return false; }
+  uint32_t slot = this->ring_free.back();
+  this->ring_free.pop_back();
+  this->ring_requests[slot] = *request;
+
+  // we're the only producer, so the tail is ours to read plainly; the kernel sees the entry once the tail is published
+  uint32_t tail  = *(this->ring_submit_tail);
+  uint32_t index = tail & this->ring_submit_mask;
+  struct io_uring_sqe* entry = &(((struct io_uring_sqe*)this->ring_entries)[index]);
+  memset(entry, 0, sizeof(*entry));
+  entry->opcode    = request->write ? IORING_OP_WRITE : IORING_OP_READ;
+  entry->fd        = this->image_file;
+  entry->off       = request->offset;
+  entry->addr      = (uint64_t)(uintptr_t)request->buffer;
+  entry->len       = (uint32_t)request->length;
+  entry->user_data = slot;
+  this->ring_submit_array[index] = index;
+  __atomic_store_n(this->ring_submit_tail, tail + 1, __ATOMIC_RELEASE);
+
+  // anything the kernel doesn't take now (EINTR, EAGAIN) stays on the ring, and goes with the next enter
+  uint32_t unsubmitted = (tail + 1) - __atomic_load_n(this->ring_submit_head, __ATOMIC_ACQUIRE);
+  ioUringEnter(this->ring_file, unsubmitted, 0, 0);
+  return true;
+}
+
+bool BlockImage::ringCollect(block_image_completion* completion, bool wait) {
+  while(true) {
+    uint32_t head = *(this->ring_complete_head);
+    if(head != __atomic_load_n(this->ring_complete_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe* entry = &(((struct io_uring_cqe*)this->ring_completions)[head & this->ring_complete_mask]);
+      uint32_t slot   = (uint32_t)entry->user_data;
+      int32_t  result = entry->res;
+      __atomic_store_n(this->ring_complete_head, head + 1, __ATOMIC_RELEASE);
+
+      block_request* request = &(this->ring_requests[slot]);
+      completion->tag    = request->tag;
+      completion->result = (result < 0) ? result : (((size_t)result == request->length) ? 0 : -EIO); // short only past the end
+      this->ring_free.push_back(slot);
+      return true;
+    }
+
+    uint32_t unsubmitted = *(this->ring_submit_tail) - __atomic_load_n(this->ring_submit_head, __ATOMIC_ACQUIRE);
+    if(!wait) {
+      if(unsubmitted) { ioUringEnter(this->ring_file, unsubmitted, 0, 0); }
+      return false;
+    }
+    if((ioUringEnter(this->ring_file, unsubmitted, 1, IORING_ENTER_GETEVENTS) < 0) &&
+       (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) { return false; }
+  }
+}
+
+#else
+
+bool BlockImage::ringSetup() { return false; }
+void BlockImage::ringTeardown() {}
+bool BlockImage::ringSubmit(block_request* request) { return false; }
+bool BlockImage::ringCollect(block_image_completion* completion, bool wait) { return false; }
+
+#endif
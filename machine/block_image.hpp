@@ -0,0 +1,163 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define BLOCK_IMAGE_QUEUE_DEPTH 32 // most requests in flight at once
+#define BLOCK_IMAGE_THREADS     2  // workers, when io_uring isn't available
+
+/**
+ * one finished request
+ **/
+typedef struct {
+  uint64_t tag;    // as given at submission
+  int32_t  result; // 0 on success, or a negative errno
+} block_image_completion;
+
+/**
+ * Disk image, for emulated storage (SD cards, IDE/CF), read and written asynchronously
+ * requests are handed to io_uring where the kernel supports it, or to a small pool of threads doing pread/pwrite otherwise;
+ * the emulation thread submits, and later collects completions, without waiting on the host in between.
+ * buffers belong to the request until it completes; the image is closed only once nothing is in flight
+ **/
+class BlockImage {
+public:
+  /**
+   * Open a disk image; it's opened read-only (and reported as such) if it can't be written
+   *
+   * @param image_path path to the image; its size is rounded down to whole blocks
+   * @param block_size bytes per block
+   * @param use_io_uring false to always use the thread pool
+   * @returns new block image
+   **/
+  static BlockImage* open(const char* image_path, uint32_t block_size, bool use_io_uring = true);
+  ~BlockImage();
+
+  /**
+   * Get image capacity
+   *
+   * @returns count of blocks
+   **/
+  uint64_t blockCount();
+
+  /**
+   * Check whether the image is write protected
+   *
+   * @returns whether writes are refused
+   **/
+  bool readOnly();
+
+  /**
+   * Get the backend in use
+   *
+   * @returns "io_uring", or "threads"
+   **/
+  const char* backend();
+
+  /**
+   * Start reading blocks
+   *
+   * @param block first block
+   * @param count count of blocks
+   * @param buffer receives count blocks; must stay valid until the request completes
+   * @param tag returned with the completion
+   * @returns whether the request was queued (false: out of range, or BLOCK_IMAGE_QUEUE_DEPTH requests already in flight)
+   **/
+  bool submitRead(uint64_t block, uint32_t count, uint8_t* buffer, uint64_t tag);
+
+  /**
+   * Start writing blocks
+   *
+   * @param block first block
+   * @param count count of blocks
+   * @param buffer count blocks to write; must stay valid, and unchanged, until the request completes
+   * @param tag returned with the completion
+   * @returns whether the request was queued (false: read-only, out of range, or BLOCK_IMAGE_QUEUE_DEPTH requests already in flight)
+   **/
+  bool submitWrite(uint64_t block, uint32_t count, const uint8_t* buffer, uint64_t tag);
+
+  /**
+   * Collect a finished request, if there is one; never waits
+   *
+   * @param completion receives the finished request
+   * @returns whether a request had finished
+   **/
+  bool poll(block_image_completion* completion);
+
+  /**
+   * Collect a finished request, waiting for one if need be
+   *
+   * @param completion receives the finished request
+   * @returns whether a request finished (false: nothing was in flight)
+   **/
+  bool wait(block_image_completion* completion);
+
+  /**
+   * Get count of requests submitted, and not yet collected
+   *
+   * @returns count of requests in flight
+   **/
+  uint32_t pending();
+
+protected:
+  typedef struct {
+    bool     write;
+    int32_t  result;
+    uint64_t tag;
+    uint64_t offset;
+    uint8_t* buffer;
+    size_t   length;
+  } block_request;
+
+  BlockImage(uint32_t block_size);
+  bool submit(bool write, uint64_t block, uint32_t count, uint8_t* buffer, uint64_t tag);
+  bool collect(block_image_completion* completion, bool wait);
+
+  int      image_file;
+  uint32_t block_size;
+  uint64_t block_count;
+  bool     read_only;
+  uint32_t in_flight;
+
+  // io_uring
+  bool ringSetup();
+  void ringTeardown();
+  bool ringSubmit(block_request* request);
+  bool ringCollect(block_image_completion* completion, bool wait);
+  int       ring_file;           // or -1, when using threads
+  void*     ring_submit_map;
+  size_t    ring_submit_map_length;
+  void*     ring_complete_map;
+  size_t    ring_complete_map_length;
+  void*     ring_entries_map;
+  size_t    ring_entries_map_length;
+  uint32_t* ring_submit_head;
+  uint32_t* ring_submit_tail;
+  uint32_t  ring_submit_mask;
+  uint32_t* ring_submit_array;
+  uint32_t* ring_complete_head;
+  uint32_t* ring_complete_tail;
+  uint32_t  ring_complete_mask;
+  void*     ring_completions;
+  void*     ring_entries;
+  std::vector<block_request> ring_requests; // by slot; user_data is the slot index
+  std::vector<uint32_t>      ring_free;     // free slots
+
+  // thread pool
+  void workerThread();
+  std::vector<std::thread>  workers;
+  std::mutex                worker_lock;
+  std::condition_variable   worker_wake;    // work queued, or stopping
+  std::condition_variable   worker_done;    // a request finished
+  std::deque<block_request> worker_queue;
+  std::deque<block_request> worker_finished;
+  bool                      workers_stopping;
+};
@@ -1,8 +1,25 @@
 #include "duart_68681.hpp"
 #define UNINITIALIZED_VECTOR 0x0F
+#define XTAL_FREQUENCY 3686400.0
+
+// bit rates by clock select code, for ACR bit 7 == 0 & 1; 0 == not a fixed rate
+static const double duart_bit_rates[2][16] = {
+  { 50.0, 110.0, 134.5, 200.0, 300.0, 600.0, 1200.0, 1050.0, 2400.0, 4800.0, 7200.0, 9600.0, 38400.0, 0.0, 0.0, 0.0 },
+  { 75.0, 110.0, 134.5, 150.0, 300.0, 600.0, 1200.0, 2000.0, 2400.0, 4800.0, 1800.0, 9600.0, 19200.0, 0.0, 0.0, 0.0 },
+};
 
 Duart68681::Duart68681() : port_a(0), port_b(1) {
-  this->standby_mode = false;
+  this->serial_timing_accurate  = false;
+  this->serial_timing_frequency = 0;
+  this->clock_now               = 0;
+  this->port_a.setClockSource(&(this->clock_now));
+  this->port_b.setClockSource(&(this->clock_now));
+  this->standby_mode     = false;
+  this->input_port_value = 0x00; // CTSA & CTSB asserted (active low)
+  this->input_port_observer      = NULL;
+  this->input_port_observer_data = NULL;
+  this->time_source      = NULL;
+  this->time_source_data = NULL;
   this->reset();
 }
 
@@ -17,7 +34,16 @@ void Duart68681::reset() {
   this->input_port_changes = this->input_port_value; // whatever is causing the input should reset itself too, and call setInputPort()
   this->auxiliary_control  = 0x00;
   this->counter_timer      = 0x0000;
+  this->timer_started           = false;
+  this->timer_cleared           = false;
+  this->timer_interrupt_current = 0;
+  this->timer_interrupt_next    = 0;
+  this->timer_interval          = 0;
   this->output_port        = 0x00;
+  this->output_port_configuration = 0x00;
+  this->spi_bus.reset();
+  this->outputPortChanged();
+  this->serialTimingChanged();
 }
 
 void Duart68681::serialPortReceive(uint8_t port, uint8_t data) {
@@ -28,12 +54,164 @@ void Duart68681::serialPortReceive(uint8_t port, uint8_t data) {
   if(port == 1) { this->port_b.receive(data); }
 }
 
+uint32_t Duart68681::serialPortReceiveBulk(uint8_t port, const uint8_t* data, uint32_t length) {
+  if(this->standby_mode) { return 0; }
+
+  if(port == 0) { return this->port_a.receiveBulk(data, length); }
+  if(port == 1) { return this->port_b.receiveBulk(data, length); }
+  return 0;
+}
+
+void Duart68681::setSerialGate(bool gated) {
+  this->port_a.setReceiveGate(gated);
+  this->port_b.setReceiveGate(gated);
+}
+
+uint32_t Duart68681::serialPortAdmit(uint8_t port, uint8_t* data, uint32_t length) {
+  if(port == 0) { return this->port_a.receiveAdmit(data, length); }
+  if(port == 1) { return this->port_b.receiveAdmit(data, length); }
+  return 0;
+}
+
+uint32_t Duart68681::serialPortInject(uint8_t port, const uint8_t* data, uint32_t length) {
+  if(port == 0) { return this->port_a.receiveInject(data, length); }
+  if(port == 1) { return this->port_b.receiveInject(data, length); }
+  return 0;
+}
+
+uint32_t Duart68681::serialPortReceiveSpace(uint8_t port) {
+  if(this->standby_mode) { return 0; }
+
+  if(port == 0) { return this->port_a.receiveSpace(); }
+  if(port == 1) { return this->port_b.receiveSpace(); }
+  return 0;
+}
+
+void Duart68681::serialPortQueue(uint8_t port, const uint8_t* data, uint32_t length) {
+  if(port == 0) { this->port_a.queue(data, length); }
+  if(port == 1) { this->port_b.queue(data, length); }
+}
+
+uint32_t Duart68681::serialPortQueueLength(uint8_t port) {
+  if(port == 0) { return this->port_a.queueLength(); }
+  if(port == 1) { return this->port_b.queueLength(); }
+  return 0;
+}
+
+uint32_t Duart68681::serialPortTake(uint8_t port, uint8_t* data, uint32_t length) {
+  if(this->standby_mode) { return 0; }
+
+  if(port == 0) { return this->port_a.receiveTake(data, length); }
+  if(port == 1) { return this->port_b.receiveTake(data, length); }
+  return 0;
+}
+
+void Duart68681::setSerialFlowControl(uint8_t port, bool enabled) {
+  if(port == 0) { this->port_a.setFlowControl(enabled); }
+  if(port == 1) { this->port_b.setFlowControl(enabled); }
+}
+
+void Duart68681::serialPortClearToSend(uint8_t port, bool asserted) {
+  if(port > 1) { return; }
+  // IP0 == CTSA, IP1 == CTSB; active low
+  uint8_t bit = 1 << port;
+  this->setInputPort(asserted ? (this->input_port_value & ~bit) : (this->input_port_value | bit));
+}
+
+bool Duart68681::serialPortRequestToSend(uint8_t port) {
+  if(port == 0) { return this->port_a.requestToSend(); }
+  if(port == 1) { return this->port_b.requestToSend(); }
+  return false;
+}
+
+void Duart68681::setSerialTiming(bool baud_accurate, uint32_t clock_frequency) {
+  this->serial_timing_accurate  = baud_accurate;
+  this->serial_timing_frequency = clock_frequency;
+  this->serialTimingChanged();
+}
+
+void Duart68681::setClock(int64_t clock) {
+  this->clock_now = clock;
+}
+
+int64_t Duart68681::nextEvent() {
+  int64_t next_a = this->port_a.nextEvent();
+  int64_t next_b = this->port_b.nextEvent();
+  return (next_a < next_b) ? next_a : next_b;
+}
+
+double Duart68681::serialBitRate(uint8_t clock_select) {
+  double rate = duart_bit_rates[(this->auxiliary_control & 0x80) ? 1 : 0][clock_select & 0x0F];
+  if((clock_select & 0x0F) == 0x0D) {
+    // counter/timer, in timer mode, from the crystal
+    if(!this->counter_timer) { return 0.0; }
+    if((this->auxiliary_control & 0x70) == 0x60) { rate = XTAL_FREQUENCY         / (32.0 * this->counter_timer); }
+    if((this->auxiliary_control & 0x70) == 0x70) { rate = (XTAL_FREQUENCY / 16.0) / (32.0 * this->counter_timer); }
+  }
+  return rate; // external clocks (IP3/IP4/IP5) aren't modelled; those run instant
+}
+
+void Duart68681::serialTimingChanged() {
+  Duart68681Uart* ports[2] = { &(this->port_a), &(this->port_b) };
+  for(Duart68681Uart* port : ports) {
+    int64_t receive_cycles  = 0;
+    int64_t transmit_cycles = 0;
+    if(this->serial_timing_accurate && this->serial_timing_frequency) {
+      // 10 bit times per character: start, 8 data, stop
+      double receive_rate  = this->serialBitRate(port->clockSelect() >> 4);
+      double transmit_rate = this->serialBitRate(port->clockSelect() & 0x0F);
+      if(receive_rate  > 0.0) { receive_cycles  = (int64_t)((10.0 * this->serial_timing_frequency / receive_rate)  + 0.5); }
+      if(transmit_rate > 0.0) { transmit_cycles = (int64_t)((10.0 * this->serial_timing_frequency / transmit_rate) + 0.5); }
+    }
+    port->setCharacterTime(receive_cycles, transmit_cycles);
+  }
+}
+
+void Duart68681::outputPortChanged() {
+  // OP pins are the complement of OPR bits; OP0 == RTSA, OP1 == RTSB, active low, so a set bit asserts RTS
+  this->port_a.setRequestToSend((this->output_port & 0x01) != 0);
+  this->port_b.setRequestToSend((this->output_port & 0x02) != 0);
+
+  // pins given over to other functions by OPCR stop following OPR; as far as the SPI bus is concerned they sit high
+  uint8_t pins = ~this->output_port;
+  if(this->output_port_configuration & 0x03) { pins |= 0x04; } // OP2: TxCA/RxCA clock
+  if(this->output_port_configuration & 0x0C) { pins |= 0x08; } // OP3: C/T output, or TxCB/RxCB clock
+  pins |= this->output_port_configuration & 0xF0;             // OP4-OP7: interrupt outputs, one OPCR bit each
+  this->spi_bus.outputChanged(pins);
+}
+
+void Duart68681::attachSpiDevice(uint8_t select, SpiDevice* device) {
+  this->spi_bus.attach(select, device);
+}
+
+bool Duart68681::spiTransfer(const uint8_t* output, uint8_t* input, uint32_t length) {
+  if(this->standby_mode) { return false; }
+  if(this->output_port_configuration & 0xD3) { return false; } // OP2 (bits 0-1), OP4, OP6, or OP7 not general purpose, as in outputPortChanged()
+  if(!this->spi_bus.transfer(output, input, length)) { return false; }
+  if(!length) { return true; }
+
+  // MOSI pin high == OPR bit clear
+  uint8_t last = output ? output[length - 1] : 0xFF;
+  if(last & 1) { this->output_port &= ~SPI_BUS_PIN_MOSI; } else { this->output_port |= SPI_BUS_PIN_MOSI; }
+  return true;
+}
+
 void Duart68681::setSerialTransmitter(uint8_t port, serialTransmit transmitter, void* callback_data) {
   // where 68681 sends its serial data
   if(port == 0) { this->port_a.setTransmitter(transmitter, callback_data); }
   if(port == 1) { this->port_b.setTransmitter(transmitter, callback_data); }
 }
 
+void Duart68681::setSerialTransmitterBulk(uint8_t port, serialTransmitBulk transmitter, void* callback_data) {
+  if(port == 0) { this->port_a.setTransmitterBulk(transmitter, callback_data); }
+  if(port == 1) { this->port_b.setTransmitterBulk(transmitter, callback_data); }
+}
+
+void Duart68681::serialPortFlush() {
+  this->port_a.transmitFlush();
+  this->port_b.transmitFlush();
+}
+
 uint8_t Duart68681::busRead(uint8_t address) {
   if(this->standby_mode) { return 0x00; }
 
@@ -55,7 +233,10 @@ uint8_t Duart68681::busRead(uint8_t address) {
     case 0x06: return (uint8_t)((this->counter_timer & 0xFF00) >> 8);
     case 0x07: return (uint8_t)(this->counter_timer & 0x00FF);
     case 0x0C: return this->interrupt_vector_register;
-    case 0x0D: return this->input_port_value;
+    case 0x0D: {
+      if(!this->spi_bus.attached()) { return this->input_port_value; }
+      return (this->input_port_value & ~SPI_BUS_INPUT_MISO) | (this->spi_bus.miso() ? SPI_BUS_INPUT_MISO : 0x00);
+    }
     case 0x0E: { this->timerStart(); return 0x00; }
     case 0x0F: { this->timerStop(); return 0x00; }
   }
@@ -76,25 +257,48 @@ void Duart68681::busWrite(uint8_t address, uint8_t data) {
 
   switch(address) {
     case 0x00: this->port_a.busWrite(address, data); break;
-    case 0x01: this->port_a.busWrite(address, data); break;
+    case 0x01: this->port_a.busWrite(address, data); this->serialTimingChanged(); break;
     case 0x02: this->port_a.busWrite(address, data); break;
     case 0x03: this->port_a.busWrite(address, data); break;
     case 0x08: this->port_b.busWrite(address, data); break;
-    case 0x09: this->port_b.busWrite(address, data); break;
+    case 0x09: this->port_b.busWrite(address, data); this->serialTimingChanged(); break;
     case 0x0A: this->port_b.busWrite(address, data); break;
     case 0x0B: this->port_b.busWrite(address, data); break;
 
-    case 0x04: this->auxiliary_control = data; break;
+    case 0x04: this->auxiliary_control = data; this->serialTimingChanged(); break;
     case 0x05: this->interrupt_mask_regsiter = data; break;
-    case 0x06: this->counter_timer = (this->counter_timer & 0x00FF) | (((uint16_t)(data)) << 8);
-    case 0x07: this->counter_timer = (this->counter_timer & 0xFF00) | ((uint16_t)(data));
+    case 0x06: this->counter_timer = (this->counter_timer & 0x00FF) | (((uint16_t)(data)) << 8); this->serialTimingChanged(); break;
+    case 0x07: this->counter_timer = (this->counter_timer & 0xFF00) | ((uint16_t)(data));        this->serialTimingChanged(); break;
     case 0x0C: this->interrupt_vector_register = data; break;
-    case 0x0D: break; // TODO: output port configuration (OPCR); ignoring this for now
-    case 0x0E: this->output_port |= data; break;
-    case 0x0F: this->output_port &= ~data; break;
+    case 0x0D: this->output_port_configuration = data; this->outputPortChanged(); break;
+    case 0x0E: this->output_port |= data;  this->outputPortChanged(); break;
+    case 0x0F: this->output_port &= ~data; this->outputPortChanged(); break;
   }
 }
 
+void Duart68681::copyState(Duart68681* source) {
+  this->timer_started             = source->timer_started;
+  this->timer_cleared             = source->timer_cleared;
+  this->timer_interrupt_current   = source->timer_interrupt_current;
+  this->timer_interrupt_next      = source->timer_interrupt_next;
+  this->timer_interval            = source->timer_interval;
+  this->standby_mode              = source->standby_mode;
+  this->interrupt_vector_register = source->interrupt_vector_register;
+  this->interrupt_mask_regsiter   = source->interrupt_mask_regsiter;
+  this->input_port_value          = source->input_port_value;
+  this->input_port_changes        = source->input_port_changes;
+  this->auxiliary_control         = source->auxiliary_control;
+  this->counter_timer             = source->counter_timer;
+  this->output_port               = source->output_port;
+  this->output_port_configuration = source->output_port_configuration;
+  this->serial_timing_accurate    = source->serial_timing_accurate;
+  this->serial_timing_frequency   = source->serial_timing_frequency;
+  this->clock_now                 = source->clock_now;
+  this->port_a.copyState(&(source->port_a));
+  this->port_b.copyState(&(source->port_b));
+  this->spi_bus.copyState(&(source->spi_bus));
+}
+
 uint8_t Duart68681::readVector() {
   return this->interrupt_vector_register;
 }
@@ -104,7 +308,7 @@ uint8_t Duart68681::getIsr() {
 
   uint8_t interrupt_bits = 0;
   interrupt_bits |= this->port_a.pollForInterrupt();            // bits 0,1,2
-  interrupt_bits |= this->port_b.pollForInterrupt() << 2;       // bits 4,5,6
+  interrupt_bits |= this->port_b.pollForInterrupt() << 4;       // bits 4,5,6
   interrupt_bits |= (port_change_interrupt ? 1 : 0) << 7;       // bit 7
   interrupt_bits |= (this->timerCheckInterrupt() ? 1 : 0) << 3; // bit 3
 
@@ -120,6 +324,24 @@ void Duart68681::setInputPort(uint8_t value) {
   value &= 0x3F;
   this->input_port_changes = this->input_port_value ^ value;
   this->input_port_value = value;
+  this->port_a.setClearToSend((value & 0x01) == 0);
+  this->port_b.setClearToSend((value & 0x02) == 0);
+  if(this->input_port_observer) { this->input_port_observer(value, this->input_port_observer_data); }
+}
+
+void Duart68681::setInputPortObserver(duartInputPortObserver observer, void* callback_data) {
+  this->input_port_observer      = observer;
+  this->input_port_observer_data = callback_data;
+}
+
+void Duart68681::setTimeSource(duartTimeSource source, void* callback_data) {
+  this->time_source      = source;
+  this->time_source_data = callback_data;
+}
+
+time_t Duart68681::timeNow() {
+  if(this->time_source) { return this->time_source(this->time_source_data); }
+  return time(NULL);
 }
 
 uint8_t Duart68681::readOutputPort() {
@@ -157,7 +379,7 @@ void Duart68681::timerStart() {
   double f_frequency    = (f_base / f_divisor) / (2.0 * f_counter);
   double f_milliseconds = 1000.0 / f_frequency;
 
-  time_t now = time(NULL);
+  time_t now = this->timeNow();
   this->timer_interval          = (time_t)f_milliseconds;
   this->timer_started           = true;
   this->timer_cleared           = false;
@@ -172,7 +394,7 @@ void Duart68681::timerStop() {
 bool Duart68681::timerCheckInterrupt() {
   if(!timer_started) { return false; }
 
-  time_t now = time(NULL);
+  time_t now = this->timeNow();
 
   if(now >= this->timer_interrupt_next) {
     this->timer_cleared           = false;
@@ -7,12 +7,19 @@ extern "C" {
 }
 #include "interrupt_source.hpp"
 #include "duart_68681_uart.hpp"
+#include "spi_bus.hpp"
 
 #define DUART_68681_PORT_A 0
 #define DUART_68681_PORT_B 1
 
 /// @brief callback function used by serial ports to transmit data
 typedef void (*serialTransmit)(uint8_t port, uint8_t transmit_data, void* callback_data);
+/// @brief callback function used by serial ports to transmit a run of buffered data
+typedef void (*serialTransmitBulk)(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data);
+/// @brief callback function used by the counter/timer to read the host time
+typedef time_t (*duartTimeSource)(void* callback_data);
+/// @brief callback function told of every input port change
+typedef void (*duartInputPortObserver)(uint8_t value, void* callback_data);
 
 /**
  * XC68C681 Dual UART Controller (plus Counter/Timer & GPIO)
@@ -36,12 +43,129 @@ public:
   void busWrite(uint8_t address, uint8_t data);
 
   /**
-   * Receive data on serial port
+   * Receive data on serial port, on the thread running the machine (other threads queue it; see serialPortQueue())
    * @param port port to receive on (DUART_68681_PORT_A or DUART_68681_PORT_B)
    * @param data data byte to receive
    */
   void serialPortReceive(uint8_t port, uint8_t data);
 
+  /**
+   * Receive a run of data on serial port, on the thread running the machine (other threads queue it; see serialPortQueue())
+   * @param port port to receive on (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param data data bytes to receive
+   * @param length count of data bytes
+   * @returns count of bytes accepted; the rest did not fit (see serialPortReceiveSpace()), and were dropped
+   */
+  uint32_t serialPortReceiveBulk(uint8_t port, const uint8_t* data, uint32_t length);
+
+  /**
+   * Check how many bytes a serial port can currently accept without dropping any
+   * @param port port to check (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @returns count of bytes that may be received; 0 while the receiver is disabled
+   */
+  uint32_t serialPortReceiveSpace(uint8_t port);
+
+  /**
+   * Queue data to send to a serial port; nothing is dropped, the queue grows as needed
+   * bytes are delivered as fast as the guest reads them (and, with flow control, only while it asserts RTS);
+   * any thread may queue, and this is how threads other than the one running the machine feed a port (ex: a serial bridge)
+   * @param port port to receive on (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param data data bytes to queue
+   * @param length count of data bytes
+   */
+  void serialPortQueue(uint8_t port, const uint8_t* data, uint32_t length);
+
+  /**
+   * Get count of queued bytes not yet delivered to the guest
+   * @param port port to check (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @returns count of bytes waiting in the host queue
+   */
+  uint32_t serialPortQueueLength(uint8_t port);
+
+  /**
+   * Take received data, exactly as the guest would by reading the receive holding register until it's empty
+   * (FIFO first, then the backlog); for host-side fast paths, on the thread running the machine
+   * only with instant serial timing; with baud-accurate timing nothing is taken
+   * @param port port to read from (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param data receives the bytes
+   * @param length most bytes to take
+   * @returns count of bytes taken
+   */
+  uint32_t serialPortTake(uint8_t port, uint8_t* data, uint32_t length);
+
+  /**
+   * Gate received data (for recording or replaying it)
+   * while gated, bytes from serialPortReceive(), serialPortReceiveBulk(), and serialPortQueue() wait, unseen by the guest,
+   * until serialPortAdmit() lets them through; bytes received but not yet read by the guest go back behind the gate
+   * @param gated whether received data should wait to be admitted
+   */
+  void setSerialGate(bool gated);
+
+  /**
+   * Let received data through the gate, on the thread running the machine
+   * @param port port to admit on (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param data receives a copy of the bytes admitted
+   * @param length most bytes to admit
+   * @returns count of bytes admitted
+   */
+  uint32_t serialPortAdmit(uint8_t port, uint8_t* data, uint32_t length);
+
+  /**
+   * Receive data already past the gate (ex: replaying what serialPortAdmit() let through), on the thread running the machine
+   * goes in whether or not the receiver is enabled, just as it was when first admitted; while injecting, nothing else may
+   * receive on the port (queued bytes wait, as the gate holds them)
+   * @param port port to receive on (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param data data bytes to receive
+   * @param length count of data bytes
+   * @returns count of bytes accepted; the rest did not fit, and were dropped
+   */
+  uint32_t serialPortInject(uint8_t port, const uint8_t* data, uint32_t length);
+
+  /**
+   * Enable RTS/CTS flow control for queued input (disabled by default)
+   * when enabled, queued bytes are only delivered while the guest asserts RTS (OP0/OP1), or has MR1 RxRTS control set
+   * @param port port to configure (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param enabled whether to honour RTS
+   */
+  void setSerialFlowControl(uint8_t port, bool enabled);
+
+  /**
+   * Drive the CTS input (IP0/IP1) of a serial port; asserted by default
+   * while negated, a transmitter with MR2 CTS control set holds its data
+   * @param port port to drive (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param asserted whether the host is ready to receive
+   */
+  void serialPortClearToSend(uint8_t port, bool asserted);
+
+  /**
+   * Read the RTS output (OP0/OP1) of a serial port
+   * @param port port to read (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @returns whether the guest is ready to receive
+   */
+  bool serialPortRequestToSend(uint8_t port);
+
+  /**
+   * Select serial timing mode
+   * instant (the default): characters are sent and received as fast as the guest can move them;
+   * baud-accurate: each character takes 10 bit times at the rate set by CSRA/CSRB (and ACR bit 7, or the counter/timer),
+   * measured on the emulated clock (see setClock())
+   * @param baud_accurate whether to use baud-accurate timing
+   * @param clock_frequency frequency of the clock given to setClock(), in Hz
+   */
+  void setSerialTiming(bool baud_accurate, uint32_t clock_frequency);
+
+  /**
+   * Update the emulated clock, used for baud-accurate serial timing (only needed in that mode)
+   * @param clock current emulated clock cycle
+   */
+  void setClock(int64_t clock);
+
+  /**
+   * Get the emulated clock cycle of the next scheduled serial event (a character finishing transmit, or arriving)
+   * @returns clock cycle; INT64_MAX if nothing is scheduled
+   */
+  int64_t nextEvent();
+
   /**
    * Set transmitter callback for serial port
    * @param port port to receive on (DUART_68681_PORT_A or DUART_68681_PORT_B)
@@ -50,18 +174,70 @@ public:
    */
   void setSerialTransmitter(uint8_t port, serialTransmit transmitter, void* callback_data);
 
+  /**
+   * Set buffered transmitter callback for serial port (replaces any set with setSerialTransmitter())
+   * transmitted bytes are collected, and handed over on newline, when the buffer fills, or on serialPortFlush()
+   * @param port port to transmit on (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param transmitter callback to use for this port
+   * @param callback_data extra data to pass when callback is called
+   */
+  void setSerialTransmitterBulk(uint8_t port, serialTransmitBulk transmitter, void* callback_data);
+
+  /**
+   * Hand any buffered transmitted data over to the bulk transmitter callbacks
+   */
+  void serialPortFlush();
+
   /**
    * Set input port values
    * @param value 6 bit value (0-63) to set on input port
    */
   void setInputPort(uint8_t value);
 
+  /**
+   * Set a callback to be told of every input port change (including CTS, from serialPortClearToSend())
+   * @param observer callback, or NULL for none
+   * @param callback_data extra data to pass when callback is called
+   */
+  void setInputPortObserver(duartInputPortObserver observer, void* callback_data);
+
+  /**
+   * Set where the counter/timer reads the host time from (time() by default)
+   * @param source callback, or NULL for time()
+   * @param callback_data extra data to pass when callback is called
+   */
+  void setTimeSource(duartTimeSource source, void* callback_data);
+
   /**
    * Read output port values
    * @returns value 8 bit output port value
    */
   uint8_t readOutputPort();
 
+  /**
+   * Attach an SPI device to the bit-banged SPI bus on the output port (OP2/OP7 chip selects, OP4 clock, OP6 MOSI, IP2 MISO)
+   * while any device is attached, IP2 reads MISO
+   * @param select chip select (SPI_BUS_SELECT_A for OP2, or SPI_BUS_SELECT_B for OP7)
+   * @param device device to attach (not owned), or NULL to detach
+   */
+  void attachSpiDevice(uint8_t select, SpiDevice* device);
+
+  /**
+   * Move whole bytes over the SPI bus, with the same result as the guest bit-banging them through OPR and IP2
+   * (OPR is left as the last bit would leave it); for host-side fast paths
+   * @param output bytes to send, or NULL to send 0xFF
+   * @param input receives the bytes read back, or NULL to discard them
+   * @param length count of bytes
+   * @returns whether the bytes were moved; false if the bus is part way through a byte, or its pins are configured for other functions
+   */
+  bool spiTransfer(const uint8_t* output, uint8_t* input, uint32_t length);
+
+  /**
+   * Copy register/buffer state from another DUART (serial transmitters are kept as they are)
+   * @param source DUART to copy from
+   */
+  void copyState(Duart68681* source);
+
   // InterrupSource implementation
   void    reset() override;
   uint8_t readVector() override;
@@ -71,6 +247,9 @@ protected:
   void timerStart();
   void timerStop();
   bool timerCheckInterrupt();
+  time_t timeNow();
+  duartTimeSource time_source;
+  void*           time_source_data;
   bool timer_started;
   bool timer_cleared;
   time_t timer_interrupt_current;
@@ -87,13 +266,22 @@ protected:
 
   uint8_t input_port_value;
   uint8_t input_port_changes;
+  duartInputPortObserver input_port_observer;
+  void*                  input_port_observer_data;
   uint8_t auxiliary_control;
 
   uint16_t counter_timer;
   uint8_t output_port;
-};
+  uint8_t output_port_configuration;
+  void outputPortChanged();
+  SpiBus spi_bus;
 
-// TODO: add SPI interface
+  bool     serial_timing_accurate;
+  uint32_t serial_timing_frequency;
+  int64_t  clock_now;
+  void     serialTimingChanged();
+  double   serialBitRate(uint8_t clock_select);
+};
 
 /*
   XR68C681 Dual UART + GPIO + Counter/Timer
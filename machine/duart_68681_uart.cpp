@@ -1,15 +1,91 @@
 #include "duart_68681_uart.hpp"
+extern "C" {
+#include <string.h>
+}
 
 Duart68681Uart::Duart68681Uart(uint8_t port_number) {
   this->port_number = port_number;
+  this->transmitter_callback = NULL;
+  this->transmitter_bulk_callback = NULL;
+  this->transmitter_callback_data = NULL;
+  this->transmit_buffer_length = 0;
+  this->receive_ring_head = 0;
+  this->receive_ring_tail = 0;
+  this->receive_gated     = false;
+  this->receive_ring_admitted = 0;
+  this->host_queue_offset = 0;
+  this->host_queue_length = 0;
+  this->flow_control      = false;
+  this->request_to_send   = false;
+  this->clear_to_send     = true;
+  this->transmit_held     = false;
+  this->clock             = NULL;
+  this->receive_character_cycles  = 0;
+  this->transmit_character_cycles = 0;
+  this->receive_line_busy = false;
+  this->receive_next      = 0;
+  this->receive_fifo_length = 0;
+  this->receive_shift_full  = false;
+  this->receive_status      = 0;
+  this->transmit_shifting = false;
+  this->transmit_shift_end = 0;
+}
+
+void Duart68681Uart::copyState(Duart68681Uart* source) {
+  this->receiver_enabled      = source->receiver_enabled.load();
+  this->transmitter_enabled   = source->transmitter_enabled;
+  for(int index=0; index<UART_RECEIVE_FIFO_SIZE; ++index) {
+    this->receive_fifo[index] = source->receive_fifo[index];
+  }
+  this->receive_fifo_length   = source->receive_fifo_length;
+  this->receive_shift_full    = source->receive_shift_full;
+  this->receive_shift_data    = source->receive_shift_data;
+  this->receive_status        = source->receive_status;
+  // bytes still in flight are copied to the front of this ring
+  uint32_t head = source->receive_ring_head.load(std::memory_order_relaxed);
+  uint32_t tail = source->receive_ring_tail.load(std::memory_order_acquire);
+  for(uint32_t index=head; index!=tail; ++index) {
+    this->receive_ring[index - head] = source->receive_ring[index & (UART_RECEIVE_RING_SIZE - 1)];
+  }
+  this->receive_ring_head.store(0, std::memory_order_relaxed);
+  this->receive_ring_tail.store(tail - head, std::memory_order_release);
+  this->receive_gated         = source->receive_gated;
+  this->receive_ring_admitted = source->receive_gated ? (source->receive_ring_admitted - head) : 0;
+  {
+    std::lock_guard<std::mutex> guard(source->host_queue_lock);
+    std::lock_guard<std::mutex> guard_own(this->host_queue_lock);
+    this->host_queue.assign(source->host_queue.begin() + source->host_queue_offset, source->host_queue.end());
+    this->host_queue_offset = 0;
+    this->host_queue_length = (uint32_t)this->host_queue.size();
+  }
+  this->flow_control          = source->flow_control;
+  this->request_to_send       = source->request_to_send;
+  this->clear_to_send         = source->clear_to_send;
+  this->transmit_held         = source->transmit_held;
+  this->transmit_held_data    = source->transmit_held_data;
+  this->receive_character_cycles  = source->receive_character_cycles;
+  this->transmit_character_cycles = source->transmit_character_cycles;
+  this->receive_line_busy     = source->receive_line_busy;
+  this->receive_next          = source->receive_next;
+  this->transmit_shifting     = source->transmit_shifting;
+  this->transmit_shift_data   = source->transmit_shift_data;
+  this->transmit_shift_end    = source->transmit_shift_end;
+  this->register_mode_index   = source->register_mode_index;
+  this->register_mode[0]      = source->register_mode[0];
+  this->register_mode[1]      = source->register_mode[1];
+  this->register_clock_select = source->register_clock_select;
 }
 
 void Duart68681Uart::reset() {
+  this->transmitFlush(); // already sent, as far as the guest is concerned
+  this->transmit_held         = false;
+  this->transmit_shifting     = false;
+  this->receive_line_busy     = false;
+  this->receive_fifo_length   = 0;
+  this->receive_shift_full    = false;
+  this->receive_status        = 0;
   this->receiver_enabled      = false;
   this->transmitter_enabled   = false;
-  this->receive_buffer_index  = 0;
-  this->receive_buffer_length = 0;
-  pthread_mutex_init(&(this->receive_buffer_mutex), NULL);
   this->register_mode_index   = 0;
   this->register_mode[0]      = 0; // TODO default value?
   this->register_mode[1]      = 0; // TODO default value?
@@ -17,28 +93,302 @@ void Duart68681Uart::reset() {
 }
 
 void Duart68681Uart::setTransmitter(serialTransmit transmitter, void* callback_data) {
+  this->transmitFlush();
   this->transmitter_callback = transmitter;
+  this->transmitter_bulk_callback = NULL;
   this->transmitter_callback_data = callback_data;
 }
 
+void Duart68681Uart::setTransmitterBulk(serialTransmitBulk transmitter, void* callback_data) {
+  this->transmitFlush();
+  this->transmitter_callback = NULL;
+  this->transmitter_bulk_callback = transmitter;
+  this->transmitter_callback_data = callback_data;
+}
+
+void Duart68681Uart::transmitFlush() {
+  if(!this->transmit_buffer_length) { return; }
+  uint32_t length = this->transmit_buffer_length;
+  this->transmit_buffer_length = 0;
+  if(this->transmitter_bulk_callback) {
+    this->transmitter_bulk_callback(this->port_number, this->transmit_buffer, length, this->transmitter_callback_data);
+  }
+}
+
 void Duart68681Uart::receive(uint8_t data) {
-  if(this->receive_buffer_length == 0xFF) { return; } // overflow
+  this->receiveBulk(&data, 1);
+}
+
+uint32_t Duart68681Uart::receiveBulk(const uint8_t* data, uint32_t length) {
+  if(this->receiver_enabled == false) { return 0; } // disabled
+  return this->receiveRingWrite(data, length);
+}
+
+uint32_t Duart68681Uart::receiveRingWrite(const uint8_t* data, uint32_t length) {
+  // producer side: only the tail is ours; the head can only move forward (freeing more space) while we work
+  uint32_t tail  = this->receive_ring_tail.load(std::memory_order_relaxed);
+  uint32_t space = UART_RECEIVE_RING_SIZE - (tail - this->receive_ring_head.load(std::memory_order_acquire));
+  if(length > space) { length = space; } // overflow; the rest is dropped
+
+  uint32_t offset = tail & (UART_RECEIVE_RING_SIZE - 1);
+  uint32_t first  = UART_RECEIVE_RING_SIZE - offset;
+  if(first > length) { first = length; }
+  memcpy(this->receive_ring + offset, data, first);
+  memcpy(this->receive_ring, data + first, length - first);
+
+  this->receive_ring_tail.store(tail + length, std::memory_order_release); // publish the whole batch at once
+  return length;
+}
+
+uint32_t Duart68681Uart::receiveSpace() {
+  if(this->receiver_enabled == false) { return 0; }
+  uint32_t tail = this->receive_ring_tail.load(std::memory_order_relaxed);
+  return UART_RECEIVE_RING_SIZE - (tail - this->receive_ring_head.load(std::memory_order_acquire));
+}
+
+uint32_t Duart68681Uart::receiveTake(uint8_t* data, uint32_t length) {
+  if(this->receive_character_cycles) { return 0; } // baud-accurate; bytes only arrive with time
+
+  // what's already in the FIFO goes first
+  uint32_t taken = 0;
+  while((taken < length) && this->receive_fifo_length) {
+    data[taken++] = this->receive_fifo[0];
+    this->receive_fifo[0] = this->receive_fifo[1];
+    this->receive_fifo[1] = this->receive_fifo[2];
+    --(this->receive_fifo_length);
+  }
+
+  // then the backlog, a run at a time (it would have flowed through the FIFO as fast as it was read)
+  while(taken < length) {
+    if(!this->receiveAllowed()) { break; }
+    uint32_t available = this->receiveLength();
+    if(!available) { break; }
+    uint32_t head   = this->receive_ring_head.load(std::memory_order_relaxed);
+    uint32_t offset = head & (UART_RECEIVE_RING_SIZE - 1);
+    uint32_t run    = UART_RECEIVE_RING_SIZE - offset;
+    if(run > available)        { run = available;      }
+    if(run > (length - taken)) { run = length - taken; }
+    memcpy(data + taken, this->receive_ring + offset, run);
+    this->receive_ring_head.store(head + run, std::memory_order_release);
+    taken += run;
+  }
+
+  this->receiveAdvance();
+  return taken;
+}
+
+uint32_t Duart68681Uart::receiveLength() {
+  // consumer side
+  uint32_t head   = this->receive_ring_head.load(std::memory_order_relaxed);
+  if(this->receive_gated) { return this->receive_ring_admitted - head; }
+  uint32_t length = this->receive_ring_tail.load(std::memory_order_acquire) - head;
+  if(!length && this->host_queue_length.load(std::memory_order_relaxed)) { length = this->hostQueuePump(); }
+  return length;
+}
+
+void Duart68681Uart::setReceiveGate(bool gated) {
+  // consumer side; whatever the guest hasn't taken yet waits to be admitted again
+  this->receive_gated         = gated;
+  this->receive_ring_admitted = this->receive_ring_head.load(std::memory_order_relaxed);
+}
+
+uint32_t Duart68681Uart::receiveAdmit(uint8_t* data, uint32_t length) {
+  // consumer side: let through bytes waiting behind the gate, copying them out (the host queue is pumped once the ring runs dry)
+  uint32_t tail = this->receive_ring_tail.load(std::memory_order_acquire);
+  if((tail == this->receive_ring_admitted) && this->host_queue_length.load(std::memory_order_relaxed)) {
+    this->hostQueuePump();
+    tail = this->receive_ring_tail.load(std::memory_order_acquire);
+  }
+  uint32_t admitted = tail - this->receive_ring_admitted;
+  if(admitted > length) { admitted = length; }
+  for(uint32_t index=0; index<admitted; ++index) {
+    data[index] = this->receive_ring[(this->receive_ring_admitted + index) & (UART_RECEIVE_RING_SIZE - 1)];
+  }
+  this->receive_ring_admitted += admitted;
+  return admitted;
+}
+
+uint32_t Duart68681Uart::receiveInject(const uint8_t* data, uint32_t length) {
+  // consumer side: bytes admitted straight away (nothing else receives while injecting; queued bytes wait behind the gate)
+  uint32_t written = this->receiveRingWrite(data, length);
+  this->receive_ring_admitted = this->receive_ring_tail.load(std::memory_order_relaxed);
+  return written;
+}
+
+void Duart68681Uart::queue(const uint8_t* data, uint32_t length) {
+  std::lock_guard<std::mutex> guard(this->host_queue_lock);
+  // reclaim the delivered front once it's the larger part
+  if(this->host_queue_offset > (this->host_queue.size() / 2)) {
+    this->host_queue.erase(this->host_queue.begin(), this->host_queue.begin() + this->host_queue_offset);
+    this->host_queue_offset = 0;
+  }
+  this->host_queue.insert(this->host_queue.end(), data, data + length);
+  this->host_queue_length.store((uint32_t)(this->host_queue.size() - this->host_queue_offset), std::memory_order_release);
+}
+
+uint32_t Duart68681Uart::queueLength() {
+  return this->host_queue_length.load(std::memory_order_acquire);
+}
+
+uint32_t Duart68681Uart::hostQueuePump() {
+  // runs on the consumer side, once the ring is empty (RTS is honoured further along, as bytes go onto the line)
+  std::lock_guard<std::mutex> guard(this->host_queue_lock);
+  uint32_t delivered = this->receiveBulk(this->host_queue.data() + this->host_queue_offset, (uint32_t)(this->host_queue.size() - this->host_queue_offset));
+  this->host_queue_offset += delivered;
+  if(this->host_queue_offset == this->host_queue.size()) {
+    this->host_queue.clear();
+    this->host_queue_offset = 0;
+  }
+  this->host_queue_length.store((uint32_t)(this->host_queue.size() - this->host_queue_offset), std::memory_order_release);
+  return delivered;
+}
+
+void Duart68681Uart::setFlowControl(bool enabled) {
+  this->flow_control = enabled;
+}
 
-  pthread_mutex_lock(&(this->receive_buffer_mutex));
-  if(this->receiver_enabled == false) { // disabled
-    pthread_mutex_unlock(&(this->receive_buffer_mutex));
+void Duart68681Uart::setRequestToSend(bool asserted) {
+  this->request_to_send = asserted;
+}
+
+bool Duart68681Uart::requestToSend() {
+  // MR1 bit 7: receiver controls RTS itself, negating it only while the FIFO is full
+  if(this->register_mode[0] & 0x80) { return this->receive_fifo_length < UART_RECEIVE_FIFO_SIZE; }
+  return this->request_to_send;
+}
+
+void Duart68681Uart::setClearToSend(bool asserted) {
+  this->clear_to_send = asserted;
+  if(asserted && this->transmit_held && !this->transmit_shifting) {
+    this->transmit_held = false;
+    this->transmitStart(this->transmit_held_data);
+  }
+}
+
+void Duart68681Uart::setClockSource(const int64_t* clock) {
+  this->clock = clock;
+}
+
+uint8_t Duart68681Uart::clockSelect() {
+  return this->register_clock_select;
+}
+
+void Duart68681Uart::setCharacterTime(int64_t receive_cycles, int64_t transmit_cycles) {
+  if(!this->clock) { receive_cycles = transmit_cycles = 0; }
+
+  // a byte half way along the line restarts at the new rate
+  this->receive_line_busy        = false;
+  this->receive_character_cycles = receive_cycles;
+
+  // entering instant mode, anything in flight goes out now
+  this->transmit_character_cycles = transmit_cycles;
+  if(!transmit_cycles && this->transmit_shifting) {
+    this->transmit_shifting = false;
+    this->transmitByte(this->transmit_shift_data);
+    if(this->transmit_held && !this->transmitBlocked()) {
+      this->transmit_held = false;
+      this->transmitByte(this->transmit_held_data);
+    }
+  }
+}
+
+int64_t Duart68681Uart::nextEvent() {
+  int64_t next = INT64_MAX;
+  if(this->transmit_shifting) { next = this->transmit_shift_end; }
+  if(this->receive_line_busy && (this->receive_next < next)) { next = this->receive_next; }
+  return next;
+}
+
+bool Duart68681Uart::receiveAllowed() {
+  // whether the host may start another byte down the line (a disabled receiver leaves them in the backlog)
+  if(this->receiver_enabled == false) { return false; }
+  return !this->flow_control || this->requestToSend();
+}
+
+void Duart68681Uart::receiveCharacter(uint8_t data) {
+  // a byte finished arriving
+  if(this->receive_fifo_length < UART_RECEIVE_FIFO_SIZE) {
+    this->receive_fifo[this->receive_fifo_length] = data;
+    ++(this->receive_fifo_length);
     return;
   }
-  uint8_t free_index = this->receive_buffer_index + this->receive_buffer_length;
-  this->receive_buffer[free_index] = data;
-  ++(this->receive_buffer_length);
-  pthread_mutex_unlock(&(this->receive_buffer_mutex));
+  if(this->receive_shift_full) { this->receive_status |= 0x10; } // overrun; the byte waiting in the shift register is lost
+  this->receive_shift_full = true;
+  this->receive_shift_data = data;
+}
+
+void Duart68681Uart::receiveAdvance() {
+  if(!this->receive_character_cycles) {
+    // instant: the FIFO is topped up from the backlog whenever it has room
+    while((this->receive_fifo_length < UART_RECEIVE_FIFO_SIZE) && this->receiveAllowed() && this->receiveLength()) {
+      uint32_t head = this->receive_ring_head.load(std::memory_order_relaxed);
+      this->receive_fifo[this->receive_fifo_length] = this->receive_ring[head & (UART_RECEIVE_RING_SIZE - 1)];
+      ++(this->receive_fifo_length);
+      this->receive_ring_head.store(head + 1, std::memory_order_release);
+    }
+    return;
+  }
+
+  // baud-accurate: bytes come off the line back to back, one character time apart, whether or not there's room for them
+  int64_t now = *(this->clock);
+  while(true) {
+    if(!this->receive_line_busy) {
+      if(!this->receiveAllowed() || !this->receiveLength()) { return; }
+      this->receive_line_busy = true;
+      this->receive_next      = now + this->receive_character_cycles;
+    }
+    if(now < this->receive_next) { return; }
+
+    uint32_t head = this->receive_ring_head.load(std::memory_order_relaxed);
+    uint8_t  data = this->receive_ring[head & (UART_RECEIVE_RING_SIZE - 1)];
+    this->receive_ring_head.store(head + 1, std::memory_order_release);
+    this->receiveCharacter(data);
+
+    // the next byte (if allowed to start) follows straight on from this one
+    if(!this->receiveAllowed() || !this->receiveLength()) {
+      this->receive_line_busy = false;
+      return;
+    }
+    this->receive_next += this->receive_character_cycles;
+  }
+}
+
+bool Duart68681Uart::transmitBlocked() {
+  // MR2 bit 4: CTS enabled Tx
+  return (this->register_mode[1] & 0x10) && !this->clear_to_send;
+}
+
+void Duart68681Uart::transmitStart(uint8_t data) {
+  if(!this->transmit_character_cycles) {
+    this->transmitByte(data);
+    return;
+  }
+  this->transmit_shifting   = true;
+  this->transmit_shift_data = data;
+  this->transmit_shift_end  = *(this->clock) + this->transmit_character_cycles;
+}
+
+void Duart68681Uart::transmitAdvance() {
+  // each finished character goes out, and THR (if waiting) follows straight on from it
+  while(this->transmit_shifting && (*(this->clock) >= this->transmit_shift_end)) {
+    this->transmit_shifting = false;
+    this->transmitByte(this->transmit_shift_data);
+    if(this->transmit_held && !this->transmitBlocked()) {
+      this->transmit_held       = false;
+      this->transmit_shifting   = true;
+      this->transmit_shift_data = this->transmit_held_data;
+      this->transmit_shift_end += this->transmit_character_cycles;
+    }
+  }
 }
 
 uint8_t Duart68681Uart::pollForInterrupt() {
-  uint8_t bits = this->transmitter_enabled ? UART_INTERRUPT_TX_READY : 0;
-  // TODO: should really differentiate between RxRDY & RxFULL here...
-  if(this->receive_buffer_length) { bits |= UART_INTERRUPT_RX_READY; }
+  this->transmitAdvance();
+  this->receiveAdvance();
+  uint8_t bits = (this->transmitter_enabled && !this->transmit_held) ? UART_INTERRUPT_TX_READY : 0;
+  // MR1 bit 6 selects the receiver interrupt: RxRDY (any byte waiting), or FFULL (FIFO full)
+  uint8_t receive_threshold = (this->register_mode[0] & 0x40) ? UART_RECEIVE_FIFO_SIZE : 1;
+  if(this->receive_fifo_length >= receive_threshold) { bits |= UART_INTERRUPT_RX_READY; }
   return bits;
 }
 
@@ -52,32 +402,41 @@ uint8_t Duart68681Uart::busRead(uint8_t address) {
       return mode;
     }
     case 0x01: { // status register
-      uint8_t status = 0;
-      if(this->transmitter_enabled)       { status |= 0xC; }
-      if(this->receive_buffer_length > 2) { status |= 0x2; }
-      if(this->receive_buffer_length > 0) { status |= 0x1; }
+      this->transmitAdvance();
+      this->receiveAdvance();
+      uint8_t status = this->receive_status;
+      if(this->transmitter_enabled && !this->transmit_held) { status |= 0x4; }
+      if(this->transmitter_enabled && !this->transmit_held && !this->transmit_shifting) { status |= 0x8; }
+      if(this->receive_fifo_length == UART_RECEIVE_FIFO_SIZE) { status |= 0x2; }
+      if(this->receive_fifo_length > 0)                       { status |= 0x1; }
       return status;
     }
     /* status register
-      bit 7 - received break -- don't care
-      bit 6 - framing error -- don't care
-      bit 5 - partity error -- don't care
-      bit 4 - overrun error -- don't care
-      bit 3 - transmitter empty -- always true if transmitter enabled (because we send immediately)
-      bit 2 - transmitter ready -- functionally same as bit 3, for us
-      bit 1 - receiver FIFO full -- true if receive_buffer_length > 2
-      bit 0 - receiver ready -- true if receive_buffer_length > 0
+      bit 7 - received break -- never (host input has no line errors)
+      bit 6 - framing error -- never
+      bit 5 - partity error -- never
+      bit 4 - overrun error -- a byte arrived while both FIFO and shift register were full (baud-accurate timing only); cleared by reset error status
+      bit 3 - transmitter empty -- true if transmitter enabled, and neither THR nor the shift register hold a byte
+      bit 2 - transmitter ready -- true if transmitter enabled, and THR is free (in instant mode, only CTS can hold it up)
+      bit 1 - receiver FIFO full -- true if all 3 FIFO bytes are waiting
+      bit 0 - receiver ready -- true if any bytes are waiting in the FIFO
     */
 
     case 0x03: { // receive holding
-      if(!this->receive_buffer_length) {
+      this->receiveAdvance();
+      if(!this->receive_fifo_length) {
         return 0;
       }
-      pthread_mutex_lock(&(this->receive_buffer_mutex));
-      uint8_t received_data = this->receive_buffer[this->receive_buffer_index];
-      ++(this->receive_buffer_index);
-      --(this->receive_buffer_length);
-      pthread_mutex_unlock(&(this->receive_buffer_mutex));
+      uint8_t received_data = this->receive_fifo[0];
+      this->receive_fifo[0] = this->receive_fifo[1];
+      this->receive_fifo[1] = this->receive_fifo[2];
+      --(this->receive_fifo_length);
+      if(this->receive_shift_full) {
+        // byte waiting in the shift register moves up
+        this->receive_fifo[this->receive_fifo_length] = this->receive_shift_data;
+        ++(this->receive_fifo_length);
+        this->receive_shift_full = false;
+      }
       return received_data;
     }
   }
@@ -96,8 +455,8 @@ void Duart68681Uart::busWrite(uint8_t address, uint8_t data) {
     }
     /*
       mode register 1 (MR1A/MR1B)
-      bit 7 - Receiver RTS Control -- don't care
-      bit 6 - Receiver Interrupt Type (0:Rx data > 0, 1:Rx data full (>=3))
+      bit 7 - Receiver RTS Control -- RTS is asserted whenever the FIFO has room
+      bit 6 - Receiver Interrupt Type (0:Rx data > 0, 1:Rx data full (>=3)) -- selects RxRDY or FFULL interrupt
       bit 5 - Error mode select (0: character, 1: block) -- don't care
       bit 4,3 - Parity mode select -- don't care
       bit 2 - parity type -- don't care
@@ -106,7 +465,7 @@ void Duart68681Uart::busWrite(uint8_t address, uint8_t data) {
       mode register 2 (MR2A/MR2B)
       bit 7,6 - channel mode (0:normal, 1:echo, 2:local loop, 3: remote loop) -- maybe care?
       bit 5 - Tx RTS Control -- don't care
-      bit 4 - CTS enabled Tx -- don't care
+      bit 4 - CTS enabled Tx -- transmitter holds its byte while CTS is negated
       bit 3,2,1,0 - stop bit length -- don't care
     */
 
@@ -125,14 +484,15 @@ void Duart68681Uart::busWrite(uint8_t address, uint8_t data) {
       switch(nibble_upper) {
         case 0x10: { this->register_mode_index = 0; } break;
         case 0x20: {
-          pthread_mutex_lock(&(this->receive_buffer_mutex));
-          this->receiver_enabled      = false;
-          this->receive_buffer_index  = 0;
-          this->receive_buffer_length = 0;
-          pthread_mutex_unlock(&(this->receive_buffer_mutex));
+          // the host backlog isn't part of the receiver, and is kept
+          this->receiver_enabled    = false;
+          this->receive_line_busy   = false;
+          this->receive_fifo_length = 0;
+          this->receive_shift_full  = false;
+          this->receive_status      = 0;
           break;
         }
-        case 0x40: { /* ignoring command: clear error flags in status register */ } break;
+        case 0x40: { this->receive_status = 0; } break;
         case 0x50: { /* this->interrupt_bits &= ~UART_INTERRUPT_BREAK; */ /*  NOTE: ignoring break interrupts */ } break;
       }
 
@@ -160,11 +520,27 @@ void Duart68681Uart::busWrite(uint8_t address, uint8_t data) {
 
     case 0x03: { // transmit holding
       if(this->transmitter_enabled) {
-        if(this->transmitter_callback) {
-          this->transmitter_callback(this->port_number, data, this->transmitter_callback_data);
+        this->transmitAdvance();
+        if(this->transmitBlocked() || this->transmit_shifting) {
+          // THR waits for CTS, or for the shift register (a further write replaces it)
+          this->transmit_held      = true;
+          this->transmit_held_data = data;
+          return;
         }
+        this->transmitStart(data);
       }
       return;
     }
   }
 }
+
+void Duart68681Uart::transmitByte(uint8_t data) {
+  if(this->transmitter_bulk_callback) {
+    // batched; handed over at the end of a run, on newline, or once the buffer fills
+    this->transmit_buffer[this->transmit_buffer_length] = data;
+    ++(this->transmit_buffer_length);
+    if((data == '\n') || (this->transmit_buffer_length == UART_TRANSMIT_BUFFER_SIZE)) { this->transmitFlush(); }
+  } else if(this->transmitter_callback) {
+    this->transmitter_callback(this->port_number, data, this->transmitter_callback_data);
+  }
+}
@@ -3,39 +3,118 @@
 extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
-#include <pthread.h>
 }
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 typedef void (*serialTransmit)(uint8_t port, uint8_t transmit_data, void* callback_data);
+typedef void (*serialTransmitBulk)(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data);
 
 #define UART_INTERRUPT_TX_READY 1
 #define UART_INTERRUPT_RX_READY 2
 #define UART_INTERRUPT_BREAK    4
 
+#define UART_RECEIVE_FIFO_SIZE 3
+#define UART_RECEIVE_RING_SIZE 4096 // must be a power of two
+#define UART_TRANSMIT_BUFFER_SIZE 256
+
 class Duart68681Uart {
 public:
   Duart68681Uart(uint8_t port_number);
 
   void setTransmitter(serialTransmit transmitter, void* callback_data);
+  void setTransmitterBulk(serialTransmitBulk transmitter, void* callback_data);
+  void transmitFlush();
   void receive(uint8_t data);
+  uint32_t receiveBulk(const uint8_t* data, uint32_t length);
+  uint32_t receiveSpace();
+  uint32_t receiveTake(uint8_t* data, uint32_t length);
+  void     setReceiveGate(bool gated);
+  uint32_t receiveAdmit(uint8_t* data, uint32_t length);
+  uint32_t receiveInject(const uint8_t* data, uint32_t length);
+  void     queue(const uint8_t* data, uint32_t length);
+  uint32_t queueLength();
+  void     setFlowControl(bool enabled);
+  void     setRequestToSend(bool asserted);
+  void     setClearToSend(bool asserted);
+  bool     requestToSend();
+  void     setClockSource(const int64_t* clock);
+  void     setCharacterTime(int64_t receive_cycles, int64_t transmit_cycles);
+  uint8_t  clockSelect();
+  int64_t  nextEvent();
 
   void    reset();
+  void    copyState(Duart68681Uart* source);
   uint8_t pollForInterrupt();
   uint8_t busRead(uint8_t address);
   void    busWrite(uint8_t address, uint8_t data);
 
 protected:
   uint8_t port_number;
-  bool receiver_enabled;
+  std::atomic<bool> receiver_enabled; // also read by receiveSpace(), from any thread
   bool transmitter_enabled;
 
   serialTransmit transmitter_callback;
+  serialTransmitBulk transmitter_bulk_callback;
   void* transmitter_callback_data;
 
-  uint8_t receive_buffer[255];
-  uint8_t receive_buffer_index;
-  uint8_t receive_buffer_length;
-  pthread_mutex_t receive_buffer_mutex;
+  // bytes sent, but not yet handed to transmitter_bulk_callback
+  uint8_t  transmit_buffer[UART_TRANSMIT_BUFFER_SIZE];
+  uint32_t transmit_buffer_length;
+
+  // receiver, as the guest sees it: 3 byte FIFO, plus the shift register (which holds a 4th byte while the FIFO is full)
+  uint8_t receive_fifo[UART_RECEIVE_FIFO_SIZE];
+  uint8_t receive_fifo_length;
+  bool    receive_shift_full;
+  uint8_t receive_shift_data;
+  uint8_t receive_status;      // error bits of the status register (overrun)
+  void    receiveAdvance();
+  void    receiveCharacter(uint8_t data);
+  bool    receiveAllowed();
+
+  // host backlog, behind the receiver: bytes not yet on the line
+  // ring written by receive()/receiveBulk()/receiveInject() and hostQueuePump(), and read by the emulated bus, all on the
+  // emulation thread (other threads feed the port through queue()); indices run freely, and are masked on access,
+  // and each side only ever stores its own index, so receiveSpace() may be read from anywhere
+  uint8_t receive_ring[UART_RECEIVE_RING_SIZE];
+  alignas(64) std::atomic<uint32_t> receive_ring_head; // next byte to read; written by consumer
+  alignas(64) std::atomic<uint32_t> receive_ring_tail; // next byte to write; written by producer
+  uint32_t receiveLength();
+  uint32_t receiveRingWrite(const uint8_t* data, uint32_t length);
+
+  // gated: the consumer only sees bytes up to receive_ring_admitted, moved on by receiveAdmit()/receiveInject()
+  // (consumer side only), so when bytes arrive is decided by the emulation thread, not the producer
+  bool     receive_gated;
+  uint32_t receive_ring_admitted;
+
+  // host side input, held until the guest can take it (unbounded; any thread may queue, and the pump moves it into the ring)
+  std::mutex            host_queue_lock;
+  std::vector<uint8_t>  host_queue;
+  size_t                host_queue_offset; // bytes at the front already delivered
+  std::atomic<uint32_t> host_queue_length; // bytes still waiting
+  uint32_t hostQueuePump();
+
+  // RTS/CTS (both stored as asserted == true, regardless of pin polarity)
+  bool flow_control;    // host holds queued input while RTS is negated
+  bool request_to_send; // driven by guest, from OPR
+  bool clear_to_send;   // driven by host, to IPR
+  bool transmit_held;   // a byte is waiting in THR (for CTS, or for the shift register)
+  uint8_t transmit_held_data;
+  void transmitByte(uint8_t data);
+  void transmitStart(uint8_t data);
+  bool transmitBlocked();
+
+  // baud-accurate timing, in emulated clock cycles per character; 0 == instant (the default)
+  const int64_t* clock;
+  int64_t  receive_character_cycles;
+  int64_t  transmit_character_cycles;
+  bool     receive_line_busy;   // the byte at the front of the ring is arriving
+  int64_t  receive_next;        // when it has
+  bool     transmit_shifting;   // shift register busy
+  uint8_t  transmit_shift_data;
+  int64_t  transmit_shift_end;  // when it's done, and the byte goes out
+  void     transmitAdvance();
 
   uint8_t register_mode_index;
   uint8_t register_mode[2];
@@ -0,0 +1,179 @@
+#include "guest_memory.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+}
+
+static std::atomic<guest_memory_pages> guest_memory_page_request(GUEST_MEMORY_PAGES_NORMAL);
+
+// file to hold a snapshot: anonymous, sparse, and gone once the last mapping is
+static int snapshotFileCreate(size_t size) {
+#if defined(__linux__)
+  int file = memfd_create("mremu-guest-memory", MFD_CLOEXEC);
+#else
+  char name[64];
+  static std::atomic<uint32_t> sequence(0);
+  snprintf(name, sizeof(name), "/mremu-%d-%u", (int)getpid(), (unsigned)sequence++);
+  int file = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(file >= 0) { shm_unlink(name); }
+#endif
+  if(file < 0) { return -1; }
+  if(ftruncate(file, (off_t)size) != 0) {
+    close(file);
+    return -1;
+  }
+  return file;
+}
+
+static bool pageIsZero(const uint8_t* page, size_t page_size) {
+  const uint64_t* words = (const uint64_t*)page;
+  uint64_t bits = 0;
+  for(size_t index=0; index<(page_size / sizeof(uint64_t)); ++index) {
+    bits |= words[index];
+  }
+  return bits == 0;
+}
+
+void GuestMemory::setPages(guest_memory_pages pages) {
+  guest_memory_page_request = pages;
+}
+
+guest_memory_pages GuestMemory::requestedPages() {
+  return guest_memory_page_request;
+}
+
+uint8_t* GuestMemory::mapAnonymous(size_t size, size_t* mapped_length, guest_memory_pages* pages) {
+  guest_memory_pages request = guest_memory_page_request;
+  size_t huge_length = (size + GUEST_MEMORY_HUGE_PAGE_SIZE - 1) & ~((size_t)GUEST_MEMORY_HUGE_PAGE_SIZE - 1);
+
+#if defined(MAP_HUGETLB)
+  if(request == GUEST_MEMORY_PAGES_EXPLICIT) {
+    void* mapped = mmap(NULL, huge_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+    if(mapped != MAP_FAILED) {
+      *mapped_length = huge_length;
+      *pages         = GUEST_MEMORY_PAGES_EXPLICIT;
+      return (uint8_t*)mapped;
+    }
+    request = GUEST_MEMORY_PAGES_TRANSPARENT; // none reserved (or none free)
+  }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+  if(request == GUEST_MEMORY_PAGES_TRANSPARENT) {
+    // over-allocate, then trim to a huge page aligned range; unaligned ranges can't be backed by huge pages
+    size_t reserve_length = huge_length + GUEST_MEMORY_HUGE_PAGE_SIZE;
+    void* reserved = mmap(NULL, reserve_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(reserved == MAP_FAILED) { return NULL; }
+
+    uintptr_t start   = (uintptr_t)reserved;
+    uintptr_t aligned = (start + GUEST_MEMORY_HUGE_PAGE_SIZE - 1) & ~((uintptr_t)GUEST_MEMORY_HUGE_PAGE_SIZE - 1);
+    if(aligned > start) { munmap(reserved, aligned - start); }
+    size_t tail = (start + reserve_length) - (aligned + huge_length);
+    if(tail > 0) { munmap((void*)(aligned + huge_length), tail); }
+
+    *mapped_length = huge_length;
+    *pages         = (madvise((void*)aligned, huge_length, MADV_HUGEPAGE) == 0) ? GUEST_MEMORY_PAGES_TRANSPARENT : GUEST_MEMORY_PAGES_NORMAL;
+    return (uint8_t*)aligned;
+  }
+#endif
+
+  void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if(mapped == MAP_FAILED) { return NULL; }
+  *mapped_length = size;
+  *pages         = GUEST_MEMORY_PAGES_NORMAL;
+  return (uint8_t*)mapped;
+}
+
+GuestMemory::GuestMemory(size_t size) {
+  this->bytes = mapAnonymous(size, &(this->mapped_length), &(this->page_type));
+  if(!this->bytes) { throw "error allocating guest memory"; }
+
+  this->length   = size;
+  this->snapshot = NULL;
+}
+
+GuestMemory::GuestMemory(guest_memory_snapshot* snapshot, size_t size) {
+  void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, snapshot->file, 0);
+  if(mapped == MAP_FAILED) { throw "error mapping guest memory snapshot"; }
+
+  ++(snapshot->references);
+  this->bytes         = (uint8_t*)mapped;
+  this->length        = size;
+  this->mapped_length = size;
+  this->page_type     = GUEST_MEMORY_PAGES_NORMAL;
+  this->snapshot      = snapshot;
+}
+
+GuestMemory::~GuestMemory() {
+  munmap(this->bytes, this->mapped_length);
+  snapshotRelease(this->snapshot);
+}
+
+guest_memory_pages GuestMemory::pages() {
+  return this->page_type;
+}
+
+uint8_t* GuestMemory::data() {
+  return this->bytes;
+}
+
+size_t GuestMemory::size() {
+  return this->length;
+}
+
+GuestMemory* GuestMemory::clone(bool modified) {
+  if(!this->snapshot || modified) {
+    guest_memory_snapshot* frozen = this->snapshotCreate();
+
+    // switch this memory over to the snapshot too: contents are identical, and the pages it had committed are given back
+    // huge page mappings are replaced whole (hugetlb ones can't be split), then the part past the snapshot is trimmed off
+    void* mapped = mmap(this->bytes, this->mapped_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, frozen->file, 0);
+    if((mapped != MAP_FAILED) && (this->mapped_length > this->length)) {
+      munmap(this->bytes + this->length, this->mapped_length - this->length);
+    }
+    if(mapped == MAP_FAILED) {
+      snapshotRelease(frozen);
+      throw "error mapping guest memory snapshot";
+    }
+    snapshotRelease(this->snapshot);
+    this->snapshot      = frozen;
+    this->mapped_length = this->length;
+    this->page_type     = GUEST_MEMORY_PAGES_NORMAL;
+  }
+
+  return new GuestMemory(this->snapshot, this->length);
+}
+
+guest_memory_snapshot* GuestMemory::snapshotCreate() {
+  int file = snapshotFileCreate(this->length);
+  if(file < 0) { throw "error creating guest memory snapshot"; }
+
+  uint8_t* frozen = (uint8_t*)mmap(NULL, this->length, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  if(frozen == MAP_FAILED) {
+    close(file);
+    throw "error mapping guest memory snapshot";
+  }
+
+  // zero pages are left as holes, keeping the snapshot as sparse as the memory it came from
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  for(size_t offset=0; offset<this->length; offset+=page_size) {
+    if(pageIsZero(this->bytes + offset, page_size)) { continue; }
+    memcpy(frozen + offset, this->bytes + offset, page_size);
+  }
+  munmap(frozen, this->length);
+
+  guest_memory_snapshot* snapshot = new guest_memory_snapshot;
+  snapshot->file       = file;
+  snapshot->references = 1;
+  return snapshot;
+}
+
+void GuestMemory::snapshotRelease(guest_memory_snapshot* snapshot) {
+  if(!snapshot) { return; }
+  if(--(snapshot->references) > 0) { return; }
+  close(snapshot->file);
+  delete snapshot;
+}
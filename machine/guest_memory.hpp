@@ -0,0 +1,110 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include <atomic>
+
+#define GUEST_MEMORY_HUGE_PAGE_SIZE 0x200000 // 2 MiB
+
+/**
+ * host page size used for guest memory (and ROM images)
+ **/
+typedef enum {
+  GUEST_MEMORY_PAGES_NORMAL,      // host base pages
+  GUEST_MEMORY_PAGES_TRANSPARENT, // transparent huge pages, advised with madvise() (kernel may still decline)
+  GUEST_MEMORY_PAGES_EXPLICIT,    // hugetlbfs pages (needs vm.nr_hugepages); falls back to transparent when none are free
+} guest_memory_pages;
+
+/**
+ * frozen guest memory contents, mapped copy-on-write by any number of GuestMemory
+ **/
+typedef struct {
+  int                   file;       // memfd (or unlinked shared memory object) holding the contents
+  std::atomic<uint32_t> references; // count of GuestMemory mapping it
+} guest_memory_snapshot;
+
+/**
+ * Guest RAM
+ * zero-filled and committed on first touch; can be cloned copy-on-write
+ **/
+class GuestMemory {
+public:
+  /**
+   * Allocate new guest memory; reads as zero, and host pages are only committed once written
+   * 
+   * @param size size in bytes (multiple of the host page size)
+   **/
+  GuestMemory(size_t size);
+  ~GuestMemory();
+
+  /**
+   * Get memory contents
+   * 
+   * @returns pointer to size() bytes of guest memory
+   **/
+  uint8_t* data();
+
+  /**
+   * Get memory size
+   * 
+   * @returns size in bytes
+   **/
+  size_t size();
+
+  /**
+   * Create a copy-on-write copy of this memory
+   * the current contents are frozen into a snapshot shared by this memory and the copy (and by every
+   * later copy, until this memory is modified); each side only commits pages it writes afterwards
+   * 
+   * @param modified whether contents may have been written since the last clone() (false lets the previous snapshot be reused)
+   * @returns new guest memory, with the same contents as this one
+   **/
+  GuestMemory* clone(bool modified);
+
+  /**
+   * Get the host pages this memory ended up with
+   * 
+   * @returns page type actually in use (after any fallback)
+   **/
+  guest_memory_pages pages();
+
+  /**
+   * Set the host page type for memory allocated from now on (process wide; default GUEST_MEMORY_PAGES_NORMAL)
+   * huge pages cut host TLB misses from the emulator's scattered guest accesses, at the cost of committing 2 MiB at a time;
+   * clones still share their snapshot copy-on-write in base pages
+   * 
+   * @param pages requested page type
+   **/
+  static void setPages(guest_memory_pages pages);
+
+  /**
+   * Get the host page type requested with setPages()
+   * 
+   * @returns requested page type
+   **/
+  static guest_memory_pages requestedPages();
+
+  /**
+   * Map zero-filled anonymous memory using the current page type
+   * 
+   * @param size size in bytes
+   * @param mapped_length receives the length actually mapped (size, rounded up to a huge page if one is used), for munmap()
+   * @param pages receives the page type obtained
+   * @returns mapping, or NULL on failure
+   **/
+  static uint8_t* mapAnonymous(size_t size, size_t* mapped_length, guest_memory_pages* pages);
+
+protected:
+  GuestMemory(guest_memory_snapshot* snapshot, size_t size);
+  guest_memory_snapshot* snapshotCreate();
+  static void snapshotRelease(guest_memory_snapshot* snapshot);
+
+  uint8_t* bytes;
+  size_t   length;
+  size_t   mapped_length;
+  guest_memory_pages     page_type;
+  guest_memory_snapshot* snapshot; // snapshot this memory maps copy-on-write, or NULL while purely anonymous
+};
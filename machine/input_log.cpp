@@ -0,0 +1,102 @@
+#include "input_log.hpp"
+extern "C" {
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+}
+
+#define INPUT_LOG_LINE_MAX 0x10000
+
+static const char* const input_log_names[] = { "serial", "input", "time", "reset", "end" };
+
+InputLog* InputLog::create(const char* log_path) {
+  InputLog* log = new InputLog();
+  log->log_file = fopen(log_path, "w");
+  if(!log->log_file) {
+    delete log;
+    throw "error creating input log";
+  }
+  fprintf(log->log_file, "# mremu input log %u: <instruction> <clock> <event> ...\n", INPUT_LOG_VERSION);
+  fflush(log->log_file);
+  return log;
+}
+
+InputLog* InputLog::load(const char* log_path) {
+  FILE* log_file = fopen(log_path, "r");
+  if(!log_file) { throw "error opening input log"; }
+
+  InputLog* log = new InputLog();
+  char* line = (char*)malloc(INPUT_LOG_LINE_MAX);
+  try {
+    while(fgets(line, INPUT_LOG_LINE_MAX, log_file)) {
+      if((line[0] == '#') || (line[0] == '\n')) { continue; }
+
+      input_log_event event;
+      char name[16];
+      int  consumed = 0;
+      if(sscanf(line, "%" SCNu64 " %" SCNd64 " %15s %n", &(event.instruction), &(event.clock), name, &consumed) != 3) { throw "malformed input log"; }
+      uint32_t kind = 0;
+      while((kind <= INPUT_LOG_END) && strcmp(name, input_log_names[kind])) { ++kind; }
+      if(kind > INPUT_LOG_END) { throw "unknown event in input log"; }
+      event.kind  = (input_log_kind)kind;
+      event.port  = 0;
+      event.value = 0;
+
+      const char* argument = line + consumed;
+      switch(event.kind) {
+        case INPUT_LOG_SERIAL: {
+          unsigned int port;
+          int hex_offset = 0;
+          if(sscanf(argument, "%u %n", &port, &hex_offset) != 1) { throw "malformed serial event in input log"; }
+          event.port = (uint8_t)port;
+          for(const char* hex=argument + hex_offset; (hex[0] != '\n') && (hex[0] != 0x00); hex += 2) {
+            unsigned int byte;
+            if(sscanf(hex, "%2x", &byte) != 1) { throw "malformed serial event in input log"; }
+            event.data.push_back((uint8_t)byte);
+          }
+          break;
+        }
+        case INPUT_LOG_INPUT_PORT: if(sscanf(argument, "%" SCNx64, (uint64_t*)&(event.value)) != 1) { throw "malformed input event in input log"; } break;
+        case INPUT_LOG_TIME:       if(sscanf(argument, "%" SCNd64, &(event.value)) != 1)            { throw "malformed time event in input log";  } break;
+        default: break;
+      }
+      log->logged.push_back(event);
+    }
+  } catch(...) {
+    free(line);
+    fclose(log_file);
+    delete log;
+    throw;
+  }
+  free(line);
+  fclose(log_file);
+  return log;
+}
+
+InputLog::InputLog() {
+  this->log_file = NULL;
+}
+
+InputLog::~InputLog() {
+  if(this->log_file) { fclose(this->log_file); }
+}
+
+void InputLog::add(const input_log_event* event) {
+  if(!this->log_file) { return; }
+  fprintf(this->log_file, "%" PRIu64 " %" PRId64 " %s", event->instruction, event->clock, input_log_names[event->kind]);
+  switch(event->kind) {
+    case INPUT_LOG_SERIAL:
+      fprintf(this->log_file, " %u ", event->port);
+      for(uint8_t byte : event->data) { fprintf(this->log_file, "%02x", byte); }
+      break;
+    case INPUT_LOG_INPUT_PORT: fprintf(this->log_file, " %02" PRIx64, (uint64_t)event->value); break;
+    case INPUT_LOG_TIME:       fprintf(this->log_file, " %" PRId64, event->value);              break;
+    default: break;
+  }
+  fprintf(this->log_file, "\n");
+  fflush(this->log_file); // a session that crashes still leaves everything up to the crash
+}
+
+const std::vector<input_log_event>& InputLog::events() {
+  return this->logged;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+}
+#include <vector>
+
+#define INPUT_LOG_VERSION 1
+
+/**
+ * kinds of external event
+ **/
+typedef enum {
+  INPUT_LOG_SERIAL,     // bytes admitted to a serial port (port, data)
+  INPUT_LOG_INPUT_PORT, // DUART input port set (value)
+  INPUT_LOG_TIME,       // host time first seen by the counter/timer (value, in seconds)
+  INPUT_LOG_RESET,      // machine reset
+  INPUT_LOG_END,        // recording stopped
+} input_log_kind;
+
+/**
+ * one external event, at the point in the instruction stream where the machine took it in
+ **/
+typedef struct {
+  uint64_t             instruction; // instructions executed since recording started (across resets)
+  int64_t              clock;       // processor clock
+  input_log_kind       kind;
+  uint8_t              port;        // INPUT_LOG_SERIAL
+  int64_t              value;       // INPUT_LOG_INPUT_PORT, INPUT_LOG_TIME
+  std::vector<uint8_t> data;        // INPUT_LOG_SERIAL
+} input_log_event;
+
+/**
+ * Log of everything from outside a machine that reaches the guest, for deterministic replay (see RoscoM68K::recordInputs())
+ * kept as text, one event per line: "<instruction> <clock> serial <port> <hex bytes>", "... input <hex value>",
+ * "... time <seconds>", "... reset", or "... end"; lines starting with '#' are comments
+ **/
+class InputLog {
+public:
+  /**
+   * Create a log to record to; each event is written out as it's added
+   *
+   * @param log_path path to the file to create (replaced, if it exists)
+   * @returns new log
+   **/
+  static InputLog* create(const char* log_path);
+  /**
+   * Read a recorded log, to replay
+   *
+   * @param log_path path to the log
+   * @returns new log, holding every event
+   **/
+  static InputLog* load(const char* log_path);
+  ~InputLog();
+
+  /**
+   * Add an event (recording)
+   *
+   * @param event event to add
+   **/
+  void add(const input_log_event* event);
+
+  /**
+   * Get the events read by load()
+   *
+   * @returns events, in the order they were recorded
+   **/
+  const std::vector<input_log_event>& events();
+
+protected:
+  InputLog();
+
+  FILE* log_file; // recording, or NULL
+  std::vector<input_log_event> logged;
+};
@@ -0,0 +1,226 @@
+#include "machine_farm.hpp"
+#include <thread>
+extern "C" {
+#include <stdio.h>
+}
+
+// instructions run between exit/budget checks
+#define MACHINE_FARM_SLICE 10000
+
+static void farmSerialOutput(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data) {
+  std::string* serial_output = (std::string*)callback_data;
+  serial_output->append((const char*)transmit_data, length);
+}
+
+static bool farmReadFile(const std::string& path, std::string* contents) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if(!file) { return false; }
+
+  char buffer[4096];
+  size_t read = fread(buffer, 1, sizeof(buffer), file);
+  while(read > 0) {
+    contents->append(buffer, read);
+    read = fread(buffer, 1, sizeof(buffer), file);
+  }
+  fclose(file);
+  return true;
+}
+
+MachineFarm::MachineFarm(uint32_t thread_count) {
+  if(thread_count == 0) { thread_count = std::thread::hardware_concurrency(); }
+  if(thread_count == 0) { thread_count = 1; }
+  this->thread_count = thread_count;
+  this->worker_count = 0;
+  this->queues       = NULL;
+}
+
+MachineFarm::~MachineFarm() {
+  for(auto& rom_image : this->rom_images) {
+    RomImage::release(rom_image.second);
+  }
+}
+
+uint32_t MachineFarm::addJob(const machine_farm_job* job) {
+  this->jobs.push_back(*job);
+  this->results.push_back({ .status = MACHINE_FARM_PENDING, .exit_code = 0, .cycles = 0, .input_sent = 0 });
+  return (uint32_t)(this->jobs.size() - 1);
+}
+
+uint32_t MachineFarm::jobCount() {
+  return (uint32_t)this->jobs.size();
+}
+
+const machine_farm_result* MachineFarm::result(uint32_t index) {
+  if(index >= this->results.size()) { return NULL; }
+  return &(this->results[index]);
+}
+
+const char* MachineFarm::statusName(machine_farm_status status) {
+  switch(status) {
+    case MACHINE_FARM_PENDING: return "pending";
+    case MACHINE_FARM_EXITED:  return "exited";
+    case MACHINE_FARM_HALTED:  return "halted";
+    case MACHINE_FARM_BUDGET:  return "timeout";
+    case MACHINE_FARM_ERROR:   return "error";
+  }
+  return "unknown";
+}
+
+void MachineFarm::loadRomImages() {
+  // every ROM is mapped once, before any worker starts; workers only ever read them
+  for(auto& job : this->jobs) {
+    if(this->rom_images.count(job.rom_path) || this->rom_errors.count(job.rom_path)) { continue; }
+    try {
+      this->rom_images[job.rom_path] = RomImage::acquire(job.rom_path.c_str());
+    } catch(const char* error) {
+      this->rom_errors[job.rom_path] = error;
+    }
+  }
+}
+
+void MachineFarm::run() {
+  this->loadRomImages();
+
+  uint32_t worker_count = this->thread_count;
+  if(worker_count > this->jobs.size()) { worker_count = (uint32_t)this->jobs.size(); }
+  if(worker_count == 0) { return; }
+  this->worker_count = worker_count;
+
+  // deal pending jobs out round-robin; stealing evens out whatever imbalance remains
+  this->queues = new work_queue[worker_count];
+  uint32_t dealt = 0;
+  for(uint32_t index=0; index<this->jobs.size(); ++index) {
+    if(this->results[index].status != MACHINE_FARM_PENDING) { continue; }
+    this->queues[dealt % worker_count].jobs.push_back(index);
+    ++dealt;
+  }
+
+  std::vector<std::thread> workers;
+  for(uint32_t index=1; index<worker_count; ++index) {
+    workers.emplace_back(&MachineFarm::worker, this, index);
+  }
+  this->worker(0);
+  for(auto& worker : workers) { worker.join(); }
+
+  delete[] this->queues;
+  this->queues = NULL;
+}
+
+void MachineFarm::worker(uint32_t worker_index) {
+  uint32_t job_index;
+  while(this->takeJob(worker_index, &job_index)) {
+    this->runJob(job_index);
+  }
+}
+
+bool MachineFarm::takeJob(uint32_t worker_index, uint32_t* job_index) {
+  // own queue first, newest job
+  work_queue* own = &(this->queues[worker_index]);
+  {
+    std::lock_guard<std::mutex> guard(own->lock);
+    if(!own->jobs.empty()) {
+      *job_index = own->jobs.back();
+      own->jobs.pop_back();
+      return true;
+    }
+  }
+
+  // then steal the oldest job from another worker; no jobs are added while running, so all empty means done
+  for(uint32_t offset=1; offset<this->worker_count; ++offset) {
+    work_queue* victim = &(this->queues[(worker_index + offset) % this->worker_count]);
+    std::lock_guard<std::mutex> guard(victim->lock);
+    if(!victim->jobs.empty()) {
+      *job_index = victim->jobs.front();
+      victim->jobs.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MachineFarm::runJob(uint32_t job_index) {
+  const machine_farm_job* job = &(this->jobs[job_index]);
+  machine_farm_result* result = &(this->results[job_index]);
+
+  auto rom_image = this->rom_images.find(job->rom_path);
+  if(rom_image == this->rom_images.end()) {
+    result->status = MACHINE_FARM_ERROR;
+    result->error  = this->rom_errors[job->rom_path];
+    return;
+  }
+
+  // everything the guest will receive on port A, in order
+  std::string input;
+  if(!job->program_path.empty()) {
+    std::string program;
+    if(!farmReadFile(job->program_path, &program)) {
+      result->status = MACHINE_FARM_ERROR;
+      result->error  = "error opening program file";
+      return;
+    }
+    uint32_t program_size = (uint32_t)program.size();
+    input.push_back((char)((program_size >> 24) & 0xFF));
+    input.push_back((char)((program_size >> 16) & 0xFF));
+    input.push_back((char)((program_size >>  8) & 0xFF));
+    input.push_back((char)((program_size      ) & 0xFF));
+    input.append(program);
+  }
+  if(!job->input_path.empty()) {
+    if(!farmReadFile(job->input_path, &input)) {
+      result->status = MACHINE_FARM_ERROR;
+      result->error  = "error opening input file";
+      return;
+    }
+  }
+
+  std::vector<memory_region> expansion;
+  if(!MemoryMap::parseRegions(job->memory_map.c_str(), &expansion)) {
+    result->status = MACHINE_FARM_ERROR;
+    result->error  = "invalid memory map";
+    return;
+  }
+
+  RoscoM68K* rosco;
+  try {
+    rosco = new RoscoM68K(rom_image->second, expansion.data(), (uint32_t)expansion.size());
+  } catch(const char* error) {
+    result->status = MACHINE_FARM_ERROR;
+    result->error  = error;
+    return;
+  }
+  rosco->reset();
+  rosco->setSerialTiming(job->baud_accurate);
+  rosco->setTurboUpload(job->turbo_upload);
+  rosco->duart->setSerialTransmitterBulk(DUART_68681_PORT_A, farmSerialOutput, &(result->serial_output));
+
+  // queued input is held until the guest reads it, so it can all be handed over up front
+  rosco->duart->serialPortQueue(DUART_68681_PORT_A, (const uint8_t*)input.data(), (uint32_t)input.size());
+
+  while(true) {
+    if(rosco->hasExited()) {
+      result->status = rosco->isHalted() ? MACHINE_FARM_HALTED : MACHINE_FARM_EXITED;
+      result->cycles = (uint64_t)rosco->getClock();
+      // with baud-accurate timing, characters still on the wire go out after the guest stops, as they would on hardware
+      // (a stopped processor still advances the clock)
+      while(!rosco->isHalted() && (rosco->duart->nextEvent() != INT64_MAX)) { rosco->run(MACHINE_FARM_SLICE); }
+      break;
+    }
+
+    uint64_t cycles = (uint64_t)rosco->getClock();
+    if(cycles >= job->cycle_budget) {
+      result->status = MACHINE_FARM_BUDGET;
+      result->cycles = cycles;
+      break;
+    }
+
+    // slices shrink as the budget runs out, to limit how far the last one runs past it
+    uint64_t slice = ((job->cycle_budget - cycles) / 4) + 1;
+    if(slice > MACHINE_FARM_SLICE) { slice = MACHINE_FARM_SLICE; }
+    rosco->run((uint32_t)slice);
+  }
+
+  result->exit_code  = rosco->getD(0);
+  result->input_sent = input.size() - rosco->duart->serialPortQueueLength(DUART_68681_PORT_A);
+  delete rosco;
+}
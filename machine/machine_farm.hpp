@@ -0,0 +1,116 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdbool.h>
+}
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include "rosco_m68k.hpp"
+#include "rom_image.hpp"
+
+/**
+ * description of a single headless rosco-m68k run
+ **/
+typedef struct {
+  std::string rom_path;     // ROM to boot; instances naming the same path share one loaded image
+  std::string program_path; // optional; sent to serial port A using the loader protocol (4 byte big-endian size, then data)
+  std::string input_path;   // optional; sent to serial port A (after the program), as fast as the guest accepts it
+  uint64_t    cycle_budget; // emulated clock cycles to run before giving up
+  std::string memory_map;   // optional; expansion regions, as accepted by MemoryMap::parseRegions(), ex: "ram:0x100000:3M"
+  bool        baud_accurate; // baud-accurate serial timing (instead of instant)
+  bool        turbo_upload;  // copy the program straight into memory while the loader reads it (see RoscoM68K::setTurboUpload())
+} machine_farm_job;
+
+typedef enum {
+  MACHINE_FARM_PENDING, // not run (yet)
+  MACHINE_FARM_EXITED,  // guest executed STOP with all interrupts masked; exit_code is D0
+  MACHINE_FARM_HALTED,  // processor halted (double fault)
+  MACHINE_FARM_BUDGET,  // cycle budget ran out first
+  MACHINE_FARM_ERROR,   // instance could not be started; see error
+} machine_farm_status;
+
+/**
+ * outcome of a single headless rosco-m68k run
+ **/
+typedef struct {
+  machine_farm_status status;
+  uint32_t    exit_code;     // D0 at exit
+  uint64_t    cycles;        // emulated clock cycles used
+  uint64_t    input_sent;    // bytes of program and input delivered to the guest
+  std::string serial_output; // everything transmitted on serial port A
+  std::string error;         // reason for MACHINE_FARM_ERROR
+} machine_farm_result;
+
+/**
+ * Runs many independent rosco-m68k instances in parallel, headless
+ * jobs are dealt out to one queue per worker thread; idle workers steal from the others
+ **/
+class MachineFarm {
+public:
+  /**
+   * Create a new, empty, machine farm
+   *
+   * @param thread_count count of worker threads; 0 to use one per hardware thread
+   **/
+  MachineFarm(uint32_t thread_count);
+  ~MachineFarm();
+
+  /**
+   * Queue a job
+   *
+   * @param job description of the run
+   * @returns index of the job, for reading its result
+   **/
+  uint32_t addJob(const machine_farm_job* job);
+
+  /**
+   * Run every queued job, returning once all have finished
+   **/
+  void run();
+
+  /**
+   * Get count of queued jobs
+   *
+   * @returns count of jobs
+   **/
+  uint32_t jobCount();
+
+  /**
+   * Get the result of a job
+   *
+   * @param index index returned by addJob()
+   * @returns result of the job; status is MACHINE_FARM_PENDING until run() has processed it
+   **/
+  const machine_farm_result* result(uint32_t index);
+
+  /**
+   * Get a printable name for a job status
+   *
+   * @param status job status
+   * @returns status name
+   **/
+  static const char* statusName(machine_farm_status status);
+
+protected:
+  typedef struct {
+    std::mutex            lock;
+    std::deque<uint32_t>  jobs;
+  } work_queue;
+
+  void worker(uint32_t worker_index);
+  bool takeJob(uint32_t worker_index, uint32_t* job_index);
+  void runJob(uint32_t job_index);
+  void loadRomImages();
+
+  uint32_t thread_count;
+  uint32_t worker_count; // threads actually started by run()
+  std::vector<machine_farm_job>    jobs;
+  std::vector<machine_farm_result> results;
+  std::map<std::string, RomImage*> rom_images; // shared, read-only, while running
+  std::map<std::string, std::string> rom_errors;
+  work_queue* queues;
+};
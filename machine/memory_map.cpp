@@ -0,0 +1,153 @@
+#include "memory_map.hpp"
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+}
+
+// backing for empty pages, so they can be read directly like any other memory
+static const uint8_t memory_map_zero_page[MEMORY_MAP_PAGE_SIZE] = { 0 };
+
+MemoryMap::MemoryMap() {
+  for(uint32_t index=0; index<MEMORY_MAP_PAGE_COUNT; ++index) {
+    this->pages[index] = { .read = memory_map_zero_page, .write = NULL, .device_read = NULL, .device_write = NULL, .callback_data = NULL, .device_base = 0 };
+  }
+}
+
+MemoryMap::~MemoryMap() {
+  this->release();
+}
+
+void MemoryMap::release() {
+  for(GuestMemory* memory : this->ram) { delete memory; }
+  this->ram.clear();
+}
+
+static bool memoryMapRegionValid(const memory_region* region) {
+  if(region->size == 0) { return false; }
+  if((region->base | region->size) & (MEMORY_MAP_PAGE_SIZE - 1)) { return false; }
+  if(((uint64_t)region->base + (uint64_t)region->size) > ((uint64_t)MEMORY_MAP_PAGE_COUNT << MEMORY_MAP_PAGE_BITS)) { return false; }
+  if((region->type == MEMORY_REGION_ROM) && !region->rom) { return false; }
+  if((region->type == MEMORY_REGION_DEVICE) && (!region->read || !region->write)) { return false; }
+  return true;
+}
+
+bool MemoryMap::addRegion(const memory_region* region) {
+  if(!memoryMapRegionValid(region)) { return false; }
+  this->regions.push_back(*region);
+  return true;
+}
+
+static bool memoryMapParseNumber(const char* text, const char** end, uint32_t* value) {
+  char* number_end;
+  unsigned long long number = strtoull(text, &number_end, 0);
+  if(number_end == text) { return false; }
+  if((*number_end == 'K') || (*number_end == 'k')) { number *= 1024;        ++number_end; }
+  else if((*number_end == 'M') || (*number_end == 'm')) { number *= 1024 * 1024; ++number_end; }
+  if(number > 0xFFFFFFFFULL) { return false; }
+  *value = (uint32_t)number;
+  *end   = number_end;
+  return true;
+}
+
+bool MemoryMap::parseRegions(const char* description, std::vector<memory_region>* regions) {
+  std::vector<memory_region> parsed;
+  const char* cursor = description;
+
+  while(*cursor) {
+    while((*cursor == ' ') || (*cursor == ',') || (*cursor == ';')) { ++cursor; }
+    if(!*cursor) { break; }
+
+    memory_region region = { .type = MEMORY_REGION_EMPTY, .base = 0, .size = 0, .rom = NULL, .read = NULL, .write = NULL, .callback_data = NULL };
+    if(!strncmp(cursor, "ram:", 4)) {
+      region.type = MEMORY_REGION_RAM;
+      cursor += 4;
+    } else if(!strncmp(cursor, "empty:", 6)) {
+      region.type = MEMORY_REGION_EMPTY;
+      cursor += 6;
+    } else {
+      return false;
+    }
+
+    if(!memoryMapParseNumber(cursor, &cursor, &region.base)) { return false; }
+    if(*cursor != ':') { return false; }
+    ++cursor;
+    if(!memoryMapParseNumber(cursor, &cursor, &region.size)) { return false; }
+    if(*cursor && (*cursor != ',') && (*cursor != ';') && (*cursor != ' ')) { return false; }
+
+    if(!memoryMapRegionValid(&region)) { return false; }
+    parsed.push_back(region);
+  }
+
+  for(const memory_region& region : parsed) {
+    regions->push_back(region);
+  }
+  return true;
+}
+
+void MemoryMap::compile() {
+  this->release();
+  for(const memory_region& region : this->regions) {
+    if(region.type == MEMORY_REGION_RAM) {
+      this->ram.push_back(new GuestMemory(region.size));
+    }
+  }
+  this->buildPages();
+}
+
+void MemoryMap::compileClone(MemoryMap* source, bool modified) {
+  size_t ram_count = 0;
+  for(const memory_region& region : this->regions) {
+    if(region.type == MEMORY_REGION_RAM) { ++ram_count; }
+  }
+  if(ram_count != source->ram.size()) { throw "memory map differs from clone source"; }
+
+  this->release();
+  for(GuestMemory* memory : source->ram) {
+    this->ram.push_back(memory->clone(modified));
+  }
+  this->buildPages();
+}
+
+void MemoryMap::buildPages() {
+  for(uint32_t index=0; index<MEMORY_MAP_PAGE_COUNT; ++index) {
+    this->pages[index] = { .read = memory_map_zero_page, .write = NULL, .device_read = NULL, .device_write = NULL, .callback_data = NULL, .device_base = 0 };
+  }
+
+  // regions are applied in order, so later ones win wherever they overlap
+  size_t ram_index = 0;
+  for(const memory_region& region : this->regions) {
+    uint32_t first_page = region.base >> MEMORY_MAP_PAGE_BITS;
+    uint32_t page_count = region.size >> MEMORY_MAP_PAGE_BITS;
+    uint8_t* ram = (region.type == MEMORY_REGION_RAM) ? this->ram[ram_index++]->data() : NULL;
+
+    for(uint32_t page=0; page<page_count; ++page) {
+      memory_page* entry = &(this->pages[first_page + page]);
+      size_t offset = (size_t)page << MEMORY_MAP_PAGE_BITS;
+      *entry = { .read = NULL, .write = NULL, .device_read = NULL, .device_write = NULL, .callback_data = NULL, .device_base = 0 };
+      switch(region.type) {
+        case MEMORY_REGION_EMPTY:  entry->read = memory_map_zero_page; break;
+        case MEMORY_REGION_RAM:    entry->read = ram + offset; entry->write = ram + offset; break;
+        case MEMORY_REGION_ROM:    entry->read = region.rom + offset; break;
+        case MEMORY_REGION_DEVICE:
+          entry->device_read   = region.read;
+          entry->device_write  = region.write;
+          entry->callback_data = region.callback_data;
+          entry->device_base   = region.base;
+          break;
+      }
+    }
+  }
+}
+
+uint8_t* MemoryMap::ramPointer(uint32_t address) {
+  memory_page* page = &(this->pages[(address >> MEMORY_MAP_PAGE_BITS) & (MEMORY_MAP_PAGE_COUNT - 1)]);
+  if(!page->write) { return NULL; }
+  return page->write + (address & (MEMORY_MAP_PAGE_SIZE - 1));
+}
+
+uint32_t MemoryMap::ramContiguousEnd() {
+  uint32_t page = 0;
+  while((page < MEMORY_MAP_PAGE_COUNT) && this->pages[page].write) { ++page; }
+  if(page == 0) { return 0; }
+  return (page << MEMORY_MAP_PAGE_BITS) - 1;
+}
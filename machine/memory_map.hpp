@@ -0,0 +1,120 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdbool.h>
+}
+#include <vector>
+#include "guest_memory.hpp"
+
+#define MEMORY_MAP_PAGE_BITS  16
+#define MEMORY_MAP_PAGE_SIZE  (1 << MEMORY_MAP_PAGE_BITS)          // 64 KiB
+#define MEMORY_MAP_PAGE_COUNT (1 << (24 - MEMORY_MAP_PAGE_BITS))  // 24 bit bus
+
+/// @brief callback used to read a byte from a device region
+typedef uint8_t (*memoryRead)(uint32_t offset, void* callback_data);
+/// @brief callback used to write a byte to a device region
+typedef void (*memoryWrite)(uint32_t offset, uint8_t value, void* callback_data);
+
+typedef enum {
+  MEMORY_REGION_EMPTY,  // reads as zero, ignores writes
+  MEMORY_REGION_RAM,    // read/write memory (sparse; pages committed on first write)
+  MEMORY_REGION_ROM,    // read-only memory, contents supplied by the owner of the map
+  MEMORY_REGION_DEVICE, // reads/writes are forwarded to callbacks
+} memory_region_type;
+
+/**
+ * one entry of a memory map description
+ * base and size must be multiples of MEMORY_MAP_PAGE_SIZE
+ **/
+typedef struct {
+  memory_region_type type;
+  uint32_t       base;          // first bus address of the region
+  uint32_t       size;          // size of the region, in bytes
+  const uint8_t* rom;           // MEMORY_REGION_ROM: contents (size bytes)
+  memoryRead     read;          // MEMORY_REGION_DEVICE: read callback (offset is relative to base)
+  memoryWrite    write;         // MEMORY_REGION_DEVICE: write callback (offset is relative to base)
+  void*          callback_data; // MEMORY_REGION_DEVICE: extra data passed to callbacks
+} memory_region;
+
+/**
+ * one page of the compiled bus dispatch table
+ **/
+typedef struct {
+  const uint8_t* read;          // page contents for direct reads, or NULL if the page belongs to a device
+  uint8_t*       write;         // page contents for direct writes, or NULL if writes go to a device (or nowhere)
+  memoryRead     device_read;   // device callbacks, when read/write are NULL
+  memoryWrite    device_write;
+  void*          callback_data;
+  uint32_t       device_base;   // base address of the device region
+} memory_page;
+
+/**
+ * Bus memory map
+ * regions are described declaratively, then compiled into a page table; a bus access costs
+ * one table lookup no matter how many regions there are
+ **/
+class MemoryMap {
+public:
+  MemoryMap();
+  ~MemoryMap();
+
+  /**
+   * Add a region to the map description (takes effect on compile())
+   * later regions replace earlier ones where they overlap
+   *
+   * @param region region to add
+   * @returns whether the region is valid (page aligned, and within the 24 bit bus)
+   **/
+  bool addRegion(const memory_region* region);
+
+  /**
+   * Parse regions from a textual description
+   * entries are separated by ',' or ';', each is "<type>:<base>:<size>", where type is ram or empty;
+   * numbers may be decimal or 0x-prefixed hex, and sizes may end in K or M, ex: "ram:0x100000:3M"
+   *
+   * @param description memory map description
+   * @param regions receives the parsed regions
+   * @returns whether every entry was valid (if not, nothing is added to regions)
+   **/
+  static bool parseRegions(const char* description, std::vector<memory_region>* regions);
+
+  /**
+   * Build the bus dispatch table from the current description, allocating RAM regions
+   **/
+  void compile();
+
+  /**
+   * Build the bus dispatch table, with RAM regions sharing another map's current contents copy-on-write
+   * this map must have been given the same description as source (device regions are kept as described here)
+   *
+   * @param source map to clone RAM from (must be compiled)
+   * @param modified whether source RAM may have changed since it was last cloned
+   **/
+  void compileClone(MemoryMap* source, bool modified);
+
+  /**
+   * Find the RAM backing a bus address
+   *
+   * @param address bus address
+   * @returns pointer to the byte at address, or NULL if address isn't in RAM
+   **/
+  uint8_t* ramPointer(uint32_t address);
+
+  /**
+   * Get the end of RAM starting from address zero
+   *
+   * @returns highest address of the contiguous RAM starting at 0 (or 0 if there is none)
+   **/
+  uint32_t ramContiguousEnd();
+
+  // compiled dispatch table, indexed by (address >> MEMORY_MAP_PAGE_BITS)
+  memory_page pages[MEMORY_MAP_PAGE_COUNT];
+
+protected:
+  void buildPages();
+  void release();
+
+  std::vector<memory_region> regions;
+  std::vector<GuestMemory*>  ram; // one per RAM region, in regions order (once compiled)
+};
@@ -0,0 +1,360 @@
+#include "program_image.hpp"
+#include "rosco_m68k.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+// ELF32 layout (only what we use)
+#define ELF_HEADER_SIZE   52
+#define ELF_CLASS_32      1
+#define ELF_DATA_MSB      2
+#define ELF_MACHINE_68K   4
+#define ELF_PT_LOAD       1
+#define ELF_SHT_SYMTAB    2
+#define ELF_STT_FUNC      2
+#define ELF_STT_SECTION   3
+#define ELF_STT_FILE      4
+#define ELF_SHN_ABS       0xFFF1
+
+static uint16_t programRead16(const uint8_t* data) {
+  return (((uint16_t)data[0]) << 8) | data[1];
+}
+
+static uint32_t programRead32(const uint8_t* data) {
+  return (((uint32_t)data[0]) << 24) | (((uint32_t)data[1]) << 16) | (((uint32_t)data[2]) << 8) | data[3];
+}
+
+// whether offset..offset+length lies within limit bytes; checked without the sum, which may not fit
+static bool programRange(uint64_t limit, uint64_t offset, uint64_t length) {
+  return (offset <= limit) && (length <= (limit - offset));
+}
+
+static int programHexDigit(uint8_t character) {
+  if((character >= '0') && (character <= '9')) { return character - '0'; }
+  if((character >= 'A') && (character <= 'F')) { return character - 'A' + 10; }
+  if((character >= 'a') && (character <= 'f')) { return character - 'a' + 10; }
+  return -1;
+}
+
+// decode hex digit pairs up to the end of the line; returns count of bytes, or -1 if malformed
+static int programHexLine(const uint8_t* text, const uint8_t* end, uint8_t* bytes, int limit) {
+  int count = 0;
+  while((text < end) && (*text != '\r') && (*text != '\n')) {
+    if(((end - text) < 2) || (count == limit)) { return -1; }
+    int high = programHexDigit(text[0]);
+    int low  = programHexDigit(text[1]);
+    if((high < 0) || (low < 0)) { return -1; }
+    bytes[count++] = (uint8_t)((high << 4) | low);
+    text += 2;
+  }
+  return count;
+}
+
+ProgramImage* ProgramImage::load(const char* program_path) {
+  int program_file = open(program_path, O_RDONLY);
+  if(program_file < 0) { throw "error opening program file"; }
+
+  struct stat program_stat;
+  if(fstat(program_file, &program_stat) != 0) { close(program_file); throw "error opening program file"; }
+  if(program_stat.st_size <= 0) { close(program_file); throw "empty program file"; }
+
+  void* mapped = mmap(NULL, (size_t)program_stat.st_size, PROT_READ, MAP_PRIVATE, program_file, 0);
+  close(program_file); // the mapping holds its own reference to the file
+  if(mapped == MAP_FAILED) { throw "error mapping program file"; }
+  madvise(mapped, (size_t)program_stat.st_size, MADV_SEQUENTIAL); // read front to back, once
+
+  ProgramImage* program = new ProgramImage();
+  program->file_data   = (const uint8_t*)mapped;
+  program->file_length = (size_t)program_stat.st_size;
+  try {
+    const uint8_t* data = program->file_data;
+    if((program->file_length >= 4) && (data[0] == 0x7F) && (data[1] == 'E') && (data[2] == 'L') && (data[3] == 'F')) {
+      program->parseElf();
+    } else if((program->file_length >= 2) && (data[0] == 'S') && (data[1] >= '0') && (data[1] <= '9')) {
+      program->parseSrec();
+    } else if(data[0] == ':') {
+      program->parseIhex();
+    } else {
+      program->parseRaw();
+    }
+  } catch(...) {
+    delete program;
+    throw;
+  }
+  return program;
+}
+
+ProgramImage::ProgramImage() {
+  this->file_data    = NULL;
+  this->file_length  = 0;
+  this->image_format = PROGRAM_IMAGE_RAW;
+  this->entry_point  = 0;
+  this->entry_known  = false;
+}
+
+ProgramImage::~ProgramImage() {
+  if(this->file_data) { munmap((void*)this->file_data, this->file_length); }
+}
+
+program_image_format ProgramImage::format() {
+  return this->image_format;
+}
+
+uint32_t ProgramImage::entry() {
+  return this->entry_point;
+}
+
+const std::vector<program_segment>& ProgramImage::segments() {
+  return this->segment_list;
+}
+
+const std::vector<program_symbol>& ProgramImage::symbols() {
+  return this->symbol_list;
+}
+
+void ProgramImage::parseRaw() {
+  if(this->file_length > (0x1000000 - PROGRAM_IMAGE_RAW_BASE)) { throw "program file too large"; }
+  this->image_format = PROGRAM_IMAGE_RAW;
+  this->entry_point  = PROGRAM_IMAGE_RAW_BASE;
+  this->entry_known  = true;
+  this->segment_list.push_back({
+    .address       = PROGRAM_IMAGE_RAW_BASE,
+    .data          = this->file_data,
+    .file_length   = (uint32_t)this->file_length,
+    .memory_length = (uint32_t)this->file_length,
+  });
+}
+
+void ProgramImage::parseElf() {
+  const uint8_t* data   = this->file_data;
+  size_t         length = this->file_length;
+  this->image_format = PROGRAM_IMAGE_ELF;
+
+  if(length < ELF_HEADER_SIZE) { throw "invalid ELF program file"; }
+  if((data[4] != ELF_CLASS_32) || (data[5] != ELF_DATA_MSB)) { throw "ELF program file is not 32 bit big-endian"; }
+  if(programRead16(data + 18) != ELF_MACHINE_68K) { throw "ELF program file is not for m68k"; }
+  this->entry_point = programRead32(data + 24);
+  this->entry_known = true;
+
+  // program headers: PT_LOAD segments, placed at their physical (load) address
+  uint32_t header_offset = programRead32(data + 28);
+  uint16_t header_size   = programRead16(data + 42);
+  uint16_t header_count  = programRead16(data + 44);
+  if((header_size < 32) || !programRange(length, header_offset, (uint64_t)header_size * header_count)) { throw "invalid ELF program headers"; }
+  for(uint16_t index=0; index<header_count; ++index) {
+    const uint8_t* header = data + header_offset + ((size_t)header_size * index);
+    if(programRead32(header) != ELF_PT_LOAD) { continue; }
+    uint32_t offset        = programRead32(header +  4);
+    uint32_t address       = programRead32(header + 12);
+    uint32_t file_size     = programRead32(header + 16);
+    uint32_t memory_size   = programRead32(header + 20);
+    if(!memory_size) { continue; }
+    if((file_size > memory_size) || !programRange(length, offset, file_size)) { throw "invalid ELF program segment"; }
+    if(((uint64_t)address + memory_size) > 0x1000000) { throw "ELF program segment outside of 24 bit bus"; }
+    this->segment_list.push_back({ .address = address, .data = data + offset, .file_length = file_size, .memory_length = memory_size });
+  }
+  if(this->segment_list.empty()) { throw "ELF program file has nothing to load"; }
+
+  // section headers: symbol table, if not stripped
+  uint32_t section_offset = programRead32(data + 32);
+  uint16_t section_size   = programRead16(data + 46);
+  uint16_t section_count  = programRead16(data + 48);
+  if(!section_offset || !section_count) { return; }
+  if((section_size < 40) || !programRange(length, section_offset, (uint64_t)section_size * section_count)) { throw "invalid ELF section headers"; }
+  for(uint16_t index=0; index<section_count; ++index) {
+    const uint8_t* section = data + section_offset + ((size_t)section_size * index);
+    if(programRead32(section + 4) != ELF_SHT_SYMTAB) { continue; }
+    uint32_t symbols_offset = programRead32(section + 16);
+    uint32_t symbols_size   = programRead32(section + 20);
+    uint32_t strings_index  = programRead32(section + 24);
+    uint32_t symbol_size    = programRead32(section + 36);
+    if((symbol_size < 16) || (strings_index >= section_count) || !programRange(length, symbols_offset, symbols_size)) { throw "invalid ELF symbol table"; }
+    const uint8_t* strings_section = data + section_offset + ((size_t)section_size * strings_index);
+    uint32_t strings_offset = programRead32(strings_section + 16);
+    uint32_t strings_size   = programRead32(strings_section + 20);
+    if(!programRange(length, strings_offset, strings_size)) { throw "invalid ELF symbol table"; }
+    const char* strings = (const char*)(data + strings_offset);
+
+    for(uint32_t symbol_offset=symbol_size; programRange(symbols_size, symbol_offset, symbol_size); symbol_offset += symbol_size) { // entry 0 is reserved
+      const uint8_t* symbol = data + symbols_offset + symbol_offset;
+      uint32_t name_offset = programRead32(symbol);
+      uint8_t  type        = symbol[12] & 0x0F;
+      uint16_t section_ref = programRead16(symbol + 14);
+      if(!name_offset || (name_offset >= strings_size)) { continue; }
+      if((type == ELF_STT_SECTION) || (type == ELF_STT_FILE) || (section_ref == 0) || (section_ref == ELF_SHN_ABS)) { continue; } // not an address (absolute symbols are constants), or undefined
+      size_t name_length = strnlen(strings + name_offset, strings_size - name_offset);
+      this->symbol_list.push_back({
+        .address  = programRead32(symbol + 4),
+        .size     = programRead32(symbol + 8),
+        .function = (type == ELF_STT_FUNC),
+        .name     = std::string(strings + name_offset, name_length),
+      });
+    }
+  }
+}
+
+void ProgramImage::parseSrec() {
+  this->image_format = PROGRAM_IMAGE_SREC;
+  const uint8_t* text = this->file_data;
+  const uint8_t* end  = text + this->file_length;
+  uint8_t record[256];
+
+  while(text < end) {
+    if((*text == '\r') || (*text == '\n')) { ++text; continue; }
+    if((*text != 'S') || ((end - text) < 2)) { throw "invalid S-record"; }
+    uint8_t type = text[1];
+    int count = programHexLine(text + 2, end, record, sizeof(record));
+    if((count < 1) || (record[0] != (count - 1))) { throw "invalid S-record"; }
+    uint8_t sum = 0;
+    for(int index=0; index<count; ++index) { sum += record[index]; }
+    if(sum != 0xFF) { throw "S-record checksum mismatch"; }
+    while((text < end) && (*text != '\n')) { ++text; }
+
+    // count, address (2-4 bytes), data, checksum
+    int address_size;
+    switch(type) {
+      case '1': case '9': address_size = 2; break;
+      case '2': case '8': address_size = 3; break;
+      case '3': case '7': address_size = 4; break;
+      case '0': case '5': case '6': continue; // header, record counts
+      default: throw "invalid S-record type";
+    }
+    if(count < (address_size + 2)) { throw "invalid S-record"; }
+    uint32_t address = 0;
+    for(int index=0; index<address_size; ++index) { address = (address << 8) | record[1 + index]; }
+
+    if(type <= '3') {
+      uint32_t data_length = (uint32_t)(count - address_size - 2);
+      if(((uint64_t)address + data_length) > 0x1000000) { throw "S-record outside of 24 bit bus"; }
+      this->addDecoded(address, record + 1 + address_size, data_length);
+    } else {
+      this->entry_point = address;
+      this->entry_known = true;
+    }
+  }
+  this->finishDecoded();
+}
+
+void ProgramImage::parseIhex() {
+  this->image_format = PROGRAM_IMAGE_IHEX;
+  const uint8_t* text = this->file_data;
+  const uint8_t* end  = text + this->file_length;
+  uint8_t  record[256 + 5];
+  uint32_t base = 0;
+
+  while(text < end) {
+    if((*text == '\r') || (*text == '\n')) { ++text; continue; }
+    if(*text != ':') { throw "invalid Intel HEX record"; }
+    int count = programHexLine(text + 1, end, record, sizeof(record));
+    if((count < 5) || (count != (record[0] + 5))) { throw "invalid Intel HEX record"; }
+    uint8_t sum = 0;
+    for(int index=0; index<count; ++index) { sum += record[index]; }
+    if(sum != 0x00) { throw "Intel HEX checksum mismatch"; }
+    while((text < end) && (*text != '\n')) { ++text; }
+
+    // count, address (2 bytes), type, data, checksum
+    uint8_t        data_length = record[0];
+    uint16_t       offset      = programRead16(record + 1);
+    const uint8_t* data        = record + 4;
+    switch(record[3]) {
+      case 0x00: { // data
+        uint32_t address = base + offset;
+        if(((uint64_t)address + data_length) > 0x1000000) { throw "Intel HEX record outside of 24 bit bus"; }
+        this->addDecoded(address, data, data_length);
+      } break;
+      case 0x01: // end of file
+        text = end;
+        break;
+      case 0x02: // extended segment address
+        if(data_length != 2) { throw "invalid Intel HEX record"; }
+        base = ((uint32_t)programRead16(data)) << 4;
+        break;
+      case 0x03: // start segment address (CS:IP)
+        if(data_length != 4) { throw "invalid Intel HEX record"; }
+        this->entry_point = (((uint32_t)programRead16(data)) << 4) + programRead16(data + 2);
+        this->entry_known = true;
+        break;
+      case 0x04: // extended linear address
+        if(data_length != 2) { throw "invalid Intel HEX record"; }
+        base = ((uint32_t)programRead16(data)) << 16;
+        break;
+      case 0x05: // start linear address
+        if(data_length != 4) { throw "invalid Intel HEX record"; }
+        this->entry_point = programRead32(data);
+        this->entry_known = true;
+        break;
+      default: throw "invalid Intel HEX record type";
+    }
+  }
+  this->finishDecoded();
+}
+
+void ProgramImage::addDecoded(uint32_t address, const uint8_t* data, uint32_t length) {
+  if(!length) { return; }
+  // records usually run on from each other; those just grow the current segment
+  if(!this->segment_list.empty()) {
+    program_segment* last = &(this->segment_list.back());
+    if((last->address + last->file_length) == address) {
+      this->decoded.insert(this->decoded.end(), data, data + length);
+      last->file_length   += length;
+      last->memory_length += length;
+      return;
+    }
+  }
+  this->decoded_offsets.push_back((uint32_t)this->decoded.size());
+  this->decoded.insert(this->decoded.end(), data, data + length);
+  this->segment_list.push_back({ .address = address, .data = NULL, .file_length = length, .memory_length = length });
+}
+
+void ProgramImage::finishDecoded() {
+  if(this->segment_list.empty()) { throw "program file has nothing to load"; }
+  for(size_t index=0; index<this->segment_list.size(); ++index) {
+    this->segment_list[index].data = this->decoded.data() + this->decoded_offsets[index];
+  }
+  if(!this->entry_known) {
+    this->entry_point = this->segment_list[0].address;
+    for(const program_segment& segment : this->segment_list) {
+      if(segment.address < this->entry_point) { this->entry_point = segment.address; }
+    }
+  }
+
+  // the text has been decoded; it's no longer needed
+  munmap((void*)this->file_data, this->file_length);
+  this->file_data   = NULL;
+  this->file_length = 0;
+}
+
+void ProgramImage::place(RoscoM68K* rosco) {
+  // check everything lands in RAM first, so a bad image leaves memory untouched
+  for(const program_segment& segment : this->segment_list) {
+    uint32_t address = segment.address & ~(MEMORY_MAP_PAGE_SIZE - 1);
+    uint32_t end     = segment.address + segment.memory_length;
+    for(; address < end; address += MEMORY_MAP_PAGE_SIZE) {
+      if(!rosco->memory_map.ramPointer(address)) { throw "program segment outside of RAM"; }
+    }
+  }
+
+  // one copy per page, straight from the file mapping (or decoded records) into guest memory
+  for(const program_segment& segment : this->segment_list) {
+    uint32_t done = 0;
+    while(done < segment.memory_length) {
+      uint32_t address = segment.address + done;
+      uint32_t run     = MEMORY_MAP_PAGE_SIZE - (address & (MEMORY_MAP_PAGE_SIZE - 1));
+      if(run > (segment.memory_length - done)) { run = segment.memory_length - done; }
+      uint8_t* destination = rosco->memory_map.ramPointer(address);
+
+      uint32_t copy = (done < segment.file_length) ? (segment.file_length - done) : 0;
+      if(copy > run) { copy = run; }
+      memcpy(destination, segment.data + done, copy);
+      memset(destination + copy, 0x00, run - copy); // BSS
+      done += run;
+    }
+  }
+  rosco->ram_modified = true;
+
+  rosco->debugger.jump(this->entry_point);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include <string>
+#include <vector>
+
+class RoscoM68K;
+
+#define PROGRAM_IMAGE_RAW_BASE 0x000410 // where the loader places raw binaries (.PROGRAM_BEGIN)
+
+typedef enum {
+  PROGRAM_IMAGE_RAW,   // flat binary, loaded at PROGRAM_IMAGE_RAW_BASE
+  PROGRAM_IMAGE_ELF,   // ELF32 big-endian (m68k), PT_LOAD segments
+  PROGRAM_IMAGE_SREC,  // Motorola S-records
+  PROGRAM_IMAGE_IHEX,  // Intel HEX
+} program_image_format;
+
+/**
+ * one contiguous run of program memory
+ **/
+typedef struct {
+  uint32_t       address;       // bus address of the first byte
+  const uint8_t* data;          // contents; points into the mapped file (raw, ELF), or the decoded records (S-record, HEX)
+  uint32_t       file_length;   // bytes of data
+  uint32_t       memory_length; // bytes of memory the segment covers; past file_length is zero filled (BSS)
+} program_segment;
+
+/**
+ * one symbol from an ELF symbol table
+ **/
+typedef struct {
+  uint32_t    address;
+  uint32_t    size;     // 0 if unknown
+  bool        function; // code (STT_FUNC), rather than data, or a plain label
+  std::string name;
+} program_symbol;
+
+/**
+ * Program file, parsed for loading straight onto the bus
+ * the file is mapped read-only, and segments are copied to guest memory from the mapping in one pass
+ **/
+class ProgramImage {
+public:
+  /**
+   * Load a program file; the format is detected from its contents:
+   * ELF by its magic, S-records by a leading 'S' and digit, Intel HEX by a leading ':', and anything else as raw binary
+   *
+   * @param program_path path to the program file
+   * @returns new program image
+   **/
+  static ProgramImage* load(const char* program_path);
+  ~ProgramImage();
+
+  /**
+   * Copy every segment into guest RAM (zero filling BSS), and start the processor at the entry point
+   * a segment outside of RAM throws, before anything is copied
+   *
+   * @param rosco rosco-m68k to load into
+   **/
+  void place(RoscoM68K* rosco);
+
+  /**
+   * Get the detected file format
+   *
+   * @returns format of the program file
+   **/
+  program_image_format format();
+
+  /**
+   * Get the entry point
+   *
+   * @returns address to start at (raw: PROGRAM_IMAGE_RAW_BASE; S-record/HEX without a start record: the lowest address loaded)
+   **/
+  uint32_t entry();
+
+  /**
+   * Get the memory to load
+   *
+   * @returns segments, in file order
+   **/
+  const std::vector<program_segment>& segments();
+
+  /**
+   * Get the symbol table (ELF only; empty if stripped)
+   *
+   * @returns symbols, in symbol table order
+   **/
+  const std::vector<program_symbol>& symbols();
+
+protected:
+  ProgramImage();
+  void parseRaw();
+  void parseElf();
+  void parseSrec();
+  void parseIhex();
+  void addDecoded(uint32_t address, const uint8_t* data, uint32_t length);
+  void finishDecoded();
+
+  const uint8_t* file_data;   // mapped file (or NULL if empty)
+  size_t         file_length;
+
+  program_image_format         image_format;
+  uint32_t                     entry_point;
+  bool                         entry_known;
+  std::vector<program_segment> segment_list;
+  std::vector<program_symbol>  symbol_list;
+
+  // S-record / HEX contents, decoded; segments point into here once finishDecoded() runs
+  std::vector<uint8_t>  decoded;
+  std::vector<uint32_t> decoded_offsets; // offset into decoded, per segment
+};
@@ -0,0 +1,123 @@
+#include "rom_image.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+#include <mutex>
+#include <vector>
+
+// every image currently mapped, so instances booting the same file share it
+static std::mutex              rom_images_lock;
+static std::vector<RomImage*>  rom_images;
+
+RomImage* RomImage::acquire(const char* rom_path) {
+  int rom_file = open(rom_path, O_RDONLY);
+  if(rom_file < 0) { throw "error opening rosco rom file"; }
+
+  struct stat rom_stat;
+  if(fstat(rom_file, &rom_stat) != 0) { close(rom_file); throw "error opening rosco rom file"; }
+
+  std::lock_guard<std::mutex> guard(rom_images_lock);
+  for(RomImage* rom_image : rom_images) {
+    if((rom_image->file_device == rom_stat.st_dev) && (rom_image->file_inode == rom_stat.st_ino)) {
+      close(rom_file);
+      ++(rom_image->references);
+      return rom_image;
+    }
+  }
+
+  size_t file_length = (size_t)rom_stat.st_size;
+  if(file_length > ROM_IMAGE_SIZE) { file_length = ROM_IMAGE_SIZE; }
+
+  RomImage* rom_image;
+  try {
+    rom_image = new RomImage(rom_file, file_length);
+  } catch(...) {
+    close(rom_file);
+    throw;
+  }
+  close(rom_file); // the mapping holds its own reference to the file
+
+  rom_image->file_device = rom_stat.st_dev;
+  rom_image->file_inode  = rom_stat.st_ino;
+  rom_images.push_back(rom_image);
+  return rom_image;
+}
+
+RomImage* RomImage::acquire(RomImage* rom_image) {
+  std::lock_guard<std::mutex> guard(rom_images_lock);
+  ++(rom_image->references);
+  return rom_image;
+}
+
+void RomImage::release(RomImage* rom_image) {
+  if(!rom_image) { return; }
+
+  std::lock_guard<std::mutex> guard(rom_images_lock);
+  if(--(rom_image->references) > 0) { return; }
+  for(size_t index=0; index<rom_images.size(); ++index) {
+    if(rom_images[index] == rom_image) {
+      rom_images.erase(rom_images.begin() + index);
+      break;
+    }
+  }
+  delete rom_image;
+}
+
+RomImage::RomImage(int rom_file, size_t file_length) {
+  // huge pages are anonymous, so the file is read in, once per process
+  guest_memory_pages pages = GUEST_MEMORY_PAGES_NORMAL;
+  this->bytes = NULL;
+  if(GuestMemory::requestedPages() != GUEST_MEMORY_PAGES_NORMAL) {
+    this->bytes = GuestMemory::mapAnonymous(ROM_IMAGE_SIZE, &(this->mapped_length), &pages);
+  }
+  if(this->bytes && (pages != GUEST_MEMORY_PAGES_NORMAL)) {
+    size_t loaded = 0;
+    while(loaded < file_length) {
+      ssize_t read_length = pread(rom_file, this->bytes + loaded, file_length - loaded, (off_t)loaded);
+      if(read_length <= 0) {
+        munmap(this->bytes, this->mapped_length);
+        throw "error reading rosco rom file";
+      }
+      loaded += (size_t)read_length;
+    }
+    mprotect(this->bytes, this->mapped_length, PROT_READ);
+
+    this->file_length = file_length;
+    this->references  = 1;
+    return;
+  }
+  if(this->bytes) { munmap(this->bytes, this->mapped_length); }
+
+  // reserve the whole ROM as zero pages, then map the file over the front of it;
+  // touching file pages past EOF would fault, the anonymous pages behind them just read zero
+  void* reserved = mmap(NULL, ROM_IMAGE_SIZE, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if(reserved == MAP_FAILED) { throw "error mapping rosco rom"; }
+
+  if(file_length > 0) {
+    void* mapped = mmap(reserved, file_length, PROT_READ, MAP_PRIVATE | MAP_FIXED, rom_file, 0);
+    if(mapped == MAP_FAILED) {
+      munmap(reserved, ROM_IMAGE_SIZE);
+      throw "error mapping rosco rom file";
+    }
+  }
+
+  this->bytes         = (uint8_t*)reserved;
+  this->mapped_length = ROM_IMAGE_SIZE;
+  this->file_length   = file_length;
+  this->references  = 1;
+}
+
+RomImage::~RomImage() {
+  munmap(this->bytes, this->mapped_length);
+}
+
+const uint8_t* RomImage::data() {
+  return this->bytes;
+}
+
+size_t RomImage::fileLength() {
+  return this->file_length;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+}
+#include "guest_memory.hpp"
+
+#define ROM_IMAGE_SIZE (1024 * 1024)
+
+/**
+ * Read-only, memory-mapped, ROM contents
+ * images are shared: every acquire() of the same file returns the same mapping;
+ * when guest memory uses huge pages (GuestMemory::setPages()), the file is copied into huge pages instead
+ **/
+class RomImage {
+public:
+  /**
+   * Get the (shared) image of a ROM file, mapping it if it isn't already
+   * bytes past the end of the file (up to ROM_IMAGE_SIZE) read as zero
+   * 
+   * @param rom_path path to a file to use as ROM (limit 1 MiB)
+   * @returns ROM image; pass to release() when done with it
+   **/
+  static RomImage* acquire(const char* rom_path);
+
+  /**
+   * Take another reference to an image already returned by acquire()
+   * 
+   * @param rom_image ROM image to reference
+   * @returns the same ROM image; pass to release() when done with it
+   **/
+  static RomImage* acquire(RomImage* rom_image);
+
+  /**
+   * Release an image returned by acquire(); the last release unmaps it
+   * 
+   * @param rom_image ROM image to release
+   **/
+  static void release(RomImage* rom_image);
+
+  /**
+   * Get ROM contents
+   * 
+   * @returns pointer to ROM_IMAGE_SIZE bytes of ROM data
+   **/
+  const uint8_t* data();
+
+  /**
+   * Get size of the mapped file
+   * 
+   * @returns count of bytes of the ROM file in use
+   **/
+  size_t fileLength();
+
+protected:
+  RomImage(int rom_file, size_t file_length);
+  ~RomImage();
+
+  uint8_t* bytes;
+  size_t   mapped_length;
+  size_t   file_length;
+  dev_t    file_device;
+  ino_t    file_inode;
+  uint32_t references;
+};
@@ -1,48 +1,179 @@
 #include "rosco_m68k.hpp"
 #include <moira/MoiraTypes.h>
+extern "C" {
+#include <string.h>
+}
+#define DELAY_LOOP_NONE 0xFFFFFFFF
+
+// the loader's TRAP #1 handler (rom/loader-startup.asm), from its head:
+//   tst.l D0 / beq.s done / btst.b #0,SRA / beq.s *-8 / move.b RHRA,D1 / move.b D1,(A0)+ / subq.l #1,D0 / bra.s head
+static const uint16_t loader_read_loop[] = {
+  0x4A80, 0x6716, 0x0839, 0x0000, 0x00F0, 0x0003, 0x67F6, 0x1239, 0x00F0, 0x0007, 0x10C1, 0x5380, 0x60E6,
+};
+#define LOADER_READ_LOOP_WORDS        (sizeof(loader_read_loop) / sizeof(loader_read_loop[0]))
+#define LOADER_READ_LOOP_INSTRUCTIONS 8 // per byte, when it's already waiting
+#define LOADER_READ_CHUNK             4096
+#define SPI_ROUTINE_CHUNK             512 // one SD block
+#define INPUT_ADMIT_CHUNK             4096
+
+static uint8_t roscoIoRead(uint32_t offset, void* callback_data) {
+  RoscoM68K* rosco = (RoscoM68K*)callback_data;
+  // F0_00_00-F0_00_1F @ odd == DUART
+  if((offset < 0x20) && (offset & 1)) { return rosco->duart->busRead((uint8_t)(offset >> 1)); }
+  return 0x00;
+}
 
-RoscoM68K::RoscoM68K(const char* rom_path) : moira::Moira() {
-  FILE* rom_file = fopen(rom_path, "rb");
-  if(!rom_file) { throw "error opening rosco rom file"; }
+static void roscoIoWrite(uint32_t offset, uint8_t value, void* callback_data) {
+  RoscoM68K* rosco = (RoscoM68K*)callback_data;
+  // F0_00_00-F0_00_1F @ odd == DUART
+  if((offset < 0x20) && (offset & 1)) { rosco->duart->busWrite((uint8_t)(offset >> 1), value); }
+}
+
+RoscoM68K::RoscoM68K(const char* rom_path, const memory_region* expansion, uint32_t expansion_count) : moira::Moira() {
+  this->rom_image_owned = RomImage::acquire(rom_path);
+  try {
+    this->initialize(this->rom_image_owned, expansion, expansion_count);
+  } catch(...) {
+    RomImage::release(this->rom_image_owned);
+    throw;
+  }
+}
 
-  this->ram = (uint8_t*)malloc(1024 * 1024);
-  if(!this->ram) { fclose(rom_file); throw "error allocating rosco ram"; }
+RoscoM68K::RoscoM68K(RomImage* rom_image, const memory_region* expansion, uint32_t expansion_count) : moira::Moira() {
+  this->rom_image_owned = NULL;
+  this->initialize(rom_image, expansion, expansion_count);
+}
 
-  this->rom = (uint8_t*)malloc(1024 * 1024);
-  if(!this->rom) { fclose(rom_file); free(this->ram); throw "error allocating rosco rom"; }
+void RoscoM68K::initialize(RomImage* rom_image, const memory_region* expansion, uint32_t expansion_count) {
+  this->rom_image = rom_image;
+  this->rom       = rom_image->data();
 
-  size_t rom_bytes_wrote = 0;
-  size_t rom_bytes_read = fread(this->rom, 1, 1024, rom_file);
-  while(rom_bytes_read > 0) {
-    rom_bytes_wrote += rom_bytes_read;
-    rom_bytes_read = fread(this->rom + rom_bytes_wrote, 1, 1024, rom_file);
+  const memory_region board[] = {
+    { .type = MEMORY_REGION_RAM,    .base = 0x000000, .size = 0x100000, .rom = NULL,      .read = NULL,        .write = NULL,         .callback_data = NULL }, // On-board RAM ( 1 MiB)
+    { .type = MEMORY_REGION_ROM,    .base = 0xE00000, .size = 0x100000, .rom = this->rom, .read = NULL,        .write = NULL,         .callback_data = NULL }, // On-board ROM ( 1 MiB)
+    { .type = MEMORY_REGION_DEVICE, .base = 0xF00000, .size = 0x100000, .rom = NULL,      .read = roscoIoRead, .write = roscoIoWrite, .callback_data = this }, // I/O Space    ( 1 MiB)
+  };
+  for(const memory_region& region : board) { this->memory_map.addRegion(&region); }
+  for(uint32_t index=0; index<expansion_count; ++index) {
+    const memory_region* region = &(expansion[index]);
+    if((region->base < 0x100000) || (((uint64_t)region->base + region->size) > 0xE00000)) { throw "memory map expansion outside of 0x100000-0xDFFFFF"; }
+    if(!this->memory_map.addRegion(region)) { throw "invalid memory map expansion region"; }
+    this->expansion.push_back(*region);
   }
-  fclose(rom_file);
+  this->memory_map.compile();
+  this->ram          = this->memory_map.ramPointer(0x000000);
+  this->ram_modified = true;
 
   this->irqMode = moira::IrqMode::IRQ_USER;
   this->interrupt_controller = new InterruptController();
   this->duart = new Duart68681();
   this->interrupt_controller->sourceAdd(this->duart, 4); // DUAIRQ == IRQ4
+
+  this->clock                   = 0;
+  this->delay_loop_elision      = true;
+  this->serial_timing           = false;
+  this->turbo_upload            = false;
+  this->spi_routines_set        = false;
+  for(uint32_t index=0; index<ROSCO_M68K_SPI_ROUTINES; ++index) { this->spi_routines[index] = { ROSCO_M68K_SPI_NONE, 0, 0, 0, 0, 0, 0 }; }
+  this->spi_measure_routine     = 0;
+  this->spi_measure_return      = 0;
+  this->spi_measure_bytes       = 0;
+  this->spi_measure_stack       = ROSCO_M68K_SPI_NONE;
+  this->spi_measure_clock       = 0;
+  this->spi_measure_instruction = 0;
+  this->spi_measure_sr          = 0;
+  this->spi_measure_ipl         = 0;
+  this->spi_measure_disturbed   = false;
+  this->trace_recorder          = NULL;
+  this->trace_recording         = false;
+  this->input_record            = NULL;
+  this->input_replay            = NULL;
+  this->input_instruction_base  = 0;
+  this->input_time_logged       = false;
+  this->input_time              = 0;
+  this->replay_event_next       = 0;
+  this->replay_time_next        = 0;
+  this->replay_due              = UINT64_MAX;
+  this->replay_finished         = false;
+  this->replay_diverged         = false;
+  this->delay_loop_pc           = DELAY_LOOP_NONE;
+  this->delay_loop_clock        = 0;
+  this->delay_loop_instruction  = 0;
+  this->instruction_count       = 0;
 }
 
 RoscoM68K::~RoscoM68K() {
-  if(this->ram) { free(this->ram); }
-  if(this->rom) { free(this->rom); }
+  if(this->rom_image_owned) { RomImage::release(this->rom_image_owned); }
   delete this->interrupt_controller;
   delete this->duart;
 }
 
 void RoscoM68K::reset() {
+  if(this->input_record) { this->inputLog(INPUT_LOG_RESET); }
   this->setModel(moira::Model::M68010);
   this->interrupt_controller->reset();
 
   // Moira will load up the stack and reset vectors from read* functions during a reset call
   // Rosco swaps ROM for RAM during the first four cycles
-  // so, we'll just swap it around the reset
-  uint8_t* swapped_ram = this->ram;
-  this->ram = this->rom;
+  // so, we'll just swap it in around the reset (the vectors are all in the first page)
+  const uint8_t* swapped_page = this->memory_map.pages[0].read;
+  this->memory_map.pages[0].read = this->rom;
   moira::Moira::reset();
-  this->ram = swapped_ram;
+  this->memory_map.pages[0].read = swapped_page;
+
+  this->delay_loop_pc           = DELAY_LOOP_NONE;
+  this->input_instruction_base += this->instruction_count;
+  this->instruction_count       = 0;
+  this->spi_measure_stack       = ROSCO_M68K_SPI_NONE;
+  if(this->trace_recorder) { this->trace_recorder->begin(this->reg.pc, this->reg.r, this->getSR(), this->clock); }
+}
+
+RoscoM68K* RoscoM68K::clone() {
+  RoscoM68K* copy = new RoscoM68K(this->rom_image, this->expansion.data(), (uint32_t)this->expansion.size());
+  copy->rom_image_owned = RomImage::acquire(this->rom_image);
+
+  copy->memory_map.compileClone(&(this->memory_map), this->ram_modified);
+  copy->ram          = copy->memory_map.ramPointer(0x000000);
+  copy->ram_modified = false;
+  this->ram_modified = false;
+
+  // processor; debugger state (and any trace recorder) stays behind, so drop anything that would consult it
+  copy->setModel(this->model);
+  copy->irqMode   = this->irqMode;
+  copy->flags     = this->flags & ~(CPU_LOG_INSTRUCTION | CPU_CHECK_BP | CPU_CHECK_WP | CPU_CHECK_CP);
+  copy->clock     = this->clock;
+  copy->reg       = this->reg;
+  copy->queue     = this->queue;
+  copy->mmu       = this->mmu;
+  copy->ipl       = this->ipl;
+  copy->fcl       = this->fcl;
+  copy->fcSource  = this->fcSource;
+  copy->exception = this->exception;
+  copy->cp        = this->cp;
+
+  copy->serial_timing           = this->serial_timing;
+  copy->turbo_upload            = this->turbo_upload;
+  copy->spi_routines_set        = this->spi_routines_set;
+  for(uint32_t index=0; index<ROSCO_M68K_SPI_ROUTINES; ++index) { copy->spi_routines[index] = this->spi_routines[index]; }
+  copy->spi_measure_routine     = this->spi_measure_routine;
+  copy->spi_measure_return      = this->spi_measure_return;
+  copy->spi_measure_bytes       = this->spi_measure_bytes;
+  copy->spi_measure_stack       = this->spi_measure_stack;
+  copy->spi_measure_clock       = this->spi_measure_clock;
+  copy->spi_measure_instruction = this->spi_measure_instruction;
+  copy->spi_measure_sr          = this->spi_measure_sr;
+  copy->spi_measure_ipl         = this->spi_measure_ipl;
+  copy->spi_measure_disturbed   = this->spi_measure_disturbed;
+  copy->delay_loop_elision      = this->delay_loop_elision;
+  copy->delay_loop_pc           = this->delay_loop_pc;
+  copy->delay_loop_clock        = this->delay_loop_clock;
+  copy->delay_loop_instruction  = this->delay_loop_instruction;
+  copy->instruction_count       = this->instruction_count;
+
+  // peripherals
+  copy->duart->copyState(this->duart);
+
+  return copy;
 }
 
 void RoscoM68K::getRegisters(m68k_registers* registers) {
@@ -69,54 +200,573 @@ void RoscoM68K::getRegisters(m68k_registers* registers) {
 }
 
 void RoscoM68K::run(uint32_t cycle_count) {
+  // recording or replaying inputs: the upload and SPI fast paths stop wherever the slice does, so they stand aside
+  bool input_logged = this->input_record || this->input_replay;
+  if(this->input_record) { this->inputAdmit(); }
+
   while(cycle_count) {
+    uint32_t budget = cycle_count; // instructions that may go by before anything else has to be looked at
+    if(this->input_replay) {
+      if(this->inputPosition() >= this->replay_due) { this->inputReplay(); }
+      if(this->replay_finished) { break; }
+      uint64_t due = this->replay_due - this->inputPosition();
+      if(due < budget) { budget = (uint32_t)due; }
+    }
+    if(this->serial_timing) { this->duart->setClock(this->clock); }
     this->setIPL(this->interrupt_controller->mpuPollInterrupt());
+    if(this->trace_recorder) {
+      this->traceStep();
+      ++this->instruction_count;
+      --cycle_count;
+      continue;
+    }
+    if(this->delay_loop_elision) {
+      uint32_t elided = this->elideDelayLoop(budget);
+      cycle_count -= elided;
+      if(!cycle_count) { break; }
+      if(elided && this->input_replay) { continue; } // may have stopped at the next event
+    }
+    if(input_logged) {
+      this->execute();
+      ++this->instruction_count;
+      --cycle_count;
+      continue;
+    }
+    if(this->turbo_upload && (this->queue.ird == loader_read_loop[0])) {
+      cycle_count -= this->turboUpload(cycle_count);
+      if(!cycle_count) { break; }
+    }
+    if(this->spi_routines_set) {
+      cycle_count -= this->accelerateSpi(cycle_count);
+      if(!cycle_count) { break; }
+    }
     this->execute();
+    ++this->instruction_count;
     --cycle_count;
   }
+  this->duart->serialPortFlush();
 }
 
-uint8_t RoscoM68K::read8(uint32_t address) {
-  if(address < 0x100000) { return this->ram[address]; }            // On-board RAM ( 1 MiB)
-  if(address < 0xE00000) { return 0x00; }                          // empty space  (13 MiB)
-  if(address < 0xF00000) { return this->rom[address - 0xE00000]; } // On-board ROM ( 1 MiB)
-  if(address < 0xFFFFFF) {                                         // I/O Space    ( 1 MiB)
-    if(address < 0xF00020) {
-      if(address & 1) {
-        // FF_00_00-FF_00_20 @ odd == DUART
-        address = ((address - 0xF00000) >> 1) & 0xFF;
-        return this->duart->busRead((uint8_t)address);
+void RoscoM68K::setSerialTiming(bool baud_accurate) {
+  this->serial_timing = baud_accurate;
+  this->duart->setClock(this->clock);
+  this->duart->setSerialTiming(baud_accurate, ROSCO_M68K_CLOCK_HZ);
+}
+
+void RoscoM68K::setDelayLoopElision(bool enabled) {
+  this->delay_loop_elision = enabled;
+  this->delay_loop_pc      = DELAY_LOOP_NONE;
+}
+
+void RoscoM68K::setTurboUpload(bool enabled) {
+  this->turbo_upload = enabled;
+}
+
+void RoscoM68K::setSpiRoutine(rosco_m68k_spi_routine routine, uint32_t address) {
+  if(routine >= ROSCO_M68K_SPI_ROUTINES) { return; }
+  this->spi_routines[routine] = { address, 0, 0, 0, 0, 0, 0 };
+  if(this->spi_measure_routine == routine) { this->spi_measure_stack = ROSCO_M68K_SPI_NONE; }
+  this->spi_routines_set = false;
+  for(uint32_t index=0; index<ROSCO_M68K_SPI_ROUTINES; ++index) {
+    if(this->spi_routines[index].address != ROSCO_M68K_SPI_NONE) { this->spi_routines_set = true; }
+  }
+}
+
+void RoscoM68K::setTraceRecorder(TraceRecorder* recorder) {
+  this->trace_recorder = recorder;
+  this->delay_loop_pc  = DELAY_LOOP_NONE;
+  if(recorder) { recorder->begin(this->reg.pc, this->reg.r, this->getSR(), this->clock); }
+}
+
+void RoscoM68K::traceStep() {
+  // a stopped (or halted) processor only waits; the cycles it spends show up in the next record
+  if(this->flags & (CPU_IS_HALTED | CPU_IS_STOPPED)) {
+    this->execute();
+    return;
+  }
+
+  uint32_t pc     = this->reg.pc;
+  uint16_t opcode = this->queue.ird;
+  this->trace_recording = true;
+  this->execute();
+  this->trace_recording = false;
+  this->trace_recorder->record(pc, opcode, this->clock, this->reg.r, this->getSR());
+}
+
+void RoscoM68K::recordInputs(InputLog* log) {
+  if(this->input_record && (this->input_record != log)) { this->inputLog(INPUT_LOG_END); }
+  this->input_record      = log;
+  this->input_time_logged = false;
+  this->delay_loop_pc     = DELAY_LOOP_NONE;
+  this->duart->setSerialGate(this->input_record || this->input_replay);
+  this->duart->setInputPortObserver(log ? RoscoM68K::inputPortChanged : NULL, this);
+  this->duart->setTimeSource((this->input_record || this->input_replay) ? RoscoM68K::inputTime : NULL, this);
+}
+
+void RoscoM68K::replayInputs(InputLog* log) {
+  this->input_replay = log;
+  this->replay_events.clear();
+  this->replay_times.clear();
+  this->replay_event_next = 0;
+  this->replay_time_next  = 0;
+  this->replay_finished   = false;
+  this->replay_diverged   = false;
+  this->input_time        = 0;
+  this->delay_loop_pc     = DELAY_LOOP_NONE;
+  if(log) {
+    const std::vector<input_log_event>& events = log->events();
+    for(uint32_t index=0; index<events.size(); ++index) {
+      if(events[index].kind == INPUT_LOG_TIME) { this->replay_times.push_back(index);  }
+      else                                     { this->replay_events.push_back(index); }
+    }
+  }
+  this->inputReplayDue();
+  this->duart->setSerialGate(this->input_record || this->input_replay);
+  this->duart->setTimeSource((this->input_record || this->input_replay) ? RoscoM68K::inputTime : NULL, this);
+}
+
+bool RoscoM68K::replayFinished(bool* diverged) {
+  if(diverged) { *diverged = this->replay_diverged; }
+  return this->replay_finished;
+}
+
+uint64_t RoscoM68K::inputPosition() {
+  return this->input_instruction_base + this->instruction_count;
+}
+
+void RoscoM68K::inputLog(input_log_kind kind, int64_t value, uint8_t port, const uint8_t* data, uint32_t length) {
+  input_log_event event;
+  event.instruction = this->inputPosition();
+  event.clock       = this->clock;
+  event.kind        = kind;
+  event.port        = port;
+  event.value       = value;
+  if(length) { event.data.assign(data, data + length); }
+  this->input_record->add(&event);
+}
+
+void RoscoM68K::inputAdmit() {
+  uint8_t admitted[INPUT_ADMIT_CHUNK];
+  for(uint8_t port=DUART_68681_PORT_A; port<=DUART_68681_PORT_B; ++port) {
+    uint32_t length;
+    while((length = this->duart->serialPortAdmit(port, admitted, INPUT_ADMIT_CHUNK))) {
+      this->inputLog(INPUT_LOG_SERIAL, 0, port, admitted, length);
+      if(length < INPUT_ADMIT_CHUNK) { break; }
+    }
+  }
+}
+
+void RoscoM68K::inputReplay() {
+  const std::vector<input_log_event>& events = this->input_replay->events();
+  uint64_t position = this->inputPosition();
+  while(this->replay_event_next < this->replay_events.size()) {
+    const input_log_event* event = &(events[this->replay_events[this->replay_event_next]]);
+    if(event->instruction > position) { break; }
+    if((event->instruction < position) || (event->clock != this->clock)) {
+      this->replay_diverged = true;
+      this->replay_finished = true;
+      return;
+    }
+    ++this->replay_event_next;
+    switch(event->kind) {
+      case INPUT_LOG_SERIAL: {
+        uint32_t length = (uint32_t)event->data.size();
+        if(this->duart->serialPortInject(event->port, event->data.data(), length) < length) { this->replay_diverged = true; }
+        break;
       }
+      case INPUT_LOG_INPUT_PORT: this->duart->setInputPort((uint8_t)event->value); break;
+      case INPUT_LOG_RESET:      this->reset(); break; // position carries on, through input_instruction_base
+      case INPUT_LOG_END:        this->replay_finished = true; break;
+      default: break;
+    }
+    if(this->replay_finished || this->replay_diverged) {
+      this->replay_finished = true;
+      return;
     }
-    return 0x00;
   }
-  return 0x00;
+  this->inputReplayDue();
+}
+
+void RoscoM68K::inputReplayDue() {
+  // (time events are taken as the timer reads them; they don't need the machine stopped)
+  this->replay_due = UINT64_MAX;
+  if(this->input_replay && (this->replay_event_next < this->replay_events.size())) {
+    this->replay_due = this->input_replay->events()[this->replay_events[this->replay_event_next]].instruction;
+  }
+}
+
+time_t RoscoM68K::inputTime(void* callback_data) {
+  RoscoM68K* rosco = (RoscoM68K*)callback_data;
+  if(rosco->input_replay) {
+    // each recorded time was logged by the read that first saw it, which comes again at the same instruction and clock
+    if(rosco->replay_time_next < rosco->replay_times.size()) {
+      const input_log_event* event = &(rosco->input_replay->events()[rosco->replay_times[rosco->replay_time_next]]);
+      uint64_t position = rosco->inputPosition();
+      if((event->instruction < position) || ((event->instruction == position) && (event->clock <= rosco->clock))) {
+        rosco->input_time = (time_t)event->value;
+        ++rosco->replay_time_next;
+      }
+    }
+    return rosco->input_time;
+  }
+
+  time_t now = time(NULL);
+  if(rosco->input_record && (!rosco->input_time_logged || (now != rosco->input_time))) {
+    rosco->inputLog(INPUT_LOG_TIME, (int64_t)now);
+    rosco->input_time_logged = true;
+  }
+  rosco->input_time = now;
+  return now;
+}
+
+void RoscoM68K::inputPortChanged(uint8_t value, void* callback_data) {
+  RoscoM68K* rosco = (RoscoM68K*)callback_data;
+  if(rosco->input_record) { rosco->inputLog(INPUT_LOG_INPUT_PORT, value); }
+}
+
+bool RoscoM68K::isLoaderReadLoop(uint32_t pc) {
+  if(pc >= 0xF00000) { return false; } // I/O space; reads have side effects
+  if(this->queue.irc != loader_read_loop[1]) { return false; }
+  for(uint32_t index=2; index<LOADER_READ_LOOP_WORDS; ++index) {
+    if(this->read16(pc + (index * 2)) != loader_read_loop[index]) { return false; }
+  }
+  return true;
+}
+
+uint32_t RoscoM68K::turboUpload(uint32_t instruction_budget) {
+  uint32_t remaining = this->reg.d[0];
+  if(!remaining || (instruction_budget < LOADER_READ_LOOP_INSTRUCTIONS)) { return 0; }
+  if(!this->isLoaderReadLoop(this->reg.pc)) { return 0; }
+
+  // same restrictions as delay-loop elision: nothing may need to see the individual instructions
+  const int observed = CPU_IS_HALTED | CPU_IS_STOPPED | CPU_IS_LOOPING | CPU_LOG_INSTRUCTION |
+                       CPU_TRACE_EXCEPTION | CPU_TRACE_FLAG | CPU_CHECK_BP | CPU_CHECK_WP;
+  if(this->flags & observed) { return 0; }
+  if((this->ipl > this->reg.sr.ipl) || (this->ipl == 7)) { return 0; }
+
+  uint32_t budget = instruction_budget / LOADER_READ_LOOP_INSTRUCTIONS;
+  if(remaining > budget) { remaining = budget; }
+
+  // each byte goes over the bus, just as move.b D1,(A0)+ would write it
+  uint8_t  chunk[LOADER_READ_CHUNK];
+  uint32_t address = this->reg.a[0];
+  uint32_t copied  = 0;
+  while(copied < remaining) {
+    uint32_t wanted = remaining - copied;
+    if(wanted > LOADER_READ_CHUNK) { wanted = LOADER_READ_CHUNK; }
+    uint32_t taken = this->duart->serialPortTake(DUART_68681_PORT_A, chunk, wanted);
+    for(uint32_t index=0; index<taken; ++index) { this->write8(address++, chunk[index]); }
+    if(taken) { this->reg.d[1] = (this->reg.d[1] & 0xFFFFFF00) | chunk[taken - 1]; }
+    copied += taken;
+    if(taken < wanted) { break; } // caught up with the host; the rest waits in the loop, as usual
+  }
+  if(!copied) { return 0; }
+
+  // registers and flags as left by the last SUBQ.L #1,D0 (the BRA.S back to the head doesn't touch them)
+  uint32_t previous = this->reg.d[0] - (copied - 1);
+  uint32_t result   = previous - 1;
+  this->reg.a[0] = address;
+  this->reg.d[0] = result;
+  this->reg.sr.x = false;
+  this->reg.sr.c = false;
+  this->reg.sr.z = (result == 0);
+  this->reg.sr.n = (result & 0x80000000) != 0;
+  this->reg.sr.v = (previous == 0x80000000);
+
+  uint32_t instructions = copied * LOADER_READ_LOOP_INSTRUCTIONS;
+  this->instruction_count += instructions;
+  this->delay_loop_pc      = DELAY_LOOP_NONE;
+  return instructions;
+}
+
+uint32_t RoscoM68K::accelerateSpi(uint32_t instruction_budget) {
+  uint32_t pc = this->reg.pc;
+  uint32_t sp = this->reg.a[7];
+
+  // back from the call being measured? it's kept unless an exception or interrupt level change could have added to it
+  if((this->spi_measure_stack == (sp - 4)) && (pc == this->spi_measure_return)) {
+    this->spi_measure_stack = ROSCO_M68K_SPI_NONE;
+    if(this->spi_measure_disturbed || (this->ipl != this->spi_measure_ipl) || ((this->getSR() & 0xFF00) != this->spi_measure_sr)) { return 0; }
+    spi_routine_cost* measured = &(this->spi_routines[this->spi_measure_routine]);
+    uint32_t bytes        = this->spi_measure_bytes;
+    int64_t  cycles       = this->clock - this->spi_measure_clock;
+    uint64_t instructions = this->instruction_count - this->spi_measure_instruction;
+    if(!instructions) { return 0; }
+    if(!measured->bytes) {
+      measured->bytes        = bytes;
+      measured->cycles       = cycles;
+      measured->instructions = instructions;
+    } else if(bytes != measured->bytes) {
+      // a second length tells the cost per byte from the cost per call: the differences between the two calls are all per byte
+      bool     longer            = bytes > measured->bytes;
+      uint32_t step_bytes        = longer ? (bytes - measured->bytes) : (measured->bytes - bytes);
+      int64_t  step_cycles       = longer ? (cycles - measured->cycles) : (measured->cycles - cycles);
+      int64_t  step_instructions = longer ? (int64_t)(instructions - measured->instructions) : (int64_t)(measured->instructions - instructions);
+      // (a call can't cost less than nothing; if the routine's cost isn't linear in its length, the lengths go on being timed)
+      if((step_cycles > 0) && (step_instructions > 0) &&
+         ((step_cycles * measured->bytes) <= (measured->cycles * step_bytes)) &&
+         (((uint64_t)step_instructions * measured->bytes) <= (measured->instructions * step_bytes))) {
+        measured->step_bytes        = step_bytes;
+        measured->step_cycles       = step_cycles;
+        measured->step_instructions = (uint64_t)step_instructions;
+      }
+    }
+    return 0;
+  }
+
+  uint32_t routine = 0;
+  while((routine < ROSCO_M68K_SPI_ROUTINES) && (this->spi_routines[routine].address != pc)) { ++routine; }
+  if(routine == ROSCO_M68K_SPI_ROUTINES) { return 0; }
+  spi_routine_cost* cost = &(this->spi_routines[routine]);
+
+  // same restrictions as the other fast paths: nothing may need to see the individual instructions
+  const int observed = CPU_IS_HALTED | CPU_IS_STOPPED | CPU_IS_LOOPING | CPU_LOG_INSTRUCTION |
+                       CPU_TRACE_EXCEPTION | CPU_TRACE_FLAG | CPU_CHECK_BP | CPU_CHECK_WP;
+  if(this->flags & observed) { return 0; }
+  if((this->ipl > this->reg.sr.ipl) || (this->ipl == 7)) { return 0; }
+
+  // arguments, as pushed by the caller (each one a long word; bytes in the low end)
+  uint32_t send_address    = ROSCO_M68K_SPI_NONE;
+  uint32_t receive_address = ROSCO_M68K_SPI_NONE;
+  uint32_t length          = 1;
+  uint32_t length_argument = 0;
+  uint8_t  send_byte       = 0xFF;
+  switch(routine) {
+    case ROSCO_M68K_SPI_TRANSFER_BYTE:   send_byte = this->read8(sp + 7); break;
+    case ROSCO_M68K_SPI_READ_BUFFER:     receive_address = this->read32(sp + 4); length_argument = sp + 8; break;
+    case ROSCO_M68K_SPI_WRITE_BUFFER:    send_address    = this->read32(sp + 4); length_argument = sp + 8; break;
+    case ROSCO_M68K_SPI_TRANSFER_BUFFER: send_address    = this->read32(sp + 4); receive_address = this->read32(sp + 8); length_argument = sp + 12; break;
+  }
+  if(length_argument) { length = this->read32(length_argument); }
+
+  // until its cost is known, a routine runs the slow way, and that call is timed from entry to return;
+  // known from calls of one length only, it's known for that length alone
+  if(!cost->bytes || (!cost->step_bytes && (length != cost->bytes))) {
+    if(length && (this->spi_measure_stack == ROSCO_M68K_SPI_NONE)) {
+      this->spi_measure_routine     = routine;
+      this->spi_measure_return      = this->read32(sp);
+      this->spi_measure_stack       = sp;
+      this->spi_measure_bytes       = length;
+      this->spi_measure_clock       = this->clock;
+      this->spi_measure_instruction = this->instruction_count;
+      this->spi_measure_sr          = this->getSR() & 0xFF00;
+      this->spi_measure_ipl         = this->ipl;
+      this->spi_measure_disturbed   = false;
+    }
+    return 0;
+  }
+
+  // each byte is charged its share, and the call's own cost (entry, arguments, return) is charged as it returns;
+  // from one length alone, that length's whole cost is shared out among its bytes
+  uint64_t per_bytes         = cost->step_bytes ? cost->step_bytes        : cost->bytes;
+  int64_t  per_cycles        = cost->step_bytes ? cost->step_cycles       : cost->cycles;
+  uint64_t per_instructions  = cost->step_bytes ? cost->step_instructions : cost->instructions;
+  int64_t  call_cycles       = cost->cycles       - ((per_cycles       * cost->bytes) / (int64_t)per_bytes);
+  uint64_t call_instructions = cost->instructions - ((per_instructions * cost->bytes) / per_bytes);
+  if(instruction_budget <= call_instructions) { return 0; }
+
+  // as many bytes as the budget allows; a buffer left part done has its arguments moved on, and is picked up again here
+  uint64_t budget = ((instruction_budget - call_instructions) * per_bytes) / per_instructions;
+  uint32_t count  = (length < budget) ? length : (uint32_t)budget;
+  if(count > SPI_ROUTINE_CHUNK) { count = SPI_ROUTINE_CHUNK; }
+  if(!count && length) { return 0; }
+
+  uint8_t send[SPI_ROUTINE_CHUNK];
+  uint8_t receive[SPI_ROUTINE_CHUNK];
+  if(send_address != ROSCO_M68K_SPI_NONE) {
+    for(uint32_t index=0; index<count; ++index) { send[index] = this->read8(send_address + index); }
+  } else {
+    memset(send, send_byte, count);
+  }
+  if(!this->duart->spiTransfer(send, receive, count)) { return 0; }
+  if(receive_address != ROSCO_M68K_SPI_NONE) {
+    for(uint32_t index=0; index<count; ++index) { this->write8(receive_address + index, receive[index]); }
+  }
+
+  int64_t  cycles       = (per_cycles * count) / (int64_t)per_bytes;
+  uint32_t instructions = (uint32_t)((per_instructions * count) / per_bytes);
+  if(count < length) {
+    if(send_address    != ROSCO_M68K_SPI_NONE) { this->write32(sp + 4, send_address + count); }
+    if(receive_address != ROSCO_M68K_SPI_NONE) { this->write32((routine == ROSCO_M68K_SPI_TRANSFER_BUFFER) ? (sp + 8) : (sp + 4), receive_address + count); }
+    this->write32(length_argument, length - count);
+  } else {
+    // RTS
+    if(routine == ROSCO_M68K_SPI_TRANSFER_BYTE) { this->reg.d[0] = (this->reg.d[0] & 0xFFFFFF00) | receive[0]; }
+    uint32_t return_address = this->read32(sp);
+    this->reg.a[7] = sp + 4;
+    int64_t clock = this->clock;
+    this->debugger.jump(return_address);
+    this->clock = clock;
+    cycles       += call_cycles;
+    instructions += (uint32_t)call_instructions;
+  }
+  if(!instructions) { instructions = 1; }
+  this->clock             += cycles;
+  this->instruction_count += instructions;
+  this->delay_loop_pc      = DELAY_LOOP_NONE;
+  return instructions;
+}
+
+uint32_t RoscoM68K::read32(uint32_t address) {
+  return (((uint32_t)this->read16(address)) << 16) | this->read16(address + 2);
+}
+
+void RoscoM68K::write32(uint32_t address, uint32_t value) {
+  this->write16(address,     (uint16_t)(value >> 16));
+  this->write16(address + 2, (uint16_t)(value & 0xFFFF));
+}
+
+bool RoscoM68K::hasExited() {
+  if(this->flags & CPU_IS_HALTED) { return true; }
+  return (this->flags & CPU_IS_STOPPED) && (this->reg.sr.ipl == 7) && (this->ipl < 7);
+}
+
+uint8_t RoscoM68K::delayLoopLength(uint32_t pc) {
+  // only look at code in RAM or ROM; reading from I/O space has side effects
+  if(pc >= 0xF00000) { return 0; }
+
+  uint16_t opcode = this->queue.ird;
+  uint16_t next   = this->queue.irc;
+
+  // DBcc Dn,* (branches to itself)
+  if(((opcode & 0xF0F8) == 0x50C8) && (next == 0xFFFE)) { return 1; }
+
+  // SUBQ.(b|w|l) #n,Dn ; BNE.(s|w) back to the SUBQ
+  if((opcode & 0xF138) == 0x5100) {
+    if((opcode & 0x00C0) == 0x00C0) { return 0; } // Scc/DBcc/TRAPcc
+    if(next == 0x66FC) { return 2; }
+    if((next == 0x6600) && (this->read16(pc + 4) == 0xFFFC)) { return 2; }
+  }
+
+  return 0;
+}
+
+uint32_t RoscoM68K::elideDelayLoop(uint32_t instruction_budget) {
+  uint32_t pc = this->reg.pc;
+  uint8_t  loop_length = this->delayLoopLength(pc);
+  if(!loop_length) {
+    // a SUBQ/BNE loop's own branch is part of the iteration being measured
+    if(pc != (this->delay_loop_pc + 2)) { this->delay_loop_pc = DELAY_LOOP_NONE; }
+    return 0;
+  }
+
+  // a loop is only elided after one full iteration has been seen, uninterrupted, and back at its head;
+  // the clock delta of that iteration is exactly what every further (branch-taken) iteration costs
+  bool measured = (this->delay_loop_pc == pc) && ((this->instruction_count - this->delay_loop_instruction) == loop_length);
+  int64_t iteration_cycles = this->clock - this->delay_loop_clock;
+  this->delay_loop_pc          = pc;
+  this->delay_loop_clock       = this->clock;
+  this->delay_loop_instruction = this->instruction_count;
+  if(!measured) { return 0; }
+
+  // anything that needs to observe individual instructions, or a pending interrupt, runs the slow way
+  const int observed = CPU_IS_HALTED | CPU_IS_STOPPED | CPU_IS_LOOPING | CPU_LOG_INSTRUCTION |
+                       CPU_TRACE_EXCEPTION | CPU_TRACE_FLAG | CPU_CHECK_BP;
+  if(this->flags & observed) { return 0; }
+  if((this->ipl > this->reg.sr.ipl) || (this->ipl == 7)) { return 0; }
+
+  // never run past the caller's budget; device state is polled again once we return,
+  // so nothing pending is skipped over
+  uint32_t iterations_budget = instruction_budget / loop_length;
+  if(this->serial_timing && (iteration_cycles > 0)) {
+    // nor past the next serial event, which the guest may be waiting on
+    int64_t event_cycles = this->duart->nextEvent() - this->clock;
+    if(event_cycles <= 0) { return 0; }
+    if((event_cycles / iteration_cycles) < iterations_budget) { iterations_budget = (uint32_t)(event_cycles / iteration_cycles); }
+  }
+  uint8_t  register_index = this->queue.ird & 0x07;
+  uint32_t iterations;
+
+  if(loop_length == 1) {
+    // DBcc: the condition can't change inside the loop (DBcc doesn't touch flags), so it was already false;
+    // every iteration with Dn.w != 0 branches back here, the one with Dn.w == 0 falls through
+    uint32_t counter = this->reg.d[register_index] & 0xFFFF;
+    iterations = (counter < iterations_budget) ? counter : iterations_budget;
+    if(!iterations) { return 0; }
+    this->reg.d[register_index] = (this->reg.d[register_index] & 0xFFFF0000) | (counter - iterations);
+  } else {
+    // SUBQ/BNE: elide every iteration except the last (which sets Z, and falls through)
+    uint32_t quick = (this->queue.ird >> 9) & 0x07;
+    if(!quick) { quick = 8; }
+    uint32_t size_mask, sign_bit;
+    switch(this->queue.ird & 0x00C0) {
+      case 0x0000: size_mask = 0x000000FF; sign_bit = 0x00000080; break;
+      case 0x0040: size_mask = 0x0000FFFF; sign_bit = 0x00008000; break;
+      default:     size_mask = 0xFFFFFFFF; sign_bit = 0x80000000; break;
+    }
+    uint32_t counter = this->reg.d[register_index] & size_mask;
+    if(!counter || (counter % quick)) { return 0; } // would wrap around; leave it to the interpreter
+    uint32_t remaining = (counter / quick) - 1;
+    iterations = (remaining < iterations_budget) ? remaining : iterations_budget;
+    if(!iterations) { return 0; }
+
+    uint32_t result   = counter - (iterations * quick);
+    uint32_t previous = result + quick;
+    this->reg.d[register_index] = (this->reg.d[register_index] & ~size_mask) | result;
+    // flags as left by the last elided SUBQ (no borrow, non-zero result)
+    this->reg.sr.x = false;
+    this->reg.sr.c = false;
+    this->reg.sr.z = false;
+    this->reg.sr.n = (result & sign_bit) != 0;
+    this->reg.sr.v = (((previous ^ quick) & (previous ^ result)) & sign_bit) != 0;
+  }
+
+  uint32_t instructions = iterations * loop_length;
+  this->clock                  += iteration_cycles * iterations;
+  this->instruction_count      += instructions;
+  this->delay_loop_clock        = this->clock;
+  this->delay_loop_instruction  = this->instruction_count;
+  return instructions;
+}
+
+uint8_t RoscoM68K::read8(uint32_t address) {
+  const memory_page* page = &(this->memory_map.pages[(address >> MEMORY_MAP_PAGE_BITS) & (MEMORY_MAP_PAGE_COUNT - 1)]);
+  uint8_t value;
+  if(page->read) {
+    value = page->read[address & (MEMORY_MAP_PAGE_SIZE - 1)];
+  } else {
+    value = page->device_read((address & 0xFFFFFF) - page->device_base, page->callback_data);
+  }
+  if(this->trace_recording && (this->fcl == moira::FC_USER_DATA)) { this->trace_recorder->access(0, address, value); }
+  return value;
 }
 
 uint16_t RoscoM68K::read16(uint32_t address) {
+  const memory_page* page = &(this->memory_map.pages[(address >> MEMORY_MAP_PAGE_BITS) & (MEMORY_MAP_PAGE_COUNT - 1)]);
+  uint32_t offset = address & (MEMORY_MAP_PAGE_SIZE - 1);
+  if(page->read && (offset != (MEMORY_MAP_PAGE_SIZE - 1))) {
+    uint16_t value = (((uint16_t)page->read[offset]) << 8) | page->read[offset + 1];
+    if(this->trace_recording && (this->fcl == moira::FC_USER_DATA)) { this->trace_recorder->access(TRACE_ACCESS_WORD, address, value); }
+    return value;
+  }
+
   uint16_t byte_high = this->read8(address);
   uint16_t byte_low  = this->read8(address + 1);
   return (byte_high << 8) | byte_low;
 }
 
 void RoscoM68K::write8(uint32_t address, uint8_t value) {
-  if(address < 0x100000) { this->ram[address] = value; } // On-board RAM ( 1 MiB)
-  if(address < 0xE00000) { return; }                     // empty space  (13 MiB)
-  if(address < 0xF00000) { return; }                     // On-board ROM ( 1 MiB)
-  if(address < 0xFFFFFF) {                               // I/O Space    ( 1 MiB)
-    if(address < 0xF00020) {
-      if(address & 1) {
-        // FF_00_00-FF_00_20 @ odd == DUART
-        address = ((address - 0xF00000) >> 1) & 0xFF;
-        this->duart->busWrite((uint8_t)address, value);
-      }
-    }
+  memory_page* page = &(this->memory_map.pages[(address >> MEMORY_MAP_PAGE_BITS) & (MEMORY_MAP_PAGE_COUNT - 1)]);
+  if(this->trace_recording && (this->fcl == moira::FC_USER_DATA)) { this->trace_recorder->access(TRACE_ACCESS_WRITE, address, value); }
+  if(page->write) {
+    page->write[address & (MEMORY_MAP_PAGE_SIZE - 1)] = value;
+    this->ram_modified = true;
     return;
   }
-  return;
+  if(page->device_write) { page->device_write((address & 0xFFFFFF) - page->device_base, value, page->callback_data); }
 }
 
 void RoscoM68K::write16(uint32_t address, uint16_t value) {
+  memory_page* page = &(this->memory_map.pages[(address >> MEMORY_MAP_PAGE_BITS) & (MEMORY_MAP_PAGE_COUNT - 1)]);
+  uint32_t offset = address & (MEMORY_MAP_PAGE_SIZE - 1);
+  if(page->write && (offset != (MEMORY_MAP_PAGE_SIZE - 1))) {
+    if(this->trace_recording && (this->fcl == moira::FC_USER_DATA)) { this->trace_recorder->access(TRACE_ACCESS_WRITE | TRACE_ACCESS_WORD, address, value); }
+    page->write[offset]     = (uint8_t)(value >> 8);
+    page->write[offset + 1] = (uint8_t)(value & 0xFF);
+    this->ram_modified = true;
+    return;
+  }
+
   uint8_t byte_high = (uint8_t)(value >> 8);
   uint8_t byte_low  = (uint8_t)(value & 0xFF);
   this->write8(address+0, byte_high);
@@ -127,9 +777,13 @@ uint16_t RoscoM68K::readIrqUserVector(uint8_t level) const {
   return (uint16_t)(this->interrupt_controller->mpuReadVector(level));
 }
 
+void RoscoM68K::signalJumpToVector(int number, uint32_t address) {
+  if(this->spi_measure_stack != ROSCO_M68K_SPI_NONE) { this->spi_measure_disturbed = true; }
+}
+
 void RoscoM68K::addressExtentsRam(uint32_t* lowest, uint32_t* highest) {
   if(lowest ) { *lowest  = 0x000000; }
-  if(highest) { *highest = 0x0FFFFF; }
+  if(highest) { *highest = this->memory_map.ramContiguousEnd(); }
 }
 
 void RoscoM68K::addressExtentsRom(uint32_t* lowest, uint32_t* highest) {
@@ -9,6 +9,25 @@ extern "C" {
 #include <moira/Moira.h>
 #include "interrupt_controller.hpp"
 #include "duart_68681.hpp"
+#include "rom_image.hpp"
+#include "memory_map.hpp"
+#include "trace_recorder.hpp"
+#include "input_log.hpp"
+
+#define ROSCO_M68K_CLOCK_HZ 10000000 // 10 MHz
+#define ROSCO_M68K_SPI_NONE 0xFFFFFFFF
+
+/**
+ * guest SPI routines (program/duart.c) that may be run on the host; each is a C function (arguments on the stack, result in D0)
+ **/
+typedef enum {
+  ROSCO_M68K_SPI_TRANSFER_BYTE,   // uint8_t duartSpi_transferByte(uint8_t send_byte)
+  ROSCO_M68K_SPI_READ_BUFFER,     // void duartSpi_readBuffer(uint8_t* receive_buffer, uint32_t length)
+  ROSCO_M68K_SPI_WRITE_BUFFER,    // void duartSpi_writeBuffer(uint8_t* send_buffer, uint32_t length)
+  ROSCO_M68K_SPI_TRANSFER_BUFFER, // void duartSpi_transferBuffer(uint8_t* send_buffer, uint8_t* receive_buffer, uint32_t length)
+  ROSCO_M68K_SPI_ROUTINES,
+} rosco_m68k_spi_routine;
+
 /**
  * structure for inspecting 68K registers
  **/
@@ -30,11 +49,30 @@ public:
   /**
    * Create a new rosco-m68k instance
    * 
-   * @param rom_path path to a file to load as ROM (limit 1 MiB)
+   * @param rom_path path to a file to map as ROM (limit 1 MiB); shared with other instances using the same file
+   * @param expansion regions to map into the expansion space (0x100000-0xDFFFFF), ex: more RAM; NULL for none
+   * @param expansion_count count of expansion regions
+   **/
+  RoscoM68K(const char* rom_path, const memory_region* expansion = NULL, uint32_t expansion_count = 0);
+  /**
+   * Create a new rosco-m68k instance, sharing an already loaded ROM
+   * 
+   * @param rom_image ROM to map; not owned, and must outlive this instance
+   * @param expansion regions to map into the expansion space (0x100000-0xDFFFFF), ex: more RAM; NULL for none
+   * @param expansion_count count of expansion regions
    **/
-  RoscoM68K(const char* rom_path);
+  RoscoM68K(RomImage* rom_image, const memory_region* expansion = NULL, uint32_t expansion_count = 0);
   ~RoscoM68K();
 
+  /**
+   * Create a copy of this rosco-m68k, in its current state
+   * RAM is shared copy-on-write, so clones (and this instance) only commit the pages they go on to write;
+   * debugger state, serial transmitters, trace recorders, and input logs are not copied; expansion devices are shared
+   * 
+   * @returns new rosco-m68k instance
+   **/
+  RoscoM68K* clone();
+
   /**
    * Copy current register values
    * 
@@ -49,11 +87,103 @@ public:
 
   /**
    * Run processor cycle(s)
+   * serial output buffered for bulk transmitters is handed over before returning
    * 
    * @param cycle_count count of processor cycles to run
    **/
   void run(uint32_t cycle_count);
 
+  /**
+   * Enable/disable delay-loop elision
+   * register-only countdown loops (DBcc Dn,* or SUBQ #n,Dn / BNE) are finished in a single step,
+   * with identical register, flag, and clock results; enabled by default
+   * 
+   * @param enabled whether delay loops should be elided
+   **/
+  void setDelayLoopElision(bool enabled);
+
+  /**
+   * Select serial timing mode
+   * instant (the default) moves characters as fast as the guest handles them;
+   * baud-accurate takes 10 bit times per character, at the programmed rate, on the emulated clock
+   * (delay-loop elision then stops short of each serial event)
+   * 
+   * @param baud_accurate whether to use baud-accurate serial timing
+   **/
+  void setSerialTiming(bool baud_accurate);
+
+  /**
+   * Enable/disable the program upload fast path
+   * while the boot loader sits in its serial read loop (TRAP #1: read D0 bytes from port A into (A0)+),
+   * whatever port A has already received is copied into memory in a single step, leaving the registers
+   * and flags as the loop would; the copy takes no emulated time, so clock counts differ from a byte-exact run.
+   * only applies with instant serial timing; disabled by default
+   * 
+   * @param enabled whether uploads should be fast-pathed
+   **/
+  void setTurboUpload(bool enabled);
+
+  /**
+   * Set the address of a guest SPI routine to run on the host
+   * when the processor arrives at the routine, its bytes are moved over the SPI bus in a single step
+   * (a whole block per call for the buffer routines), and it returns, leaving memory, D0, and the bus as the routine would;
+   * the clock is charged what the routine was measured to take: a cost per call, and a cost per byte, told apart by timing
+   * calls of two lengths (those calls run as usual, as does a call that took an exception or saw the interrupt level change;
+   * until a second length is timed, calls of the first length are charged per byte, and others run as usual).
+   * the routine must be called, not jumped into, and must follow the calling convention above
+   * 
+   * @param routine which routine
+   * @param address entry point (ex: from the program's symbols), or ROSCO_M68K_SPI_NONE to run it as usual
+   **/
+  void setSpiRoutine(rosco_m68k_spi_routine routine, uint32_t address);
+
+  /**
+   * Attach/detach an instruction trace recorder
+   * every instruction executed is recorded, with the registers it changed and the data it read and wrote
+   * (instruction fetches are left out); while attached, the fast paths above stand aside, so nothing goes unrecorded
+   * 
+   * @param recorder recorder to write to (not owned; detach before deleting it), or NULL to stop recording
+   **/
+  void setTraceRecorder(TraceRecorder* recorder);
+
+  /**
+   * Start/stop recording external inputs
+   * serial data (however it arrives: queued, bridged, or received directly) is held at the DUART until the start of a run() call,
+   * then let in and logged; input port changes, reset() calls, and the host time read by the counter/timer are logged as they happen.
+   * each event is logged at its instruction and clock, so replayInputs() can hand the guest the same inputs at the same points.
+   * while recording (or replaying), the upload and SPI fast paths stand aside, as where they stop depends on the run() slices;
+   * start recording, and replaying, from the same state (ex: straight after reset() and loading the same program)
+   * 
+   * @param log log to write to (not owned; stop recording before deleting it), or NULL to stop recording
+   **/
+  void recordInputs(InputLog* log);
+
+  /**
+   * Start/stop replaying recorded inputs
+   * received serial data, input port changes, and resets are taken from the log (live inputs are held back);
+   * the counter/timer reads the recorded host time
+   * 
+   * @param log log to replay (not owned; stop replaying before deleting it), or NULL to stop replaying
+   **/
+  void replayInputs(InputLog* log);
+
+  /**
+   * Check how replaying is going
+   * 
+   * @param diverged receives whether the machine left the recorded path (an event came due at a different clock); may be NULL
+   * @returns whether the replay is over: at the end of the recording, or diverged
+   **/
+  bool replayFinished(bool* diverged = NULL);
+
+  /**
+   * Check whether the processor has stopped for good
+   * that is: halted on a double fault, or executing STOP with all interrupts masked (STOP #$27xx);
+   * guest programs run without a monitor use the latter to exit, leaving their exit code in D0
+   * 
+   * @returns whether no further instructions will run (until reset)
+   **/
+  bool hasExited();
+
   /**
    * Get extents of RAM, in bus addresses
    * 
@@ -77,18 +207,93 @@ public:
   uint8_t busRead(uint32_t address);
 
   // internal state
-  uint8_t* ram;
-  uint8_t* rom;
+  uint8_t* ram; // NOTE: writes made directly (rather than over the bus) must be followed by setting ram_modified
+  bool ram_modified;
+  MemoryMap memory_map;
+  const uint8_t* rom;
   InterruptController* interrupt_controller;
   Duart68681* duart;
 
 protected:
+  void initialize(RomImage* rom_image, const memory_region* expansion, uint32_t expansion_count);
+  std::vector<memory_region> expansion;
+  RomImage* rom_image;
+  RomImage* rom_image_owned;
+
   // Moira overrides for bus accesses, and forward IRQ related things to our interrupt controller
   uint8_t  read8  (uint32_t address) override;
   uint16_t read16 (uint32_t address) override;
   void     write8 (uint32_t address, uint8_t value) override;
   void     write16(uint32_t address, uint16_t value) override;
   uint16_t readIrqUserVector(uint8_t level) const override;
+  void     signalJumpToVector(int number, uint32_t address) override;
+
+  // delay-loop elision
+  uint32_t elideDelayLoop(uint32_t instruction_budget);
+  uint8_t  delayLoopLength(uint32_t pc);
+  bool     delay_loop_elision;
+  uint32_t delay_loop_pc;           // head of the loop last seen (or DELAY_LOOP_NONE)
+  int64_t  delay_loop_clock;        // clock when last seen at loop head
+  uint64_t delay_loop_instruction;  // instruction count when last seen at loop head
+  uint64_t instruction_count;       // instructions executed since reset
+
+  bool     serial_timing; // baud-accurate; DUART needs the clock
+
+  // loader upload fast path
+  uint32_t turboUpload(uint32_t instruction_budget);
+  bool     isLoaderReadLoop(uint32_t pc);
+  bool     turbo_upload;
+
+  // SPI routine fast path
+  typedef struct {
+    uint32_t address;           // entry point, or ROSCO_M68K_SPI_NONE
+    uint32_t bytes;             // bytes moved by the first call measured; 0 until then
+    int64_t  cycles;            // clock cycles that call took
+    uint64_t instructions;      // instructions it took
+    uint32_t step_bytes;        // difference in bytes to a call of another length; 0 until one is measured
+    int64_t  step_cycles;       // difference in clock cycles, from the shorter call to the longer
+    uint64_t step_instructions; // difference in instructions
+  } spi_routine_cost;
+  uint32_t accelerateSpi(uint32_t instruction_budget);
+  uint32_t read32(uint32_t address);
+  void     write32(uint32_t address, uint32_t value);
+  spi_routine_cost spi_routines[ROSCO_M68K_SPI_ROUTINES];
+  bool             spi_routines_set;
+  uint32_t         spi_measure_routine;     // routine whose call is being measured
+  uint32_t         spi_measure_return;      // its return address
+  uint32_t         spi_measure_stack;       // stack pointer at its entry (or ROSCO_M68K_SPI_NONE if not measuring)
+  uint32_t         spi_measure_bytes;
+  int64_t          spi_measure_clock;
+  uint64_t         spi_measure_instruction;
+  uint16_t         spi_measure_sr;          // status register system byte at its entry
+  uint8_t          spi_measure_ipl;         // interrupt level at its entry
+  bool             spi_measure_disturbed;   // an exception was taken during it
+
+  // instruction trace
+  void           traceStep();
+  TraceRecorder* trace_recorder;
+  bool           trace_recording; // an instruction is executing; its data accesses go to the recorder
+
+  // external input record/replay
+  uint64_t    inputPosition();
+  void        inputLog(input_log_kind kind, int64_t value = 0, uint8_t port = 0, const uint8_t* data = NULL, uint32_t length = 0);
+  void        inputAdmit();
+  void        inputReplay();
+  void        inputReplayDue();
+  static time_t inputTime(void* callback_data);
+  static void   inputPortChanged(uint8_t value, void* callback_data);
+  InputLog*   input_record;
+  InputLog*   input_replay;
+  uint64_t    input_instruction_base; // instructions executed before the last reset(), so positions keep climbing across resets
+  bool        input_time_logged;
+  time_t      input_time;             // last time logged (recording) or replayed
+  std::vector<uint32_t> replay_events; // non-time events, by index in the log
+  std::vector<uint32_t> replay_times;  // time events
+  size_t      replay_event_next;
+  size_t      replay_time_next;
+  uint64_t    replay_due;             // position of the next non-time event
+  bool        replay_finished;
+  bool        replay_diverged;
 };
 
 /*
@@ -97,7 +302,7 @@ Address Layout
   |----------|----------|----------|----------|-----------------|
   | 00_00_00 | 00_03_FF | 00_04_00 |    1 KiB | Vector Table    |
   | 00_00_00 | 0F_FF_FF | 10_00_00 | 1024 KiB | On-board RAM    |
-  | 10_00_00 | DF_FF_FF | D0_00_00 |   13 MiB |                 |
+  | 10_00_00 | DF_FF_FF | D0_00_00 |   13 MiB | Expansion       | // empty, unless regions are given at construction
   | E0_00_00 | EF_FF_FF | 10_00_00 | 1024 KiB | On-board ROM    |
   | F0_00_00 | FF_FF_FF | 10_00_00 | 1024 KiB | I/O Space       |
 
@@ -0,0 +1,430 @@
+#include "sd_card.hpp"
+extern "C" {
+#include <string.h>
+}
+
+// R1 response bits
+#define SD_R1_IDLE            0x01
+#define SD_R1_ILLEGAL_COMMAND 0x04
+#define SD_R1_ADDRESS_ERROR   0x20
+#define SD_R1_PARAMETER_ERROR 0x40
+
+#define SD_TOKEN_START_BLOCK  0xFE
+#define SD_TOKEN_START_MULTI  0xFC // CMD25 data block
+#define SD_TOKEN_STOP_MULTI   0xFD // CMD25 stop transmission
+#define SD_DATA_ACCEPTED      0x05
+#define SD_DATA_WRITE_ERROR   0x0D
+#define SD_TOKEN_READ_ERROR   0x01 // data error tokens: general error,
+#define SD_TOKEN_OUT_OF_RANGE 0x08 // and streamed past the last block
+#define SD_R2_ERROR           0x04
+
+static uint8_t sdCrc7(const uint8_t* data, uint32_t length) {
+  uint8_t crc = 0;
+  for(uint32_t index=0; index<length; ++index) {
+    uint8_t byte = data[index];
+    for(uint8_t bit=0; bit<8; ++bit) {
+      crc <<= 1;
+      if((byte ^ crc) & 0x80) { crc ^= 0x09; }
+      byte <<= 1;
+    }
+  }
+  return crc & 0x7F;
+}
+
+static uint16_t sdCrc16(const uint8_t* data, uint32_t length) {
+  // CRC-16/XMODEM (CCITT polynomial, zero initial value), as used for SD data blocks
+  static uint16_t table[256];
+  static bool     table_ready = false;
+  if(!table_ready) {
+    for(uint32_t value=0; value<256; ++value) {
+      uint16_t crc = (uint16_t)(value << 8);
+      for(uint8_t bit=0; bit<8; ++bit) { crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1); }
+      table[value] = crc;
+    }
+    table_ready = true;
+  }
+  uint16_t crc = 0;
+  for(uint32_t index=0; index<length; ++index) { crc = (crc << 8) ^ table[((crc >> 8) ^ data[index]) & 0xFF]; }
+  return crc;
+}
+
+SdCard::SdCard(const char* image_path, bool use_io_uring) {
+  this->image = BlockImage::open(image_path, SD_CARD_BLOCK_SIZE, use_io_uring);
+  uint64_t blocks = this->image->blockCount();
+  this->block_count = (blocks > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)blocks; // block addressing is 32 bits
+  this->read_only   = this->image->readOnly();
+  this->fixed_timing = false;
+
+  this->read_waiting   = false;
+  this->read_multiple  = false;
+  this->write_waiting  = false;
+  this->write_multiple = false;
+  this->buildRegisters();
+  this->spiReset();
+}
+
+SdCard::~SdCard() {
+  delete this->image; // waits for anything in flight
+}
+
+uint32_t SdCard::blockCount() {
+  return this->block_count;
+}
+
+bool SdCard::readOnly() {
+  return this->read_only;
+}
+
+void SdCard::setFixedTiming(bool fixed) {
+  this->fixed_timing = fixed;
+}
+
+void SdCard::buildRegisters() {
+  // CSD version 2.0 (SDHC/SDXC): capacity is (C_SIZE + 1) * 512 KiB
+  uint32_t size = (this->block_count / 1024) ? ((this->block_count / 1024) - 1) : 0;
+  const uint8_t csd[15] = {
+    0x40,                          // CSD_STRUCTURE 1
+    0x0E, 0x00, 0x32,              // TAAC, NSAC, TRAN_SPEED (25 MHz)
+    0x5B, 0x59,                    // CCC, READ_BL_LEN 9 (512)
+    0x00,                          // no partial/misaligned blocks, no DSR
+    (uint8_t)((size >> 16) & 0x3F), (uint8_t)((size >> 8) & 0xFF), (uint8_t)(size & 0xFF), // C_SIZE
+    0x7F, 0x80,                    // ERASE_BLK_EN, SECTOR_SIZE, WP_GRP_SIZE
+    0x0A, 0x40,                    // R2W_FACTOR, WRITE_BL_LEN 9 (512)
+    (uint8_t)(this->read_only ? 0x20 : 0x00), // FILE_FORMAT; TMP_WRITE_PROTECT
+  };
+  memcpy(this->register_csd, csd, sizeof(csd));
+  this->register_csd[15] = (sdCrc7(csd, sizeof(csd)) << 1) | 1;
+
+  const uint8_t cid[15] = {
+    0x00, 'M', 'R',                // manufacturer, OEM/application
+    'M', 'R', 'E', 'M', 'U',       // product name
+    0x10,                          // product revision 1.0
+    0x00, 0x00, 0x00, 0x01,        // serial number
+    0x01, 0x6A,                    // manufacturing date
+  };
+  memcpy(this->register_cid, cid, sizeof(cid));
+  this->register_cid[15] = (sdCrc7(cid, sizeof(cid)) << 1) | 1;
+}
+
+void SdCard::spiReset() {
+  // power on: back to SD bus mode, until the next CMD0
+  this->settle();
+  this->io_error          = false;
+  this->selected          = false;
+  this->spi_mode          = false;
+  this->idle              = true;
+  this->app_command       = false;
+  this->initialize_polls  = 0;
+  this->state             = SD_CARD_COMMAND;
+  this->command_length    = 0;
+  this->response_length   = 0;
+  this->response_position = 0;
+  this->write_block       = 0;
+  this->write_length      = 0;
+}
+
+void SdCard::spiSelect(bool selected) {
+  this->selected = selected;
+  if(!selected) { this->command_length = 0; } // a partial command is abandoned
+}
+
+uint8_t SdCard::spiOutput() {
+  if(!this->spi_mode) { return 0x00; } // not driving MISO
+  if(this->response_position < this->response_length) { return this->response[this->response_position++]; }
+
+  if(this->read_waiting) {
+    if(this->read_access) {
+      --(this->read_access);
+      return 0xFF;
+    }
+    // the card's own access time is up; a host still reading holds the token back, as a slow card would, rather than stop the guest
+    if(!this->read_collected && this->read_hold) {
+      block_image_completion completion;
+      if(!this->image->poll(&completion)) {
+        --(this->read_hold);
+        return 0xFF;
+      }
+      this->read_collected = true;
+      this->read_result    = completion.result;
+    }
+    this->readComplete();
+    return this->response[this->response_position++];
+  }
+  if(this->read_multiple) {
+    // streamed off the end of the card
+    this->read_multiple = false;
+    return SD_TOKEN_OUT_OF_RANGE;
+  }
+  if(this->write_waiting) {
+    if(this->write_busy) {
+      --(this->write_busy);
+      return 0x00;
+    }
+    this->writeComplete();
+  }
+  return 0xFF;
+}
+
+void SdCard::readComplete() {
+  // the data token is due; collect the block (waiting on the host only if it's still running behind the guest)
+  if(!this->read_collected) {
+    block_image_completion completion;
+    this->read_collected = this->image->wait(&completion);
+    this->read_result    = this->read_collected ? completion.result : -1;
+  }
+  bool read = this->read_collected && (this->read_result == 0);
+  this->read_waiting = false;
+  if(!read) {
+    this->response[0]       = SD_TOKEN_READ_ERROR;
+    this->response_length   = 1;
+    this->response_position = 0;
+    this->read_multiple     = false;
+    return;
+  }
+  this->respondBlock(this->read_buffer, SD_CARD_BLOCK_SIZE);
+
+  // streaming: the block is copied out, so its buffer can take the next one now
+  if(this->read_multiple && ((this->read_block + 1) < this->block_count)) {
+    this->read_block += 1;
+    this->read_waiting = this->image->submitRead(this->read_block, 1, this->read_buffer, this->read_block);
+    this->readStarted();
+    if(!this->read_waiting) { this->read_multiple = false; }
+  }
+}
+
+void SdCard::readStarted() {
+  this->read_access    = SD_CARD_READ_ACCESS;
+  this->read_hold      = this->fixed_timing ? 0 : SD_CARD_READ_HOLD;
+  this->read_collected = false;
+}
+
+void SdCard::writeComplete() {
+  // busy ends once the block is on the host (so later reads see it)
+  block_image_completion completion;
+  if(!this->image->wait(&completion) || (completion.result != 0)) { this->io_error = true; }
+  this->write_waiting = false;
+}
+
+void SdCard::settle() {
+  // anything still in flight finishes before the card moves on (its result is dropped, as the guest walked away from it)
+  this->read_multiple  = false;
+  this->write_multiple = false;
+  if(this->read_waiting)  { this->readComplete(); }
+  if(this->write_waiting) { this->writeComplete(); }
+  this->response_length   = 0;
+  this->response_position = 0;
+}
+
+void SdCard::respond(const uint8_t* data, uint32_t length) {
+  // one byte of wait (NCR) ahead of the response
+  this->response[0] = 0xFF;
+  memcpy(this->response + 1, data, length);
+  this->response_length   = length + 1;
+  this->response_position = 0;
+}
+
+void SdCard::respondBlock(const uint8_t* data, uint32_t length) {
+  // follows whatever is still queued (ex: an R1 from respond()): a byte of access time, then the start token, data, and CRC
+  if(this->response_position == this->response_length) {
+    this->response_length   = 0;
+    this->response_position = 0;
+  }
+  uint8_t* block = this->response + this->response_length;
+  uint16_t crc   = sdCrc16(data, length);
+  block[0] = 0xFF;
+  block[1] = SD_TOKEN_START_BLOCK;
+  memcpy(block + 2, data, length);
+  block[2 + length] = (uint8_t)(crc >> 8);
+  block[3 + length] = (uint8_t)(crc & 0xFF);
+  this->response_length += length + 4;
+}
+
+void SdCard::spiInput(uint8_t data) {
+  if(!this->selected) { return; }
+
+  switch(this->state) {
+    case SD_CARD_WRITE_TOKEN:
+      if(data == (this->write_multiple ? SD_TOKEN_START_MULTI : SD_TOKEN_START_BLOCK)) {
+        if(this->write_waiting) { this->writeComplete(); } // token sent while busy; the buffer is needed again
+        this->state        = SD_CARD_WRITE_DATA;
+        this->write_length = 0;
+      } else if(this->write_multiple && (data == SD_TOKEN_STOP_MULTI)) {
+        // a byte, then busy while the last block is finished
+        this->settle();
+        this->state       = SD_CARD_COMMAND;
+        this->response[0] = 0xFF;
+        this->response[1] = 0x00;
+        this->response_length = 2;
+      }
+      return;
+
+    case SD_CARD_WRITE_DATA:
+      this->write_buffer[this->write_length++] = data;
+      if(this->write_length == SD_CARD_BLOCK_SIZE) {
+        this->state        = SD_CARD_WRITE_CRC;
+        this->write_length = 0;
+      }
+      return;
+
+    case SD_CARD_WRITE_CRC:
+      if(++(this->write_length) == 2) { this->writeFinish(); } // CRC isn't checked (SPI mode default)
+      return;
+
+    case SD_CARD_COMMAND:
+      break;
+  }
+
+  // commands start with bits 01; anything else between commands is just clocking
+  if(!this->command_length && ((data & 0xC0) != 0x40)) { return; }
+  this->command_bytes[this->command_length++] = data;
+  if(this->command_length < 6) { return; }
+  this->command_length = 0;
+
+  uint32_t argument = (((uint32_t)this->command_bytes[1]) << 24) | (((uint32_t)this->command_bytes[2]) << 16) |
+                      (((uint32_t)this->command_bytes[3]) <<  8) |  ((uint32_t)this->command_bytes[4]);
+  this->command(this->command_bytes[0] & 0x3F, argument);
+}
+
+void SdCard::writeFinish() {
+  // data response, then busy (MISO held low) while the host writes the block
+  this->state = this->write_multiple ? SD_CARD_WRITE_TOKEN : SD_CARD_COMMAND;
+  this->write_waiting = !this->read_only && (this->write_block < this->block_count) &&
+                        this->image->submitWrite(this->write_block, 1, this->write_buffer, this->write_block);
+  if(this->write_multiple) { this->write_block += 1; }
+  this->write_busy        = SD_CARD_WRITE_BUSY;
+  this->response[0]       = this->write_waiting ? SD_DATA_ACCEPTED : SD_DATA_WRITE_ERROR;
+  this->response_length   = 1;
+  this->response_position = 0;
+}
+
+void SdCard::command(uint8_t index, uint32_t argument) {
+  // until CMD0 puts the card in SPI mode, nothing else is answered
+  if(!this->spi_mode) {
+    if(index != 0) { return; }
+    this->spi_mode = true;
+  }
+
+  this->settle(); // a new command ends whatever the last one left going
+
+  bool app_command = this->app_command;
+  this->app_command = false;
+  uint8_t r1 = this->idle ? SD_R1_IDLE : 0x00;
+  uint8_t reply[5];
+
+  if(app_command && (index == 23)) {
+    // ACMD23 SET_WR_BLK_ERASE_COUNT: a pre-erase hint for the next CMD25; nothing to do
+    reply[0] = r1;
+    this->respond(reply, 1);
+    return;
+  }
+
+  if(app_command && (index == 41)) {
+    // ACMD41: start initialization; reports idle on the first poll, ready after that
+    if(this->initialize_polls++) { this->idle = false; }
+    reply[0] = this->idle ? SD_R1_IDLE : 0x00;
+    this->respond(reply, 1);
+    return;
+  }
+
+  switch(index) {
+    case 0: // GO_IDLE_STATE
+      this->idle             = true;
+      this->initialize_polls = 0;
+      reply[0] = SD_R1_IDLE;
+      this->respond(reply, 1);
+      return;
+
+    case 8: // SEND_IF_COND: echo voltage and check pattern back
+      reply[0] = r1;
+      reply[1] = 0x00;
+      reply[2] = 0x00;
+      reply[3] = (uint8_t)((argument >> 8) & 0x0F);
+      reply[4] = (uint8_t)(argument & 0xFF);
+      this->respond(reply, 5);
+      return;
+
+    case 9:  // SEND_CSD
+    case 10: // SEND_CID
+      if(this->idle) { break; }
+      reply[0] = r1;
+      this->respond(reply, 1);
+      this->respondBlock((index == 9) ? this->register_csd : this->register_cid, 16);
+      return;
+
+    case 13: // SEND_STATUS (R2)
+      reply[0] = r1;
+      reply[1] = this->io_error ? SD_R2_ERROR : 0x00;
+      this->io_error = false;
+      this->respond(reply, 2);
+      return;
+
+    case 16: // SET_BLOCKLEN; SDHC blocks are always 512 bytes
+      reply[0] = r1 | ((argument == SD_CARD_BLOCK_SIZE) ? 0x00 : SD_R1_PARAMETER_ERROR);
+      this->respond(reply, 1);
+      return;
+
+    case 12: // STOP_TRANSMISSION; the stream was already stopped when the command came in (see settle())
+      reply[0] = r1;
+      this->respond(reply, 1);
+      return;
+
+    case 17: // READ_SINGLE_BLOCK (argument is a block number)
+    case 18: // READ_MULTIPLE_BLOCK (until CMD12)
+      if(this->idle) { break; }
+      if(argument >= this->block_count) {
+        reply[0] = r1 | SD_R1_ADDRESS_ERROR;
+        this->respond(reply, 1);
+        return;
+      }
+      if(!this->image->submitRead(argument, 1, this->read_buffer, argument)) {
+        reply[0] = r1 | SD_R1_ADDRESS_ERROR;
+        this->respond(reply, 1);
+        return;
+      }
+      reply[0] = r1;
+      this->respond(reply, 1);
+      this->read_waiting  = true;
+      this->readStarted();
+      this->read_block    = argument;
+      this->read_multiple = (index == 18);
+      return;
+
+    case 24: // WRITE_BLOCK
+    case 25: // WRITE_MULTIPLE_BLOCK (until the stop token)
+      if(this->idle) { break; }
+      if(argument >= this->block_count) {
+        reply[0] = r1 | SD_R1_ADDRESS_ERROR;
+        this->respond(reply, 1);
+        return;
+      }
+      reply[0] = r1;
+      this->respond(reply, 1);
+      this->state          = SD_CARD_WRITE_TOKEN;
+      this->write_block    = argument;
+      this->write_multiple = (index == 25);
+      return;
+
+    case 55: // APP_CMD
+      this->app_command = true;
+      reply[0] = r1;
+      this->respond(reply, 1);
+      return;
+
+    case 58: // READ_OCR: 3.2-3.4V, high capacity, and powered up once initialized
+      reply[0] = r1;
+      reply[1] = (this->idle ? 0x00 : 0x80) | 0x40;
+      reply[2] = 0xFF;
+      reply[3] = 0x80;
+      reply[4] = 0x00;
+      this->respond(reply, 5);
+      return;
+
+    case 59: // CRC_ON_OFF; CRCs are never checked anyway
+      reply[0] = r1;
+      this->respond(reply, 1);
+      return;
+  }
+
+  reply[0] = r1 | SD_R1_ILLEGAL_COMMAND;
+  this->respond(reply, 1);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include "spi_device.hpp"
+#include "block_image.hpp"
+
+#define SD_CARD_BLOCK_SIZE    512
+#define SD_CARD_RESPONSE_SIZE (SD_CARD_BLOCK_SIZE + 16) // longest response: R1, wait, token, block, CRC
+#define SD_CARD_READ_ACCESS   8                          // bytes of 0xFF ahead of each block read (NAC)
+#define SD_CARD_READ_HOLD     2048                       // most bytes more, while the host is still reading (drivers allow 100ms)
+#define SD_CARD_WRITE_BUSY    8                          // bytes of busy signalled after each block written
+
+/**
+ * SDHC card, in SPI mode, backed by a disk image file
+ * blocks are read and written asynchronously (see BlockImage), while the guest goes on clocking the bus:
+ * a read is started with its command, and its data token comes SD_CARD_READ_ACCESS bytes after the response, or,
+ * if the host is still reading then, as soon as it's done, up to SD_CARD_READ_HOLD bytes later, as a slow card's would
+ * (streamed reads start on each next block as soon as the last one is taken, so it's read while that one goes out);
+ * a write is started once its data is in, and busy ends SD_CARD_WRITE_BUSY bytes later.
+ * those are counted on the SPI clock; only past them does the card stop the guest to wait for the host.
+ * with fixed timing, reads wait straight after SD_CARD_READ_ACCESS, so results are the same however fast the host is.
+ * an image that can't be opened for writing makes the card write protected
+ **/
+class SdCard : public SpiDevice {
+public:
+  /**
+   * Create a card from a disk image
+   *
+   * @param image_path path to the image; its size is rounded down to whole blocks
+   * @param use_io_uring false to keep block I/O on a thread pool, even where io_uring is available
+   **/
+  SdCard(const char* image_path, bool use_io_uring = true);
+  ~SdCard();
+
+  /**
+   * Get card capacity
+   *
+   * @returns count of 512 byte blocks
+   **/
+  uint32_t blockCount();
+
+  /**
+   * Check whether the card is write protected
+   *
+   * @returns whether writes are refused
+   **/
+  bool readOnly();
+
+  /**
+   * Fix read timing, so a run doesn't depend on how fast the host reads the image (ex: recording or replaying inputs)
+   *
+   * @param fixed true to always give the data token SD_CARD_READ_ACCESS bytes after the response, waiting for the host if need be
+   **/
+  void setFixedTiming(bool fixed);
+
+  // SpiDevice implementation
+  void    spiReset() override;
+  void    spiSelect(bool selected) override;
+  uint8_t spiOutput() override;
+  void    spiInput(uint8_t data) override;
+
+protected:
+  typedef enum {
+    SD_CARD_COMMAND,     // waiting for (or collecting) a command
+    SD_CARD_WRITE_TOKEN, // CMD24/CMD25 accepted; waiting for a data start (or, for CMD25, stop) token
+    SD_CARD_WRITE_DATA,  // collecting the block
+    SD_CARD_WRITE_CRC,   // collecting its CRC
+  } sd_card_state;
+
+  void command(uint8_t index, uint32_t argument);
+  void respond(const uint8_t* data, uint32_t length);
+  void respondBlock(const uint8_t* data, uint32_t length);
+  void writeFinish();
+  void readStarted();
+  void readComplete();
+  void writeComplete();
+  void settle();
+  void buildRegisters();
+
+  BlockImage* image;
+  uint32_t    block_count;
+  bool        read_only;
+  bool        fixed_timing;
+
+  bool     selected;
+  bool     spi_mode;        // CMD0 received while selected; until then, the card doesn't drive MISO
+  bool     idle;            // in idle state (not yet initialized by ACMD41)
+  bool     app_command;     // CMD55 received; next command is an ACMD
+  uint8_t  initialize_polls;
+  sd_card_state state;
+
+  uint8_t  command_bytes[6];
+  uint8_t  command_length;
+
+  uint8_t  response[SD_CARD_RESPONSE_SIZE];
+  uint32_t response_length;
+  uint32_t response_position;
+
+  uint32_t write_block;
+  uint32_t write_length;
+  uint8_t  write_buffer[SD_CARD_BLOCK_SIZE];
+
+  // block I/O in flight (at most one request at a time)
+  bool     read_waiting;   // block read submitted; its data token is still to go out
+  uint32_t read_access;    // bytes of access time left before it
+  uint32_t read_hold;      // bytes more it may be held back, while the host is still reading
+  bool     read_collected; // the host has finished the read (poll()ed early)
+  int32_t  read_result;    // its result, once collected
+  bool     write_waiting;  // block write submitted; card is busy
+  uint32_t write_busy;     // bytes of busy left
+  bool     io_error;       // a write failed on the host (reported by CMD13)
+  uint8_t  read_buffer[SD_CARD_BLOCK_SIZE];
+
+  // multiple block transfers
+  bool     read_multiple;  // streaming blocks (CMD18) until CMD12; the next is read while this one goes out
+  uint32_t read_block;     // block being read
+  bool     write_multiple; // taking blocks (CMD25) until the stop token
+
+  uint8_t  register_csd[16];
+  uint8_t  register_cid[16];
+};
@@ -0,0 +1,350 @@
+#include "serial_bridge.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+}
+
+// events reported by waitEvents()
+#define BRIDGE_EVENT_LISTEN 0x01
+#define BRIDGE_EVENT_READ   0x02
+#define BRIDGE_EVENT_WRITE  0x04
+#define BRIDGE_EVENT_HANGUP 0x08
+#define BRIDGE_EVENT_WAKE   0x10
+
+// how often to check back for room in the port's queue while it's past its limit
+#define BRIDGE_RECEIVE_RETRY_MS 1
+
+static bool bridgeNonBlocking(int file) {
+  int flags = fcntl(file, F_GETFL);
+  if(flags < 0) { return false; }
+  if(fcntl(file, F_SETFL, flags | O_NONBLOCK) < 0) { return false; }
+  return fcntl(file, F_SETFD, FD_CLOEXEC) >= 0;
+}
+
+SerialBridge* SerialBridge::create(Duart68681* duart, uint8_t port, const char* specification) {
+  SerialBridge* bridge = new SerialBridge(duart, port);
+  try {
+    if(!strcmp(specification, "pty")) {
+      bridge->openPty(NULL);
+    } else if(!strncmp(specification, "pty:", 4)) {
+      bridge->openPty(specification + 4);
+    } else if(!strncmp(specification, "unix:", 5)) {
+      bridge->listenUnix(specification + 5);
+    } else {
+      throw "invalid serial bridge (expected pty, pty:<link>, or unix:<path>)";
+    }
+    bridge->start();
+  } catch(...) {
+    delete bridge;
+    throw;
+  }
+  return bridge;
+}
+
+SerialBridge::SerialBridge(Duart68681* duart, uint8_t port) {
+  this->duart          = duart;
+  this->port           = port;
+  this->listen_file    = -1;
+  this->client_file    = -1;
+  this->pty_slave_file = -1;
+  this->wake_files[0]  = -1;
+  this->wake_files[1]  = -1;
+  this->poll_file      = -1;
+  this->stopping       = false;
+  this->transmit_ring_head = 0;
+  this->transmit_ring_tail = 0;
+  this->transmit_dropped   = 0;
+  this->receive_held       = false;
+  this->poll_interest      = 0;
+}
+
+SerialBridge::~SerialBridge() {
+  this->stop();
+  if(this->client_file    >= 0) { close(this->client_file);    }
+  if(this->listen_file    >= 0) { close(this->listen_file);    }
+  if(this->pty_slave_file >= 0) { close(this->pty_slave_file); }
+  if(this->poll_file      >= 0) { close(this->poll_file);      }
+  if(this->wake_files[0]  >= 0) { close(this->wake_files[0]);  }
+  if((this->wake_files[1] >= 0) && (this->wake_files[1] != this->wake_files[0])) { close(this->wake_files[1]); }
+  if(!this->link_path.empty()) { unlink(this->link_path.c_str()); }
+}
+
+const char* SerialBridge::path() {
+  return this->host_path.c_str();
+}
+
+uint64_t SerialBridge::transmitDropped() {
+  return this->transmit_dropped.load(std::memory_order_relaxed);
+}
+
+void SerialBridge::openPty(const char* link_path) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if(master < 0) { throw "error opening pty"; }
+  this->client_file = master;
+  if((grantpt(master) != 0) || (unlockpt(master) != 0) || !bridgeNonBlocking(master)) { throw "error opening pty"; }
+
+  const char* slave_path = ptsname(master);
+  if(!slave_path) { throw "error opening pty"; }
+  this->host_path = slave_path;
+
+  // raw: bytes pass through untouched, both ways
+  this->pty_slave_file = open(slave_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if(this->pty_slave_file < 0) { throw "error opening pty"; }
+  struct termios attributes;
+  if(tcgetattr(this->pty_slave_file, &attributes) == 0) {
+    cfmakeraw(&attributes);
+    tcsetattr(this->pty_slave_file, TCSANOW, &attributes);
+  }
+
+  if(link_path && *link_path) {
+    unlink(link_path);
+    if(symlink(slave_path, link_path) != 0) { throw "error creating pty link"; }
+    this->link_path = link_path;
+    this->host_path = link_path;
+  }
+}
+
+void SerialBridge::listenUnix(const char* socket_path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(strlen(socket_path) >= sizeof(address.sun_path)) { throw "serial bridge socket path too long"; }
+  strcpy(address.sun_path, socket_path);
+
+  this->listen_file = socket(AF_UNIX, SOCK_STREAM, 0);
+  if((this->listen_file < 0) || !bridgeNonBlocking(this->listen_file)) { throw "error creating serial bridge socket"; }
+  unlink(socket_path); // stale socket from an earlier run
+  if(bind(this->listen_file, (struct sockaddr*)&address, sizeof(address)) != 0) { throw "error binding serial bridge socket"; }
+  this->link_path = socket_path;
+  this->host_path = socket_path;
+  if(listen(this->listen_file, 1) != 0) { throw "error listening on serial bridge socket"; }
+}
+
+void SerialBridge::start() {
+#if defined(__linux__)
+  this->wake_files[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  this->wake_files[1] = this->wake_files[0];
+  if(this->wake_files[0] < 0) { throw "error creating serial bridge event"; }
+
+  this->poll_file = epoll_create1(EPOLL_CLOEXEC);
+  if(this->poll_file < 0) { throw "error creating serial bridge poll"; }
+  struct epoll_event event;
+  event.events   = EPOLLIN;
+  event.data.u32 = BRIDGE_EVENT_WAKE;
+  epoll_ctl(this->poll_file, EPOLL_CTL_ADD, this->wake_files[0], &event);
+  if(this->listen_file >= 0) {
+    event.data.u32 = BRIDGE_EVENT_LISTEN;
+    epoll_ctl(this->poll_file, EPOLL_CTL_ADD, this->listen_file, &event);
+  }
+#else
+  if(pipe(this->wake_files) != 0) { throw "error creating serial bridge event"; }
+  bridgeNonBlocking(this->wake_files[0]);
+  bridgeNonBlocking(this->wake_files[1]);
+#endif
+
+  this->duart->setSerialTransmitterBulk(this->port, SerialBridge::transmit, this);
+  this->io_thread = std::thread(&SerialBridge::ioThread, this);
+}
+
+void SerialBridge::stop() {
+  if(!this->io_thread.joinable()) { return; }
+  this->duart->setSerialTransmitterBulk(this->port, NULL, NULL); // flushes whatever is still buffered to us
+  this->stopping = true;
+  this->wake();
+  this->io_thread.join();
+}
+
+void SerialBridge::transmit(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data) {
+  SerialBridge* bridge = (SerialBridge*)callback_data;
+
+  // producer side; bytes that don't fit are dropped (the client isn't keeping up)
+  uint32_t tail  = bridge->transmit_ring_tail.load(std::memory_order_relaxed);
+  uint32_t space = SERIAL_BRIDGE_TRANSMIT_RING_SIZE - (tail - bridge->transmit_ring_head.load(std::memory_order_acquire));
+  if(length > space) {
+    bridge->transmit_dropped += length - space;
+    length = space;
+  }
+  if(!length) { return; }
+
+  uint32_t offset = tail & (SERIAL_BRIDGE_TRANSMIT_RING_SIZE - 1);
+  uint32_t first  = SERIAL_BRIDGE_TRANSMIT_RING_SIZE - offset;
+  if(first > length) { first = length; }
+  memcpy(bridge->transmit_ring + offset, transmit_data, first);
+  memcpy(bridge->transmit_ring, transmit_data + first, length - first);
+  bridge->transmit_ring_tail.store(tail + length, std::memory_order_release);
+  bridge->wake();
+}
+
+void SerialBridge::wake() {
+#if defined(__linux__)
+  uint64_t count = 1;
+  ssize_t written = write(this->wake_files[1], &count, sizeof(count));
+#else
+  uint8_t count = 1;
+  ssize_t written = write(this->wake_files[1], &count, sizeof(count));
+#endif
+  (void)written; // already signalled, if full
+}
+
+uint32_t SerialBridge::waitEvents(int timeout_ms) {
+  // only wait on the client for what we can currently act on
+  uint32_t interest = 0;
+  if(this->client_file >= 0) {
+    if(!this->receive_held) { interest |= BRIDGE_EVENT_READ; }
+    if(this->transmit_ring_tail.load(std::memory_order_acquire) != this->transmit_ring_head.load(std::memory_order_relaxed)) { interest |= BRIDGE_EVENT_WRITE; }
+  }
+  uint32_t events = 0;
+
+#if defined(__linux__)
+  if((this->client_file >= 0) && (interest != this->poll_interest)) {
+    struct epoll_event event;
+    event.events   = ((interest & BRIDGE_EVENT_READ) ? EPOLLIN : 0) | ((interest & BRIDGE_EVENT_WRITE) ? EPOLLOUT : 0);
+    event.data.u32 = BRIDGE_EVENT_READ;
+    epoll_ctl(this->poll_file, EPOLL_CTL_MOD, this->client_file, &event);
+    this->poll_interest = interest;
+  }
+
+  struct epoll_event ready[4];
+  int count = epoll_wait(this->poll_file, ready, 4, timeout_ms);
+  for(int index=0; index<count; ++index) {
+    if(ready[index].data.u32 != BRIDGE_EVENT_READ) {
+      events |= ready[index].data.u32;
+      continue;
+    }
+    if(ready[index].events & EPOLLIN)              { events |= BRIDGE_EVENT_READ;   }
+    if(ready[index].events & EPOLLOUT)             { events |= BRIDGE_EVENT_WRITE;  }
+    if(ready[index].events & (EPOLLHUP | EPOLLERR)) { events |= BRIDGE_EVENT_HANGUP; }
+  }
+#else
+  struct pollfd files[3];
+  nfds_t file_count = 0;
+  files[file_count++] = { .fd = this->wake_files[0], .events = POLLIN, .revents = 0 };
+  nfds_t listen_index = file_count;
+  if(this->listen_file >= 0) { files[file_count++] = { .fd = this->listen_file, .events = POLLIN, .revents = 0 }; }
+  nfds_t client_index = file_count;
+  if(this->client_file >= 0) {
+    short client_events = ((interest & BRIDGE_EVENT_READ) ? POLLIN : 0) | ((interest & BRIDGE_EVENT_WRITE) ? POLLOUT : 0);
+    files[file_count++] = { .fd = this->client_file, .events = client_events, .revents = 0 };
+  }
+
+  if(poll(files, file_count, timeout_ms) > 0) {
+    if(files[0].revents & POLLIN) { events |= BRIDGE_EVENT_WAKE; }
+    if((this->listen_file >= 0) && (files[listen_index].revents & POLLIN)) { events |= BRIDGE_EVENT_LISTEN; }
+    if(this->client_file >= 0) {
+      if(files[client_index].revents & POLLIN)              { events |= BRIDGE_EVENT_READ;   }
+      if(files[client_index].revents & POLLOUT)             { events |= BRIDGE_EVENT_WRITE;  }
+      if(files[client_index].revents & (POLLHUP | POLLERR)) { events |= BRIDGE_EVENT_HANGUP; }
+    }
+  }
+#endif
+
+  return events;
+}
+
+void SerialBridge::ioThread() {
+#if defined(__linux__)
+  if(this->client_file >= 0) {
+    // PTY master; registered with no interest, waitEvents() sets it
+    struct epoll_event event;
+    event.events   = 0;
+    event.data.u32 = BRIDGE_EVENT_READ;
+    epoll_ctl(this->poll_file, EPOLL_CTL_ADD, this->client_file, &event);
+  }
+#endif
+
+  while(!this->stopping) {
+    // while the port's queue is full, check back for room every so often (it doesn't tell us)
+    int timeout_ms = this->receive_held ? BRIDGE_RECEIVE_RETRY_MS : -1;
+    uint32_t events = this->waitEvents(timeout_ms);
+
+    if(events & BRIDGE_EVENT_WAKE) {
+      uint8_t drain[64];
+      while(read(this->wake_files[0], drain, sizeof(drain)) > 0) {}
+    }
+    if(events & BRIDGE_EVENT_LISTEN) { this->ioAccept(); }
+    if(this->receive_held || (events & BRIDGE_EVENT_READ)) { this->ioRead(); }
+    this->ioWrite();
+    if((events & BRIDGE_EVENT_HANGUP) && (this->listen_file >= 0)) { this->ioDisconnect(); }
+  }
+}
+
+void SerialBridge::ioAccept() {
+  int client = accept(this->listen_file, NULL, NULL);
+  if(client < 0) { return; }
+  if(this->client_file >= 0) {
+    // one client at a time; the port is busy
+    close(client);
+    return;
+  }
+  bridgeNonBlocking(client);
+  this->client_file   = client;
+  this->poll_interest = 0;
+#if defined(__linux__)
+  struct epoll_event event;
+  event.events   = 0;
+  event.data.u32 = BRIDGE_EVENT_READ;
+  epoll_ctl(this->poll_file, EPOLL_CTL_ADD, client, &event);
+#endif
+}
+
+void SerialBridge::ioDisconnect() {
+  if(this->client_file < 0) { return; }
+#if defined(__linux__)
+  epoll_ctl(this->poll_file, EPOLL_CTL_DEL, this->client_file, NULL);
+#endif
+  close(this->client_file);
+  this->client_file  = -1;
+  this->receive_held = false;
+}
+
+void SerialBridge::ioRead() {
+  if(this->client_file < 0) { return; }
+
+  // queue what the client sends, as long as the guest keeps up; past the limit, the client backs up, not us
+  // (queued, the bytes go into the receiver on the emulation thread, which is its only writer)
+  while(true) {
+    this->receive_held = this->duart->serialPortQueueLength(this->port) >= SERIAL_BRIDGE_QUEUE_LIMIT;
+    if(this->receive_held) { return; }
+
+    ssize_t length = read(this->client_file, this->receive_buffer, SERIAL_BRIDGE_READ_SIZE);
+    if(length > 0) {
+      this->duart->serialPortQueue(this->port, this->receive_buffer, (uint32_t)length);
+      continue;
+    }
+    if((length == 0) && (this->listen_file >= 0)) { this->ioDisconnect(); } // socket client closed
+    return; // EAGAIN (or a PTY with nobody attached)
+  }
+}
+
+void SerialBridge::ioWrite() {
+  uint32_t head = this->transmit_ring_head.load(std::memory_order_relaxed);
+  uint32_t tail = this->transmit_ring_tail.load(std::memory_order_acquire);
+  while(head != tail) {
+    uint32_t offset = head & (SERIAL_BRIDGE_TRANSMIT_RING_SIZE - 1);
+    uint32_t length = tail - head;
+    if(length > (SERIAL_BRIDGE_TRANSMIT_RING_SIZE - offset)) { length = SERIAL_BRIDGE_TRANSMIT_RING_SIZE - offset; }
+
+    if(this->client_file < 0) {
+      head += length; // nobody connected; output goes nowhere, as with an unplugged cable
+    } else {
+      ssize_t written = write(this->client_file, this->transmit_ring + offset, length);
+      if(written <= 0) {
+        if((written < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (this->listen_file >= 0)) { this->ioDisconnect(); continue; }
+        break; // full; waitEvents() waits for room
+      }
+      head += (uint32_t)written;
+    }
+    this->transmit_ring_head.store(head, std::memory_order_release);
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdbool.h>
+}
+#include <atomic>
+#include <string>
+#include <thread>
+#include "duart_68681.hpp"
+
+#define SERIAL_BRIDGE_TRANSMIT_RING_SIZE 65536 // must be a power of two
+#define SERIAL_BRIDGE_READ_SIZE          4096
+#define SERIAL_BRIDGE_QUEUE_LIMIT        4096 // received bytes left in the port's queue before the client is no longer read
+
+/**
+ * Connects a DUART serial port to a host PTY or Unix domain socket
+ * a dedicated I/O thread (epoll on Linux, poll() elsewhere) moves data in bulk: output through a lock-free ring,
+ * input through the port's host queue (see Duart68681::serialPortQueue());
+ * the bridge becomes the port's only source of received data, and the port's transmitter hands all its output to the bridge
+ * (output the client doesn't keep up with is dropped once the transmit ring fills; see transmitDropped())
+ **/
+class SerialBridge {
+public:
+  /**
+   * Bridge a serial port, as described by a specification string:
+   *   "pty"            new pseudo-terminal; see path() for its device
+   *   "pty:<link>"     new pseudo-terminal, with a symlink to its device created at link
+   *   "unix:<path>"    Unix domain (stream) socket listening at path; one client at a time
+   *
+   * @param duart DUART owning the port; must outlive the bridge
+   * @param port port to bridge (DUART_68681_PORT_A or DUART_68681_PORT_B)
+   * @param specification what to bridge the port to
+   * @returns new bridge, already running
+   **/
+  static SerialBridge* create(Duart68681* duart, uint8_t port, const char* specification);
+  ~SerialBridge();
+
+  /**
+   * Get the host path to connect to
+   *
+   * @returns PTY device (or its link), or socket path
+   **/
+  const char* path();
+
+  /**
+   * Get count of transmitted bytes dropped, because the transmit ring was full (the client wasn't keeping up)
+   *
+   * @returns count of bytes dropped since the bridge was created
+   **/
+  uint64_t transmitDropped();
+
+protected:
+  SerialBridge(Duart68681* duart, uint8_t port);
+  void openPty(const char* link_path);
+  void listenUnix(const char* socket_path);
+  void start();
+  void stop();
+
+  static void transmit(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data);
+  void wake();
+
+  // I/O thread
+  void     ioThread();
+  uint32_t waitEvents(int timeout_ms);
+  void     ioAccept();
+  void     ioRead();
+  void     ioWrite();
+  void     ioDisconnect();
+
+  Duart68681* duart;
+  uint8_t     port;
+  std::string host_path;
+  std::string link_path;   // symlink (pty) or socket file (unix) to remove when done
+  int listen_file;         // unix socket listening for clients, or -1
+  int client_file;         // PTY master, or connected unix client, or -1
+  int pty_slave_file;      // kept open, so the master doesn't see hang-ups while nobody is attached
+  int wake_files[2];       // eventfd (both the same), or pipe (read, write)
+  int poll_file;           // epoll instance, or -1
+
+  std::thread       io_thread;
+  std::atomic<bool> stopping;
+
+  // guest -> host; producer: emulation thread (transmit callback), consumer: I/O thread
+  uint8_t transmit_ring[SERIAL_BRIDGE_TRANSMIT_RING_SIZE];
+  alignas(64) std::atomic<uint32_t> transmit_ring_head;
+  alignas(64) std::atomic<uint32_t> transmit_ring_tail;
+  std::atomic<uint64_t> transmit_dropped; // bytes lost to a full ring (client not keeping up)
+
+  // host -> guest; read from the client into the port's queue (I/O thread only)
+  uint8_t  receive_buffer[SERIAL_BRIDGE_READ_SIZE];
+  bool     receive_held;  // the queue is past SERIAL_BRIDGE_QUEUE_LIMIT, so the client isn't read until the guest catches up
+  uint32_t poll_interest; // events currently registered for client_file
+};
@@ -0,0 +1,109 @@
+#include "spi_bus.hpp"
+
+SpiBus::SpiBus() {
+  this->devices[SPI_BUS_SELECT_A] = NULL;
+  this->devices[SPI_BUS_SELECT_B] = NULL;
+  this->pins = SPI_BUS_PIN_SELECT_A | SPI_BUS_PIN_SELECT_B; // nothing selected
+  this->selected    = NULL;
+  this->input_byte  = 0x00;
+  this->input_bits  = 0;
+  this->output_byte = 0x00;
+  this->output_bits = 0;
+}
+
+void SpiBus::attach(uint8_t select, SpiDevice* device) {
+  if(select > SPI_BUS_SELECT_B) { return; }
+  if(this->devices[select] && (this->devices[select] == this->selected)) { this->selected = NULL; }
+  this->devices[select] = device;
+  if(device) { device->spiReset(); }
+}
+
+bool SpiBus::attached() {
+  return this->devices[SPI_BUS_SELECT_A] || this->devices[SPI_BUS_SELECT_B];
+}
+
+void SpiBus::reset() {
+  if(this->devices[SPI_BUS_SELECT_A]) { this->devices[SPI_BUS_SELECT_A]->spiReset(); }
+  if(this->devices[SPI_BUS_SELECT_B]) { this->devices[SPI_BUS_SELECT_B]->spiReset(); }
+  this->pins        = SPI_BUS_PIN_SELECT_A | SPI_BUS_PIN_SELECT_B;
+  this->selected    = NULL;
+  this->input_byte  = 0x00;
+  this->input_bits  = 0;
+  this->output_byte = 0x00;
+  this->output_bits = 0;
+}
+
+void SpiBus::copyState(SpiBus* source) {
+  this->pins        = source->pins;
+  this->input_byte  = source->input_byte;
+  this->input_bits  = source->input_bits;
+  this->output_byte = source->output_byte;
+  this->output_bits = source->output_bits;
+  // our own devices, as selected by the copied pins
+  bool select_a = !(this->pins & SPI_BUS_PIN_SELECT_A);
+  bool select_b = !(this->pins & SPI_BUS_PIN_SELECT_B);
+  this->selected = NULL;
+  if(select_a != select_b) { this->selected = this->devices[select_a ? SPI_BUS_SELECT_A : SPI_BUS_SELECT_B]; }
+}
+
+void SpiBus::outputChanged(uint8_t pins) {
+  uint8_t changed = this->pins ^ pins;
+  this->pins = pins;
+
+  // chip selects (active low); with both asserted at once, the bus is in contention, and nobody is heard
+  if(changed & (SPI_BUS_PIN_SELECT_A | SPI_BUS_PIN_SELECT_B)) {
+    bool select_a = !(pins & SPI_BUS_PIN_SELECT_A);
+    bool select_b = !(pins & SPI_BUS_PIN_SELECT_B);
+    if((changed & SPI_BUS_PIN_SELECT_A) && this->devices[SPI_BUS_SELECT_A]) { this->devices[SPI_BUS_SELECT_A]->spiSelect(select_a); }
+    if((changed & SPI_BUS_PIN_SELECT_B) && this->devices[SPI_BUS_SELECT_B]) { this->devices[SPI_BUS_SELECT_B]->spiSelect(select_b); }
+
+    this->selected = NULL;
+    if(select_a != select_b) { this->selected = this->devices[select_a ? SPI_BUS_SELECT_A : SPI_BUS_SELECT_B]; }
+    this->input_bits  = 0;
+    this->output_bits = 0;
+    this->output_byte = this->selected ? this->selected->spiOutput() : 0x00;
+  }
+  if(!this->selected || !(changed & SPI_BUS_PIN_CLOCK)) { return; }
+
+  if(pins & SPI_BUS_PIN_CLOCK) {
+    // rising edge: sample MOSI (as already set, or set along with the clock)
+    this->input_byte = (this->input_byte << 1) | ((pins & SPI_BUS_PIN_MOSI) ? 1 : 0);
+    if(++(this->input_bits) == 8) {
+      this->input_bits = 0;
+      this->selected->spiInput(this->input_byte);
+    }
+  } else {
+    // falling edge: MISO moves on
+    if(++(this->output_bits) == 8) {
+      this->output_bits = 0;
+      this->output_byte = this->selected->spiOutput();
+    }
+  }
+}
+
+bool SpiBus::miso() {
+  if(!this->selected) { return false; }
+  return (this->output_byte >> (7 - this->output_bits)) & 1;
+}
+
+bool SpiBus::transfer(const uint8_t* output, uint8_t* input, uint32_t length) {
+  if((this->pins & SPI_BUS_PIN_CLOCK) || this->input_bits || this->output_bits) { return false; }
+  if(!length) { return true; }
+
+  SpiDevice* device = this->selected;
+  for(uint32_t index=0; index<length; ++index) {
+    uint8_t sent = output ? output[index] : 0xFF;
+    uint8_t read = 0x00;
+    if(device) {
+      read = this->output_byte;
+      device->spiInput(sent);
+      this->output_byte = device->spiOutput();
+    }
+    if(input) { input[index] = read; }
+  }
+
+  // pins as the last bit left them
+  uint8_t last = output ? output[length - 1] : 0xFF;
+  this->pins = (last & 1) ? (this->pins | SPI_BUS_PIN_MOSI) : (this->pins & ~SPI_BUS_PIN_MOSI);
+  return true;
+}
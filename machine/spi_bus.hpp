@@ -0,0 +1,90 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include "spi_device.hpp"
+
+// pins of the rosco-m68k's bit-banged SPI (output pin levels, not OPR bits; chip selects are active low)
+#define SPI_BUS_PIN_SELECT_A 0x04 // OP2
+#define SPI_BUS_PIN_CLOCK    0x10 // OP4
+#define SPI_BUS_PIN_MOSI     0x40 // OP6
+#define SPI_BUS_PIN_SELECT_B 0x80 // OP7
+#define SPI_BUS_INPUT_MISO   0x04 // IP2
+
+#define SPI_BUS_SELECT_A 0
+#define SPI_BUS_SELECT_B 1
+
+/**
+ * Mode 0 SPI bus, driven a pin at a time from the DUART output port
+ * MOSI is sampled on the rising clock edge, MISO moves to its next bit on the falling edge;
+ * whole bytes are passed to (and taken from) the selected device
+ **/
+class SpiBus {
+public:
+  SpiBus();
+
+  /**
+   * Attach a device to a chip select
+   *
+   * @param select chip select (SPI_BUS_SELECT_A or SPI_BUS_SELECT_B)
+   * @param device device to attach (not owned), or NULL to detach
+   **/
+  void attach(uint8_t select, SpiDevice* device);
+
+  /**
+   * Check whether any device is attached
+   *
+   * @returns whether the bus has a device on either chip select
+   **/
+  bool attached();
+
+  /**
+   * Output pins changed
+   *
+   * @param pins output pin levels (OP0-OP7)
+   **/
+  void outputChanged(uint8_t pins);
+
+  /**
+   * Read MISO
+   *
+   * @returns MISO level (low when nothing drives it)
+   **/
+  bool miso();
+
+  /**
+   * Move whole bytes in one go, exactly as clocking them out a bit at a time would
+   * (each byte out on MOSI while the selected device's byte comes back on MISO); leaves the clock low, and MOSI at the last bit sent
+   * only possible between bytes, with the clock low
+   *
+   * @param output bytes to send, or NULL to send 0xFF (MOSI held high)
+   * @param input receives the bytes read back (0x00 with nothing selected), or NULL to discard them
+   * @param length count of bytes
+   * @returns whether the bytes were moved; false if the bus is part way through a byte
+   **/
+  bool transfer(const uint8_t* output, uint8_t* input, uint32_t length);
+
+  /**
+   * Reset the bus, and every attached device
+   **/
+  void reset();
+
+  /**
+   * Copy bus state from another bus (attached devices are kept as they are)
+   *
+   * @param source bus to copy from
+   **/
+  void copyState(SpiBus* source);
+
+protected:
+  SpiDevice* devices[2];
+  SpiDevice* selected;    // device currently selected (only one may be)
+  uint8_t    pins;        // last output pin levels
+  uint8_t    input_byte;  // MOSI bits shifted in so far
+  uint8_t    input_bits;
+  uint8_t    output_byte; // MISO byte being shifted out
+  uint8_t    output_bits; // bits of it already shifted out
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdbool.h>
+}
+
+class SpiDevice {
+public:
+  virtual ~SpiDevice() {}
+
+  /**
+   * reset device to its power-on state
+   */
+  virtual void spiReset() = 0;
+
+  /**
+   * chip select changed
+   * @param selected whether the device is now selected
+   */
+  virtual void spiSelect(bool selected) = 0;
+
+  /**
+   * get the byte the device is shifting out (MISO), MSB first; asked for at the start of every byte while selected
+   * @returns output byte (0x00 where the device leaves the line undriven; the bus is pulled low)
+   */
+  virtual uint8_t spiOutput() = 0;
+
+  /**
+   * a whole byte was shifted in (MOSI), while the byte from spiOutput() was shifted out
+   * @param data byte received
+   */
+  virtual void spiInput(uint8_t data) = 0;
+};
@@ -0,0 +1,119 @@
+#include "symbol_index.hpp"
+extern "C" {
+#include <stdio.h>
+#include <string.h>
+}
+#include <algorithm>
+
+#define SYMBOL_INDEX_BUS_END 0x1000000
+#define SYMBOL_INDEX_LANES   8 // searches run in lockstep by findMany()
+
+SymbolIndex::SymbolIndex() {
+}
+
+SymbolIndex::~SymbolIndex() {
+}
+
+void SymbolIndex::add(uint32_t address, uint32_t size, const char* name) {
+  address &= 0xFFFFFF;
+  if(size > (SYMBOL_INDEX_BUS_END - address)) { size = SYMBOL_INDEX_BUS_END - address; }
+  this->pending.push_back({
+    .address     = address,
+    .size        = size,
+    .order       = (uint32_t)this->pending.size(),
+    .name_offset = (uint32_t)this->pending_names.size(),
+  });
+  this->pending_names.append(name);
+  this->pending_names.push_back(0x00);
+}
+
+void SymbolIndex::add(ProgramImage* program) {
+  for(const program_symbol& symbol : program->symbols()) {
+    this->add(symbol.address, symbol.size, symbol.name.c_str());
+  }
+}
+
+void SymbolIndex::build() {
+  std::vector<pending_symbol> sorted = this->pending;
+  std::sort(sorted.begin(), sorted.end(), [](const pending_symbol& a, const pending_symbol& b) {
+    return (a.address != b.address) ? (a.address < b.address) : (a.order < b.order);
+  });
+
+  this->starts.clear();
+  this->ends.clear();
+  this->name_offsets.clear();
+  this->names.clear();
+  for(size_t index=0; index<sorted.size(); ++index) {
+    const pending_symbol* symbol = &(sorted[index]);
+    if(!this->starts.empty() && (this->starts.back() == symbol->address)) { continue; } // same address; first added wins
+
+    // runs until its size is used up, or the next symbol starts (whichever comes first)
+    uint32_t next = SYMBOL_INDEX_BUS_END;
+    for(size_t later=index+1; later<sorted.size(); ++later) {
+      if(sorted[later].address != symbol->address) { next = sorted[later].address; break; }
+    }
+    uint32_t end = symbol->size ? (symbol->address + symbol->size) : next;
+    if(end > next) { end = next; }
+
+    this->starts.push_back(symbol->address);
+    this->ends.push_back(end);
+    this->name_offsets.push_back((uint32_t)this->names.size());
+    this->names.append(this->pending_names.c_str() + symbol->name_offset);
+    this->names.push_back(0x00);
+  }
+  this->starts.shrink_to_fit();
+  this->ends.shrink_to_fit();
+  this->name_offsets.shrink_to_fit();
+  this->names.shrink_to_fit();
+}
+
+void SymbolIndex::findMany(const uint32_t* addresses, size_t count, uint32_t* indexes) const {
+  uint32_t symbol_count = (uint32_t)this->starts.size();
+  if(!symbol_count) {
+    for(size_t index=0; index<count; ++index) { indexes[index] = SYMBOL_INDEX_NONE; }
+    return;
+  }
+
+  // every search over the same array takes the same number of steps, so several can run side by side;
+  // their loads are independent, and overlap, rather than each waiting on the last
+  const uint32_t* starts = this->starts.data();
+  size_t index = 0;
+  for(; (index + SYMBOL_INDEX_LANES) <= count; index += SYMBOL_INDEX_LANES) {
+    uint32_t        address[SYMBOL_INDEX_LANES];
+    const uint32_t* base[SYMBOL_INDEX_LANES];
+    for(uint32_t lane=0; lane<SYMBOL_INDEX_LANES; ++lane) {
+      address[lane] = addresses[index + lane] & 0xFFFFFF;
+      base[lane]    = starts;
+    }
+    uint32_t remaining = symbol_count;
+    while(remaining > 1) {
+      uint32_t half = remaining >> 1;
+      for(uint32_t lane=0; lane<SYMBOL_INDEX_LANES; ++lane) {
+        base[lane] = (base[lane][half] <= address[lane]) ? (base[lane] + half) : base[lane];
+      }
+      remaining -= half;
+    }
+    for(uint32_t lane=0; lane<SYMBOL_INDEX_LANES; ++lane) {
+      uint32_t found = (uint32_t)(base[lane] - starts);
+      bool covered = (address[lane] >= starts[found]) && (address[lane] < this->ends[found]);
+      indexes[index + lane] = covered ? found : SYMBOL_INDEX_NONE;
+    }
+  }
+  for(; index<count; ++index) { indexes[index] = this->find(addresses[index]); }
+}
+
+bool SymbolIndex::format(uint32_t address, char* buffer, size_t buffer_length) const {
+  if(!buffer_length) { return false; }
+  uint32_t index = this->find(address);
+  if(index == SYMBOL_INDEX_NONE) {
+    buffer[0] = 0x00;
+    return false;
+  }
+  uint32_t offset = (address & 0xFFFFFF) - this->starts[index];
+  if(offset) {
+    snprintf(buffer, buffer_length, "%s+0x%x", this->name(index), offset);
+  } else {
+    snprintf(buffer, buffer_length, "%s", this->name(index));
+  }
+  return true;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include <string>
+#include <vector>
+#include "program_image.hpp"
+
+#define SYMBOL_INDEX_NONE 0xFFFFFFFF
+
+/**
+ * Address to symbol lookup, for the 24 bit bus
+ * symbols are collected, then build() flattens them into sorted, non-overlapping intervals, held in parallel arrays
+ * (starts are searched alone, so a lookup touches only log2(n) 4 byte entries); lookups are branchless binary searches,
+ * and never allocate, so they're safe to make from many threads at once once built
+ **/
+class SymbolIndex {
+public:
+  SymbolIndex();
+  ~SymbolIndex();
+
+  /**
+   * Add a symbol (takes effect on build())
+   *
+   * @param address first address covered
+   * @param size bytes covered; 0 to cover everything up to the next symbol
+   * @param name symbol name
+   **/
+  void add(uint32_t address, uint32_t size, const char* name);
+
+  /**
+   * Add every symbol of a program image (takes effect on build())
+   *
+   * @param program image to take symbols from
+   **/
+  void add(ProgramImage* program);
+
+  /**
+   * Sort and flatten the symbols added so far; lookups before this find nothing
+   * where symbols share an address, the first added wins; where they overlap, the later starting one does
+   **/
+  void build();
+
+  /**
+   * Find the symbol covering an address
+   *
+   * @param address bus address (only the low 24 bits are used)
+   * @returns index of the symbol, or SYMBOL_INDEX_NONE
+   **/
+  uint32_t find(uint32_t address) const {
+    address &= 0xFFFFFF;
+    uint32_t count = (uint32_t)this->starts.size();
+    if(!count || (address < this->starts[0])) { return SYMBOL_INDEX_NONE; }
+
+    // last start <= address; the loop has no data dependent branches (the select compiles to a conditional move)
+    const uint32_t* base = this->starts.data();
+    while(count > 1) {
+      uint32_t half = count >> 1;
+      base   = (base[half] <= address) ? (base + half) : base;
+      count -= half;
+    }
+    uint32_t index = (uint32_t)(base - this->starts.data());
+    return (address < this->ends[index]) ? index : SYMBOL_INDEX_NONE;
+  }
+
+  /**
+   * Find the symbols covering many addresses (ex: a block of trace records)
+   *
+   * @param addresses bus addresses
+   * @param count count of addresses
+   * @param indexes receives count symbol indexes (or SYMBOL_INDEX_NONE)
+   **/
+  void findMany(const uint32_t* addresses, size_t count, uint32_t* indexes) const;
+
+  /**
+   * Get the name of a symbol
+   *
+   * @param index index from find()
+   * @returns symbol name
+   **/
+  const char* name(uint32_t index) const { return this->names.data() + this->name_offsets[index]; }
+
+  /**
+   * Get the first address of a symbol
+   *
+   * @param index index from find()
+   * @returns address the symbol starts at
+   **/
+  uint32_t start(uint32_t index) const { return this->starts[index]; }
+
+  /**
+   * Format an address as symbol+offset
+   *
+   * @param address bus address
+   * @param buffer receives the text, ex: "main+0x1a", "main", or "" if no symbol covers address
+   * @param buffer_length size of buffer
+   * @returns whether a symbol covers address
+   **/
+  bool format(uint32_t address, char* buffer, size_t buffer_length) const;
+
+  /**
+   * Get count of symbols in the index
+   *
+   * @returns count of symbols (as of the last build())
+   **/
+  uint32_t count() const { return (uint32_t)this->starts.size(); }
+
+protected:
+  typedef struct {
+    uint32_t address;
+    uint32_t size;
+    uint32_t order;       // order added, to break ties
+    uint32_t name_offset; // into pending_names
+  } pending_symbol;
+  std::vector<pending_symbol> pending;
+  std::string                 pending_names;
+
+  // built index; entry i covers [starts[i], ends[i])
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> ends;
+  std::vector<uint32_t> name_offsets; // into names
+  std::string           names;        // NUL separated
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+}
+
+/*
+Instruction trace file format (little-endian throughout)
+
+  trace_file_header
+  chunk, chunk, ...
+
+each chunk is a trace_chunk_header followed by `length` bytes of records; the header carries the full register state,
+so a chunk decodes without looking at any other; every other value in a record is relative to the record before it:
+
+  record:
+    uint8_t  flags                  TRACE_RECORD_* bits, and the count of memory accesses
+    varint   zigzag(pc - last pc)   (usually the length of the last instruction)
+    uint16_t opcode
+    varint   zigzag(clock - last clock)
+    [uint16_t mask, then for each set bit (D0-D7, A0-A7): varint zigzag(value - last value)]  if TRACE_RECORD_REGISTERS
+    [uint16_t sr]                                                                              if TRACE_RECORD_SR
+    [varint  count - TRACE_RECORD_ACCESSES_INLINE]                                             if the inline count is TRACE_RECORD_ACCESSES_INLINE
+    access, access, ...
+
+  access:
+    uint8_t  kind                   TRACE_ACCESS_* bits
+    varint   zigzag(address - last access address)
+    uint8_t value, or uint16_t value if TRACE_ACCESS_WORD
+
+varints are LEB128 (7 bits per byte, low bits first, high bit set on all but the last byte)
+*/
+
+#define TRACE_FILE_MAGIC     "MRTRACE\0"
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_CHUNK_MAGIC    0x4354524D // "MRTC"
+
+#define TRACE_RECORD_REGISTERS       0x01 // data/address registers changed
+#define TRACE_RECORD_SR              0x02 // status register changed
+#define TRACE_RECORD_ACCESS_SHIFT    2    // memory access count, in the upper 6 bits
+#define TRACE_RECORD_ACCESSES_INLINE 63   // counts from here on continue in a varint
+
+#define TRACE_ACCESS_WRITE 0x01 // else a read
+#define TRACE_ACCESS_WORD  0x02 // else a byte
+#define TRACE_ACCESSES_MAX 128  // most accesses in one record (exceptions and MOVEM included)
+
+/**
+ * start of a trace file
+ **/
+typedef struct {
+  char     magic[8];   // TRACE_FILE_MAGIC
+  uint32_t version;    // TRACE_FORMAT_VERSION
+  uint32_t chunk_size; // largest chunk (header included) in the file
+  uint32_t clock_hz;   // processor clock, for converting cycles to time
+  uint32_t reserved;
+} trace_file_header;
+
+/**
+ * start of a chunk of records; the state here is as it was just before the chunk's first record
+ **/
+typedef struct {
+  uint32_t magic;          // TRACE_CHUNK_MAGIC
+  uint32_t length;         // bytes of records following this header
+  uint32_t records;        // count of records
+  uint32_t access_address; // last memory access address
+  uint64_t instruction;    // index of the first record, counted from the start of the trace
+  int64_t  clock;          // processor clock
+  uint32_t pc;             // program counter of the last record
+  uint16_t sr;             // status register
+  uint16_t reserved;
+  uint32_t registers[16];  // D0-D7, A0-A7
+} trace_chunk_header;
+
+static_assert(sizeof(trace_file_header)  == 24,  "trace_file_header layout");
+static_assert(sizeof(trace_chunk_header) == 104, "trace_chunk_header layout");
+
+static inline uint32_t traceZigzag(int32_t value)    { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+static inline int32_t  traceUnzigzag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+static inline uint64_t traceZigzag64(int64_t value)    { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+static inline int64_t  traceUnzigzag64(uint64_t value) { return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+
+static inline uint8_t* traceVarintPut(uint8_t* output, uint64_t value) {
+  while(value >= 0x80) {
+    *output++ = (uint8_t)value | 0x80;
+    value >>= 7;
+  }
+  *output++ = (uint8_t)value;
+  return output;
+}
+
+// returns NULL if the varint runs past end
+static inline const uint8_t* traceVarintGet(const uint8_t* input, const uint8_t* end, uint64_t* value) {
+  uint64_t result = 0;
+  for(uint32_t shift=0; (input < end) && (shift < 64); shift += 7) {
+    uint8_t byte = *input++;
+    result |= ((uint64_t)(byte & 0x7F)) << shift;
+    if(!(byte & 0x80)) {
+      *value = result;
+      return input;
+    }
+  }
+  return NULL;
+}
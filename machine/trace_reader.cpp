@@ -0,0 +1,171 @@
+#include "trace_reader.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+TraceReader* TraceReader::open(const char* trace_path) {
+  int trace_file = ::open(trace_path, O_RDONLY | O_CLOEXEC);
+  if(trace_file < 0) { throw "error opening trace file"; }
+  struct stat trace_stat;
+  if(fstat(trace_file, &trace_stat) < 0) {
+    close(trace_file);
+    throw "error opening trace file";
+  }
+  size_t length = (size_t)trace_stat.st_size;
+  if(length < sizeof(trace_file_header)) {
+    close(trace_file);
+    throw "not a trace file";
+  }
+  void* mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, trace_file, 0);
+  close(trace_file);
+  if(mapped == MAP_FAILED) { throw "error mapping trace file"; }
+
+  TraceReader* reader = new TraceReader();
+  reader->map        = (const uint8_t*)mapped;
+  reader->map_length = length;
+
+  trace_file_header header;
+  memcpy(&header, reader->map, sizeof(header));
+  if(memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) || (header.version != TRACE_FORMAT_VERSION)) {
+    delete reader;
+    throw "not a trace file (or an unsupported version)";
+  }
+  reader->clock_hz = header.clock_hz;
+
+  // walk the chunk headers; the records in between are left for decodeChunk()
+  size_t offset = sizeof(trace_file_header);
+  while((length - offset) >= sizeof(trace_chunk_header)) {
+    trace_chunk_header chunk;
+    memcpy(&chunk, reader->map + offset, sizeof(chunk));
+    if(chunk.magic != TRACE_CHUNK_MAGIC) { break; }
+    if(chunk.length > (length - offset - sizeof(trace_chunk_header))) { break; }
+    offset += sizeof(trace_chunk_header);
+    reader->chunks.push_back(chunk);
+    reader->chunk_records.push_back(offset);
+    reader->instruction_count = chunk.instruction + chunk.records;
+    offset += chunk.length;
+  }
+  madvise((void*)reader->map, reader->map_length, MADV_WILLNEED);
+  return reader;
+}
+
+TraceReader::TraceReader() {
+  this->map               = NULL;
+  this->map_length        = 0;
+  this->clock_hz          = 0;
+  this->instruction_count = 0;
+}
+
+TraceReader::~TraceReader() {
+  if(this->map) { munmap((void*)this->map, this->map_length); }
+}
+
+uint32_t TraceReader::clockHz() {
+  return this->clock_hz;
+}
+
+uint64_t TraceReader::instructions() {
+  return this->instruction_count;
+}
+
+uint32_t TraceReader::chunkCount() {
+  return (uint32_t)this->chunks.size();
+}
+
+const trace_chunk_header* TraceReader::chunk(uint32_t index) {
+  return &(this->chunks[index]);
+}
+
+uint32_t TraceReader::findChunk(uint64_t instruction) {
+  uint32_t lowest  = 0;
+  uint32_t highest = (uint32_t)this->chunks.size();
+  while(lowest < highest) {
+    uint32_t middle = lowest + ((highest - lowest) >> 1);
+    const trace_chunk_header* chunk = &(this->chunks[middle]);
+    if(instruction < chunk->instruction) {
+      highest = middle;
+    } else if(instruction >= (chunk->instruction + chunk->records)) {
+      lowest = middle + 1;
+    } else {
+      return middle;
+    }
+  }
+  return (uint32_t)this->chunks.size();
+}
+
+bool TraceReader::decodeChunk(uint32_t index, trace_step_callback callback, void* callback_data) {
+  const trace_chunk_header* chunk = &(this->chunks[index]);
+  const uint8_t* input = this->map + this->chunk_records[index];
+  const uint8_t* end   = input + chunk->length;
+
+  trace_access accesses[TRACE_ACCESSES_MAX];
+  trace_step   step;
+  step.instruction  = chunk->instruction;
+  step.pc           = chunk->pc;
+  step.sr           = chunk->sr;
+  step.clock        = chunk->clock;
+  step.accesses     = accesses;
+  memcpy(step.registers, chunk->registers, sizeof(step.registers));
+  uint32_t access_address = chunk->access_address;
+
+  uint64_t value;
+  for(uint32_t record=0; record<chunk->records; ++record) {
+    if((end - input) < 5) { return false; } // flags, pc, opcode, and clock, at their shortest
+    uint8_t flags = *input++;
+    if(!(input = traceVarintGet(input, end, &value))) { return false; }
+    step.pc += (uint32_t)traceUnzigzag((uint32_t)value);
+    if((end - input) < 2) { return false; }
+    step.opcode = (uint16_t)(input[0] | (input[1] << 8));
+    input += 2;
+    if(!(input = traceVarintGet(input, end, &value))) { return false; }
+    step.cycles  = traceUnzigzag64(value);
+    step.clock  += step.cycles;
+
+    step.changed = 0;
+    if(flags & TRACE_RECORD_REGISTERS) {
+      if((end - input) < 2) { return false; }
+      step.changed = (uint16_t)(input[0] | (input[1] << 8));
+      input += 2;
+      for(uint32_t register_index=0; register_index<16; ++register_index) {
+        if(!(step.changed & (1 << register_index))) { continue; }
+        if(!(input = traceVarintGet(input, end, &value))) { return false; }
+        step.registers[register_index] += (uint32_t)traceUnzigzag((uint32_t)value);
+      }
+    }
+
+    step.sr_changed = (flags & TRACE_RECORD_SR) != 0;
+    if(step.sr_changed) {
+      if((end - input) < 2) { return false; }
+      step.sr = (uint16_t)(input[0] | (input[1] << 8));
+      input += 2;
+    }
+
+    uint64_t count = flags >> TRACE_RECORD_ACCESS_SHIFT;
+    if(count == TRACE_RECORD_ACCESSES_INLINE) {
+      if(!(input = traceVarintGet(input, end, &value))) { return false; }
+      count += value;
+    }
+    if(count > TRACE_ACCESSES_MAX) { return false; }
+    for(uint32_t access_index=0; access_index<count; ++access_index) {
+      trace_access* access = &(accesses[access_index]);
+      if(input >= end) { return false; }
+      access->kind = *input++;
+      if(!(input = traceVarintGet(input, end, &value))) { return false; }
+      access_address += (uint32_t)traceUnzigzag((uint32_t)value);
+      access->address = access_address;
+      uint32_t size = (access->kind & TRACE_ACCESS_WORD) ? 2 : 1;
+      if((uint32_t)(end - input) < size) { return false; }
+      access->value = (size == 2) ? (uint16_t)(input[0] | (input[1] << 8)) : input[0];
+      input += size;
+    }
+    step.access_count = (uint32_t)count;
+
+    if(!callback(&step, callback_data)) { return true; }
+    ++step.instruction;
+  }
+  return input == end;
+}
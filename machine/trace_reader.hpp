@@ -0,0 +1,118 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+}
+#include <vector>
+#include "trace_format.hpp"
+
+/**
+ * one memory access, from a decoded record
+ **/
+typedef struct {
+  uint32_t address; // bus address
+  uint16_t value;   // byte or word transferred
+  uint8_t  kind;    // TRACE_ACCESS_* bits
+} trace_access;
+
+/**
+ * one decoded record; registers hold the state after the instruction
+ **/
+typedef struct {
+  uint64_t            instruction;   // index, counted from the start of the trace
+  uint32_t            pc;            // address of the instruction
+  uint16_t            opcode;        // its first word
+  uint16_t            sr;            // status register
+  uint16_t            changed;       // registers it changed (bit n: D0-D7, then A0-A7)
+  bool                sr_changed;    // whether it changed the status register
+  int64_t             clock;         // processor clock
+  int64_t             cycles;        // cycles since the record before
+  uint32_t            registers[16]; // D0-D7, A0-A7
+  uint32_t            access_count;
+  const trace_access* accesses;
+} trace_step;
+
+/**
+ * Callback for each decoded record
+ *
+ * @param step the record; only valid during the call
+ * @param callback_data as given to decodeChunk()
+ * @returns whether to go on decoding
+ **/
+typedef bool (*trace_step_callback)(const trace_step* step, void* callback_data);
+
+/**
+ * Instruction trace file (from TraceRecorder), mapped for reading
+ * chunks are indexed when opened (only their headers are touched); each one decodes on its own,
+ * so different chunks may be decoded from many threads at once
+ **/
+class TraceReader {
+public:
+  /**
+   * Open and index a trace file; a truncated last chunk (ex: the recording was cut short) is left out
+   *
+   * @param trace_path path to the trace file
+   * @returns new reader
+   **/
+  static TraceReader* open(const char* trace_path);
+  ~TraceReader();
+
+  /**
+   * Get the processor clock the trace was recorded at
+   *
+   * @returns clock rate, in Hz
+   **/
+  uint32_t clockHz();
+
+  /**
+   * Get count of records in the trace
+   *
+   * @returns count of instructions
+   **/
+  uint64_t instructions();
+
+  /**
+   * Get count of chunks in the trace
+   *
+   * @returns count of chunks
+   **/
+  uint32_t chunkCount();
+
+  /**
+   * Get the header of a chunk
+   *
+   * @param index chunk index
+   * @returns chunk header (state before its first record)
+   **/
+  const trace_chunk_header* chunk(uint32_t index);
+
+  /**
+   * Find the chunk holding a record
+   *
+   * @param instruction record index
+   * @returns chunk index, or chunkCount() if past the end of the trace
+   **/
+  uint32_t findChunk(uint64_t instruction);
+
+  /**
+   * Decode every record in a chunk
+   *
+   * @param index chunk index
+   * @param callback called with each record, in order
+   * @param callback_data passed to callback
+   * @returns false if the chunk is malformed (records up to that point have been passed to callback)
+   **/
+  bool decodeChunk(uint32_t index, trace_step_callback callback, void* callback_data);
+
+protected:
+  TraceReader();
+
+  const uint8_t* map;
+  size_t         map_length;
+  uint32_t       clock_hz;
+  uint64_t       instruction_count;
+  std::vector<trace_chunk_header> chunks;        // copied out, as chunks needn't be aligned in the file
+  std::vector<size_t>             chunk_records; // offset of each chunk's records
+};
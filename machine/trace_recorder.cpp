@@ -0,0 +1,241 @@
+#include "trace_recorder.hpp"
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+}
+
+// largest possible record: flags, pc, opcode, clock, registers, sr, access count, then every access at its largest
+#define TRACE_RECORD_MAX (1 + 5 + 2 + 10 + (2 + (16 * 5)) + 2 + 5 + (TRACE_RECORDER_ACCESSES * (1 + 5 + 2)))
+
+static bool traceWriteAll(int file, const uint8_t* data, size_t length) {
+  while(length) {
+    ssize_t written = write(file, data, length);
+    if(written < 0) {
+      if(errno == EINTR) { continue; }
+      return false;
+    }
+    data   += written;
+    length -= written;
+  }
+  return true;
+}
+
+TraceRecorder* TraceRecorder::create(const char* trace_path, uint32_t clock_hz, uint32_t chunk_size) {
+  if(chunk_size < (sizeof(trace_chunk_header) + (TRACE_RECORD_MAX * 4))) { throw "trace chunk size too small"; }
+
+  TraceRecorder* recorder = new TraceRecorder(chunk_size);
+  try {
+    recorder->trace_file = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(recorder->trace_file < 0) { throw "error creating trace file"; }
+
+    trace_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+    header.version    = TRACE_FORMAT_VERSION;
+    header.chunk_size = chunk_size;
+    header.clock_hz   = clock_hz;
+    if(!traceWriteAll(recorder->trace_file, (const uint8_t*)&header, sizeof(header))) { throw "error writing trace file"; }
+
+    for(uint8_t* &page : recorder->pages) {
+      page = (uint8_t*)malloc(chunk_size);
+      if(!page) { throw "error allocating trace pages"; }
+    }
+  } catch(...) {
+    delete recorder;
+    throw;
+  }
+
+  recorder->chunkStart();
+  recorder->writer = std::thread(&TraceRecorder::writerThread, recorder);
+  return recorder;
+}
+
+TraceRecorder::TraceRecorder(uint32_t chunk_size) {
+  this->trace_file          = -1;
+  this->chunk_size          = chunk_size;
+  this->last_pc             = 0;
+  this->last_sr             = 0;
+  this->last_clock          = 0;
+  this->last_access_address = 0;
+  memset(this->last_registers, 0, sizeof(this->last_registers));
+  this->access_count        = 0;
+  this->accesses_dropped    = 0;
+  this->record_count        = 0;
+  this->pages[0]            = NULL;
+  this->pages[1]            = NULL;
+  this->page_filling        = 0;
+  this->page_cursor         = NULL;
+  this->page_limit          = NULL;
+  this->page_records        = 0;
+  this->writer_page         = -1;
+  this->writer_length       = 0;
+  this->writer_stopping     = false;
+  this->write_failed        = false;
+}
+
+TraceRecorder::~TraceRecorder() {
+  this->finish();
+  if(this->trace_file >= 0) { close(this->trace_file); }
+  free(this->pages[0]);
+  free(this->pages[1]);
+}
+
+void TraceRecorder::finish() {
+  if(!this->writer.joinable()) { return; }
+  this->chunkSeal();
+  {
+    std::lock_guard<std::mutex> lock(this->writer_lock);
+    this->writer_stopping = true;
+  }
+  this->writer_wake.notify_one();
+  this->writer.join();
+}
+
+void TraceRecorder::begin(uint32_t pc, const uint32_t* registers, uint16_t sr, int64_t clock) {
+  this->last_pc    = pc;
+  this->last_sr    = sr;
+  this->last_clock = clock;
+  memcpy(this->last_registers, registers, sizeof(this->last_registers));
+  this->access_count = 0;
+
+  // the chunk header has to carry this state
+  if(this->page_records) {
+    this->chunkSeal();
+  } else {
+    this->chunkStart();
+  }
+}
+
+void TraceRecorder::record(uint32_t pc, uint16_t opcode, int64_t clock, const uint32_t* registers, uint16_t sr) {
+  if(this->page_cursor > this->page_limit) { this->chunkSeal(); }
+
+  uint8_t* output = this->page_cursor;
+  uint8_t* flags  = output++;
+  uint8_t  flag   = 0;
+
+  output = traceVarintPut(output, traceZigzag((int32_t)(pc - this->last_pc)));
+  *output++ = (uint8_t)(opcode & 0xFF);
+  *output++ = (uint8_t)(opcode >> 8);
+  output = traceVarintPut(output, traceZigzag64(clock - this->last_clock));
+
+  uint16_t mask = 0;
+  for(uint32_t index=0; index<16; ++index) {
+    if(registers[index] != this->last_registers[index]) { mask |= (1 << index); }
+  }
+  if(mask) {
+    flag |= TRACE_RECORD_REGISTERS;
+    *output++ = (uint8_t)(mask & 0xFF);
+    *output++ = (uint8_t)(mask >> 8);
+    for(uint32_t index=0; index<16; ++index) {
+      if(!(mask & (1 << index))) { continue; }
+      output = traceVarintPut(output, traceZigzag((int32_t)(registers[index] - this->last_registers[index])));
+      this->last_registers[index] = registers[index];
+    }
+  }
+
+  if(sr != this->last_sr) {
+    flag |= TRACE_RECORD_SR;
+    *output++ = (uint8_t)(sr & 0xFF);
+    *output++ = (uint8_t)(sr >> 8);
+    this->last_sr = sr;
+  }
+
+  uint32_t count = this->access_count;
+  if(count > TRACE_RECORDER_ACCESSES) {
+    this->accesses_dropped += count - TRACE_RECORDER_ACCESSES;
+    count = TRACE_RECORDER_ACCESSES;
+  }
+  if(count < TRACE_RECORD_ACCESSES_INLINE) {
+    flag |= (uint8_t)(count << TRACE_RECORD_ACCESS_SHIFT);
+  } else {
+    flag |= (uint8_t)(TRACE_RECORD_ACCESSES_INLINE << TRACE_RECORD_ACCESS_SHIFT);
+    output = traceVarintPut(output, count - TRACE_RECORD_ACCESSES_INLINE);
+  }
+  for(uint32_t index=0; index<count; ++index) {
+    const trace_recorder_access* entry = &(this->accesses[index]);
+    *output++ = entry->kind;
+    output = traceVarintPut(output, traceZigzag((int32_t)(entry->address - this->last_access_address)));
+    *output++ = (uint8_t)(entry->value & 0xFF);
+    if(entry->kind & TRACE_ACCESS_WORD) { *output++ = (uint8_t)(entry->value >> 8); }
+    this->last_access_address = entry->address;
+  }
+
+  *flags = flag;
+  this->page_cursor  = output;
+  this->last_pc      = pc;
+  this->last_clock   = clock;
+  this->access_count = 0;
+  ++this->page_records;
+  ++this->record_count;
+}
+
+uint64_t TraceRecorder::instructions() {
+  return this->record_count;
+}
+
+uint64_t TraceRecorder::accessesDropped() {
+  return this->accesses_dropped;
+}
+
+bool TraceRecorder::failed() {
+  return this->write_failed;
+}
+
+void TraceRecorder::chunkStart() {
+  uint8_t* page = this->pages[this->page_filling];
+  trace_chunk_header* header = (trace_chunk_header*)page;
+  memset(header, 0, sizeof(trace_chunk_header));
+  header->magic          = TRACE_CHUNK_MAGIC;
+  header->access_address = this->last_access_address;
+  header->instruction    = this->record_count;
+  header->clock          = this->last_clock;
+  header->pc             = this->last_pc;
+  header->sr             = this->last_sr;
+  memcpy(header->registers, this->last_registers, sizeof(header->registers));
+
+  this->page_cursor  = page + sizeof(trace_chunk_header);
+  this->page_limit   = page + this->chunk_size - TRACE_RECORD_MAX;
+  this->page_records = 0;
+}
+
+void TraceRecorder::chunkSeal() {
+  if(!this->page_records) { return; }
+
+  uint8_t* page = this->pages[this->page_filling];
+  trace_chunk_header* header = (trace_chunk_header*)page;
+  uint32_t length = (uint32_t)(this->page_cursor - page);
+  header->length  = length - sizeof(trace_chunk_header);
+  header->records = this->page_records;
+
+  // the other page must be on disk before this one is handed over, and that one refilled
+  {
+    std::unique_lock<std::mutex> lock(this->writer_lock);
+    this->writer_done.wait(lock, [this] { return this->writer_page < 0; });
+    this->writer_page   = this->page_filling;
+    this->writer_length = length;
+  }
+  this->writer_wake.notify_one();
+
+  this->page_filling ^= 1;
+  this->chunkStart();
+}
+
+void TraceRecorder::writerThread() {
+  std::unique_lock<std::mutex> lock(this->writer_lock);
+  while(true) {
+    this->writer_wake.wait(lock, [this] { return (this->writer_page >= 0) || this->writer_stopping; });
+    if(this->writer_page < 0) { return; }
+
+    const uint8_t* page   = this->pages[this->writer_page];
+    uint32_t       length = this->writer_length;
+    lock.unlock();
+    if(!this->write_failed && !traceWriteAll(this->trace_file, page, length)) { this->write_failed = true; }
+    lock.lock();
+
+    this->writer_page = -1;
+    this->writer_done.notify_one();
+  }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdbool.h>
+}
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "trace_format.hpp"
+
+#define TRACE_RECORDER_CHUNK_SIZE 0x400000 // 4 MiB; each page holds one chunk
+#define TRACE_RECORDER_ACCESSES   TRACE_ACCESSES_MAX // most memory accesses kept per instruction
+
+/**
+ * Streams every executed instruction to a trace file (see trace_format.hpp)
+ * records are delta-encoded into one of two pages, in the emulation thread; a full page is sealed as a chunk,
+ * and handed to a writer thread, while the other page fills (the emulation only waits if the disk falls a whole page behind)
+ **/
+class TraceRecorder {
+public:
+  /**
+   * Create a trace file
+   *
+   * @param trace_path path to the file to create (replaced, if it exists)
+   * @param clock_hz processor clock, noted in the file
+   * @param chunk_size bytes per page/chunk
+   * @returns new recorder
+   **/
+  static TraceRecorder* create(const char* trace_path, uint32_t clock_hz, uint32_t chunk_size = TRACE_RECORDER_CHUNK_SIZE);
+  /**
+   * Writes out whatever has been recorded (if not finished already), and closes the file
+   **/
+  ~TraceRecorder();
+
+  /**
+   * Seal the last chunk and wait for everything recorded to be written, so failed() covers the whole trace;
+   * nothing more may be recorded after
+   **/
+  void finish();
+
+  /**
+   * Set the state that the next record is relative to (when recording starts, or after something outside
+   * the instruction stream changed the processor state)
+   *
+   * @param pc program counter
+   * @param registers D0-D7, A0-A7
+   * @param sr status register
+   * @param clock processor clock
+   **/
+  void begin(uint32_t pc, const uint32_t* registers, uint16_t sr, int64_t clock);
+
+  /**
+   * Note a memory access made by the instruction being executed
+   *
+   * @param kind TRACE_ACCESS_* bits
+   * @param address bus address
+   * @param value byte or word transferred
+   **/
+  void access(uint8_t kind, uint32_t address, uint16_t value) {
+    if(this->access_count < TRACE_RECORDER_ACCESSES) {
+      trace_recorder_access* entry = &(this->accesses[this->access_count]);
+      entry->address = address;
+      entry->value   = value;
+      entry->kind    = kind;
+    }
+    ++this->access_count;
+  }
+
+  /**
+   * Record an executed instruction, with the accesses noted since the last record
+   *
+   * @param pc address of the instruction
+   * @param opcode its first word
+   * @param clock processor clock after it
+   * @param registers D0-D7, A0-A7 after it
+   * @param sr status register after it
+   **/
+  void record(uint32_t pc, uint16_t opcode, int64_t clock, const uint32_t* registers, uint16_t sr);
+
+  /**
+   * Get count of instructions recorded
+   *
+   * @returns count of records
+   **/
+  uint64_t instructions();
+
+  /**
+   * Get count of memory accesses left out (beyond TRACE_RECORDER_ACCESSES in one instruction)
+   *
+   * @returns count of accesses not recorded
+   **/
+  uint64_t accessesDropped();
+
+  /**
+   * Check whether writing the file has failed (records since then are lost)
+   *
+   * @returns whether a write failed
+   **/
+  bool failed();
+
+protected:
+  typedef struct {
+    uint32_t address;
+    uint16_t value;
+    uint8_t  kind;
+  } trace_recorder_access;
+
+  TraceRecorder(uint32_t chunk_size);
+  void chunkStart();
+  void chunkSeal();
+  void writerThread();
+
+  int      trace_file;
+  uint32_t chunk_size;
+
+  // state the next record is relative to
+  uint32_t last_pc;
+  uint16_t last_sr;
+  int64_t  last_clock;
+  uint32_t last_registers[16];
+  uint32_t last_access_address;
+
+  trace_recorder_access accesses[TRACE_RECORDER_ACCESSES];
+  uint32_t              access_count;
+  uint64_t              accesses_dropped;
+  uint64_t              record_count;
+
+  // pages; the emulation thread fills one, while the writer may have the other
+  uint8_t* pages[2];
+  uint8_t  page_filling;
+  uint8_t* page_cursor;
+  uint8_t* page_limit;          // no record starts past here
+  uint32_t page_records;
+
+  std::thread             writer;
+  std::mutex              writer_lock;
+  std::condition_variable writer_wake; // page handed over, or stopping
+  std::condition_variable writer_done; // page written
+  int32_t                 writer_page;   // page being written, or -1
+  uint32_t                writer_length; // its length
+  bool                    writer_stopping;
+  std::atomic<bool>       write_failed;
+};
@@ -1,4 +1,8 @@
 #include "machine/rosco_m68k.hpp"
+#include "machine/serial_bridge.hpp"
+#include "machine/program_image.hpp"
+#include "machine/symbol_index.hpp"
+#include "machine/sd_card.hpp"
 #include "interface/disassembly.hpp"
 #include "interface/registers.hpp"
 #include "interface/memory.hpp"
@@ -7,6 +11,7 @@
 
 extern "C" {
 #include <stdio.h>
+#include <unistd.h>
 #define TB_OPT_TRUECOLOR
 #define TB_OPT_EGC
 #include <termbox2/termbox.h>
@@ -22,6 +27,11 @@ typedef struct {
   InterfaceButton*      button_multi;
   InterfaceButton*      button_run;
   InterfaceButton*      button_reset;
+  SerialBridge*         bridge_a;
+  SerialBridge*         bridge_b;
+  SdCard*               sd_card;
+  TraceRecorder*        trace;
+  InputLog*             input_log;
   bool                  free_run;
 } app_context;
 
@@ -67,12 +77,63 @@ static void uiReset(void* data) {
 
 static void uiTerminalEvent(uint32_t event_data, void* callback_data) {
   app_context* context = (app_context*)callback_data;
-  context->rosco->duart->serialPortReceive(DUART_68681_PORT_A, (uint8_t)event_data);
+  uint8_t data = (uint8_t)event_data;
+  context->rosco->duart->serialPortQueue(DUART_68681_PORT_A, &data, 1);
 }
 
-static void roscoSerialOutput(uint8_t port, uint8_t transmit_data, void* callback_data) {
+static void usage(const char* name) {
+  printf("usage: %s [-a bridge] [-b bridge] [-t] [-f] [-d image] [-x trace] [-i log | -p log] [-s symbols ...] [program]\n", name);
+  printf("  -a bridge  connect serial port A to the host instead of the terminal view\n");
+  printf("  -b bridge  connect serial port B to the host\n");
+  printf("  bridge is pty, pty:<link path>, or unix:<socket path>\n");
+  printf("  -t         turbo program upload: skip the loader's byte-by-byte read loop\n");
+  printf("  -f         fast SPI: run the program's duartSpi_ routines on the host (needs its symbols)\n");
+  printf("  -d image   SD card disk image, attached to the SPI bus (on chip select B)\n");
+  printf("  -x trace   record every instruction executed to a trace file (fast paths are bypassed while recording)\n");
+  printf("  -i log     record serial input, input port changes, resets, and timer time to log, for replay\n");
+  printf("  -p log     replay a recorded log, without the interface (port A output goes to stdout), until its end;\n");
+  printf("             give the same ROM, program, options, and a copy of the SD card image as it started out\n");
+  printf("  -s symbols ELF file to take more symbols from (ex: the ROM's); may be repeated\n");
+  printf("  program    ELF, S-record, Intel HEX, or raw binary (at 0x%06X) to place in RAM and start\n", PROGRAM_IMAGE_RAW_BASE);
+}
+
+static void roscoSerialOutput(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data) {
   app_context* context = (app_context*)callback_data;
-  context->terminal_a->input(&transmit_data, 1);
+  context->terminal_a->input(transmit_data, length);
+}
+
+static void replaySerialOutput(uint8_t port, const uint8_t* transmit_data, uint32_t length, void* callback_data) {
+  fwrite(transmit_data, 1, length, stdout);
+}
+
+static int replay(app_context* context) {
+  context->rosco->duart->setSerialTransmitterBulk(DUART_68681_PORT_A, replaySerialOutput, context);
+  context->rosco->replayInputs(context->input_log);
+  bool diverged = false;
+  while(!context->rosco->hasExited() && !context->rosco->replayFinished(&diverged)) { context->rosco->run(160000); }
+  context->rosco->replayInputs(NULL);
+  fflush(stdout);
+
+  m68k_registers registers;
+  context->rosco->getRegisters(&registers);
+  if(diverged) {
+    fprintf(stderr, "\nreplay: diverged from the recording at clock %lld, pc 0x%06X\n", (long long)context->rosco->getClock(), registers.pc);
+    return 1;
+  }
+  fprintf(stderr, "\nreplay: %s at clock %lld, pc 0x%06X\n", context->rosco->hasExited() ? "guest exited" : "recording ended",
+          (long long)context->rosco->getClock(), registers.pc);
+  return 0;
+}
+
+// waits for the trace to be written out, so what's reported covers all of it
+static void traceFinish(TraceRecorder* trace, FILE* report) {
+  trace->finish();
+  fprintf(report, "trace: %llu instructions recorded", (unsigned long long)trace->instructions());
+  if(trace->accessesDropped()) {
+    fprintf(report, ", %llu memory accesses left out (over %u in one instruction)", (unsigned long long)trace->accessesDropped(), TRACE_RECORDER_ACCESSES);
+  }
+  fprintf(report, "%s\n", trace->failed() ? " (writing failed)" : "");
+  delete trace;
 }
 
 int main(int argc, char** argv) {
@@ -86,9 +147,39 @@ int main(int argc, char** argv) {
     .button_multi = NULL,
     .button_run   = NULL,
     .button_reset = NULL,
+    .bridge_a     = NULL,
+    .bridge_b     = NULL,
+    .sd_card      = NULL,
+    .trace        = NULL,
+    .input_log    = NULL,
     .free_run     = false,
   };
 
+  const char* bridge_a = NULL;
+  const char* bridge_b = NULL;
+  const char* sd_card = NULL;
+  const char* trace = NULL;
+  const char* input_record = NULL;
+  const char* input_replay = NULL;
+  bool turbo_upload = false;
+  bool fast_spi = false;
+  std::vector<const char*> symbol_paths;
+  int option;
+  while((option = getopt(argc, argv, "a:b:tfd:x:i:p:s:h")) != -1) {
+    switch(option) {
+      case 'a': bridge_a = optarg; break;
+      case 'b': bridge_b = optarg; break;
+      case 't': turbo_upload = true; break;
+      case 'f': fast_spi = true; break;
+      case 'd': sd_card = optarg; break;
+      case 'x': trace = optarg; break;
+      case 'i': input_record = optarg; break;
+      case 'p': input_replay = optarg; break;
+      case 's': symbol_paths.push_back(optarg); break;
+      default:  usage(argv[0]); return (option == 'h') ? 0 : 2;
+    }
+  }
+
   try {
     // context.rosco = new RoscoM68K("rosco_m68k.rom");
     // context.rosco = new RoscoM68K("rom.bin");
@@ -98,24 +189,123 @@ int main(int argc, char** argv) {
     return -1;
   }
 
-  // <test-user-program>
-  FILE* fin = fopen("./program/program.bin", "rb");
-  uint8_t* destination_a = context.rosco->ram + 0x1338;
-  uint8_t* destination_b = context.rosco->ram + 0xBABE;
-  uint8_t buffer[512];
-  size_t read = fread(buffer, 1, 512, fin);
-  while(read) {
-    memcpy(destination_a, buffer, read);
-    memcpy(destination_b, buffer, read);
-    destination_a += read;
-    destination_b += read;
-    read = fread(buffer, 1, 512, fin);
+  ProgramImage* program = NULL;
+  if(optind < argc) {
+    try {
+      program = ProgramImage::load(argv[optind]);
+    } catch(const char* error) {
+      printf("Exception loading program %s: %s\n", argv[optind], error);
+      delete context.rosco;
+      return -1;
+    }
   }
-  fclose(fin);
-  // </test-user-program>
+
+  SymbolIndex symbols;
+  if(program) { symbols.add(program); }
+  for(const char* symbol_path : symbol_paths) {
+    try {
+      ProgramImage* symbol_image = ProgramImage::load(symbol_path);
+      symbols.add(symbol_image);
+      delete symbol_image;
+    } catch(const char* error) {
+      printf("Exception loading symbols %s: %s\n", symbol_path, error);
+      delete program;
+      delete context.rosco;
+      return -1;
+    }
+  }
+  symbols.build();
 
   context.rosco->reset();
-  context.rosco->duart->setSerialTransmitter(DUART_68681_PORT_A, roscoSerialOutput, &context);
+  context.rosco->setTurboUpload(turbo_upload);
+  if(program) {
+    try {
+      program->place(context.rosco);
+    } catch(const char* error) {
+      printf("Exception placing program %s: %s\n", argv[optind], error);
+      delete program;
+      delete context.rosco;
+      return -1;
+    }
+  }
+  if(program && fast_spi) {
+    static const struct { const char* name; rosco_m68k_spi_routine routine; } spi_routines[] = {
+      { "duartSpi_transferByte",   ROSCO_M68K_SPI_TRANSFER_BYTE   },
+      { "duartSpi_readBuffer",     ROSCO_M68K_SPI_READ_BUFFER     },
+      { "duartSpi_writeBuffer",    ROSCO_M68K_SPI_WRITE_BUFFER    },
+      { "duartSpi_transferBuffer", ROSCO_M68K_SPI_TRANSFER_BUFFER },
+    };
+    for(const program_symbol& symbol : program->symbols()) {
+      for(const auto& spi_routine : spi_routines) {
+        if(symbol.function && (symbol.name == spi_routine.name)) { context.rosco->setSpiRoutine(spi_routine.routine, symbol.address); }
+      }
+    }
+  }
+  context.rosco->duart->setSerialTransmitterBulk(DUART_68681_PORT_A, roscoSerialOutput, &context);
+
+  if(sd_card) {
+    try {
+      context.sd_card = new SdCard(sd_card);
+    } catch(const char* error) {
+      printf("Exception opening sd card %s: %s\n", sd_card, error);
+      delete program;
+      delete context.rosco;
+      return -1;
+    }
+    context.rosco->duart->attachSpiDevice(SPI_BUS_SELECT_B, context.sd_card);
+  }
+
+  if(trace) {
+    try {
+      context.trace = TraceRecorder::create(trace, ROSCO_M68K_CLOCK_HZ);
+    } catch(const char* error) {
+      printf("Exception creating trace %s: %s\n", trace, error);
+      delete program;
+      delete context.rosco;
+      delete context.sd_card;
+      return -1;
+    }
+    context.rosco->setTraceRecorder(context.trace);
+  }
+
+  if(input_record || input_replay) {
+    try {
+      context.input_log = input_replay ? InputLog::load(input_replay) : InputLog::create(input_record);
+    } catch(const char* error) {
+      printf("Exception opening input log %s: %s\n", input_replay ? input_replay : input_record, error);
+      delete program;
+      delete context.rosco;
+      delete context.sd_card;
+      delete context.trace;
+      return -1;
+    }
+  }
+  if(context.input_log && context.sd_card) { context.sd_card->setFixedTiming(true); } // how long the host takes to read mustn't show
+  if(input_replay) {
+    int result = replay(&context);
+    delete context.rosco;
+    delete context.sd_card;
+    delete context.input_log;
+    delete program;
+    if(context.trace) { traceFinish(context.trace, stderr); }
+    return result;
+  }
+  if(context.input_log) { context.rosco->recordInputs(context.input_log); }
+
+  try {
+    if(bridge_a) { context.bridge_a = SerialBridge::create(context.rosco->duart, DUART_68681_PORT_A, bridge_a); }
+    if(bridge_b) { context.bridge_b = SerialBridge::create(context.rosco->duart, DUART_68681_PORT_B, bridge_b); }
+  } catch(const char* error) {
+    printf("Exception creating serial bridge: %s\n", error);
+    delete context.bridge_a;
+    delete context.rosco;
+    delete context.sd_card;
+    delete context.trace;
+    delete context.input_log;
+    return -1;
+  }
+  if(context.bridge_a) { printf("serial port A: %s\n", context.bridge_a->path()); }
+  if(context.bridge_b) { printf("serial port B: %s\n", context.bridge_b->path()); }
 
   struct tb_event ui_event;
   tb_init();
@@ -124,6 +314,7 @@ int main(int argc, char** argv) {
   tb_set_clear_attrs(0xFFFFFF, 0x444444);
 
   context.disassembly  = new InterfaceDisassembly(context.rosco, 6, 4, 0, 0, 48);
+  context.disassembly->setSymbols(&symbols);
   context.registers    = new InterfaceRegisters(context.rosco, 49, 0);
   context.memory       = new InterfaceMemory(context.rosco, 0, 13, 11);
   context.terminal_a   = new InterfaceTerminal(80, 0, 80, 24);
@@ -132,7 +323,8 @@ int main(int argc, char** argv) {
   context.button_run   = new InterfaceButton(36, 24, 16, 3, "&Run",      uiFreeRun,    &context);
   context.button_reset = new InterfaceButton(54, 24, 16, 3, "Reset",     uiReset,      &context);
 
-  context.terminal_a->setEventForwarder(uiTerminalEvent, &context);
+  // a bridged port takes its input from the host side only
+  if(!context.bridge_a) { context.terminal_a->setEventForwarder(uiTerminalEvent, &context); }
 
   uiRedraw(&context);
 
@@ -182,8 +374,21 @@ int main(int argc, char** argv) {
   delete context.registers;
   delete context.disassembly;
   tb_shutdown();
+  printf("\n");
+  SerialBridge* bridges[] = { context.bridge_a, context.bridge_b };
+  for(uint8_t port=DUART_68681_PORT_A; port<=DUART_68681_PORT_B; ++port) {
+    if(bridges[port] && bridges[port]->transmitDropped()) {
+      printf("serial port %c: %llu transmitted bytes dropped (client not keeping up)\n", 'A' + port, (unsigned long long)bridges[port]->transmitDropped());
+    }
+  }
+  delete context.bridge_b;
+  delete context.bridge_a;
+  context.rosco->recordInputs(NULL);
   delete context.rosco;
+  delete context.sd_card;
+  delete context.input_log;
+  delete program;
 
-  printf("\n");
+  if(context.trace) { traceFinish(context.trace, stdout); }
   return 0;
 }
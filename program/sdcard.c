@@ -261,13 +261,8 @@ bool sdCard_read(SdCard* card, uint32_t block_number, uint8_t* block_buffer) {
   return true;
 }
 
-bool sdCard_write(SdCard* card, uint32_t block_number, uint8_t* block_buffer) {
-  sdCardSpi_command(card, 24, block_number, 0x1);
-  if(card->last_status_byte > 0x00) { return false; }
-  duartSpi_transferByte(0xFE); // data start token
-  for(uint16_t idx=0; idx<512; ++idx) {
-    duartSpi_transferByte(block_buffer[idx]);
-  }
+// after a data block is sent: wait for the card's data response, then for it to finish programming
+static bool sdCardSpi_waitForDataAccepted() {
   uint8_t response = 0xFF;
   for(uint16_t attempts=0; attempts<8192; ++attempts) { // 250ms time out (very rough; should be at least 250)
     response = duartSpi_transferByte(0xFF);
@@ -281,3 +276,67 @@ bool sdCard_write(SdCard* card, uint32_t block_number, uint8_t* block_buffer) {
   if(response == 0x00) { return false; }
   return true;
 }
+
+bool sdCard_write(SdCard* card, uint32_t block_number, uint8_t* block_buffer) {
+  sdCardSpi_command(card, 24, block_number, 0x1);
+  if(card->last_status_byte > 0x00) { return false; }
+  duartSpi_transferByte(0xFE); // data start token
+  for(uint16_t idx=0; idx<512; ++idx) {
+    duartSpi_transferByte(block_buffer[idx]);
+  }
+  return sdCardSpi_waitForDataAccepted();
+}
+
+bool sdCard_readBlocks(SdCard* card, uint32_t block_number, uint32_t block_count, uint8_t* block_buffer) {
+  if(block_count < 2) { return (block_count == 0) || sdCard_read(card, block_number, block_buffer); }
+
+  // one command for the whole run; the card streams blocks until told to stop
+  sdCardSpi_command(card, 18, block_number, 0x1);
+  if(card->last_status_byte > 0x00) { return false; }
+  bool success = true;
+  while(block_count) {
+    if(!sdCardSpi_waitForStartToken()) { success = false; break; }
+    duartSpi_readBuffer(block_buffer, 512);
+    // ignore CRC bytes
+    duartSpi_transferByte(0xFF);
+    duartSpi_transferByte(0xFF);
+    block_buffer += 512;
+    --block_count;
+  }
+
+  // CMD12 goes out while the card is still streaming, so whatever comes back meanwhile (and the stuff byte after) is data;
+  // only then the response, then (maybe) busy
+  uint8_t stop_transmission[6] = { 0x40 + 12, 0x00, 0x00, 0x00, 0x00, 0x61 };
+  duartSpi_writeBuffer(stop_transmission, 6);
+  duartSpi_transferByte(0xFF);
+  card->last_status_byte = sdCardSpi_readLeadingResponseByte();
+  for(uint16_t attempts=0; attempts<8192; ++attempts) {
+    if(duartSpi_transferByte(0xFF) != 0x00) { break; }
+  }
+  return success && (card->last_status_byte == 0x00);
+}
+
+bool sdCard_writeBlocks(SdCard* card, uint32_t block_number, uint32_t block_count, uint8_t* block_buffer) {
+  if(block_count < 2) { return (block_count == 0) || sdCard_write(card, block_number, block_buffer); }
+
+  sdCardSpi_command(card, 25, block_number, 0x1);
+  if(card->last_status_byte > 0x00) { return false; }
+  bool success = true;
+  while(block_count) {
+    duartSpi_transferByte(0xFC); // multiple block data start token
+    duartSpi_writeBuffer(block_buffer, 512);
+    if(!sdCardSpi_waitForDataAccepted()) { success = false; break; }
+    block_buffer += 512;
+    --block_count;
+  }
+
+  // stop token; a byte later, the card is busy until it's done with the last block
+  duartSpi_transferByte(0xFD);
+  duartSpi_transferByte(0xFF);
+  uint8_t response = 0x00;
+  for(uint16_t attempts=0; attempts<8192; ++attempts) {
+    response = duartSpi_transferByte(0xFF);
+    if(response != 0x00) { break; }
+  }
+  return success && (response != 0x00);
+}
@@ -31,6 +31,9 @@ bool sdCard_select    (SdCard* card);
 bool sdCard_deselect  (SdCard* card);
 bool sdCard_read      (SdCard* card, uint32_t block_number, uint8_t* block_buffer);
 bool sdCard_write     (SdCard* card, uint32_t block_number, uint8_t* block_buffer);
+// contiguous runs of blocks, in a single command (CMD18/CMD25); a count of 1 falls back to sdCard_read/sdCard_write
+bool sdCard_readBlocks (SdCard* card, uint32_t block_number, uint32_t block_count, uint8_t* block_buffer);
+bool sdCard_writeBlocks(SdCard* card, uint32_t block_number, uint32_t block_count, uint8_t* block_buffer);
 
 void sdCard_writeErrorsToSerial(SdCard* card, duart_serial_port serial_port);
 
@@ -0,0 +1,85 @@
+#include "test.hpp"
+
+// runs delay-loop elision by hand, to count the instructions it takes over
+class DelayLoopProbe : public RoscoM68K {
+public:
+  DelayLoopProbe() : RoscoM68K(testRom()) {}
+
+  // as run(), without the other fast paths
+  uint64_t runCountingElided() {
+    uint64_t elided = 0;
+    while(this->read16(this->reg.pc) != 0x4E72) { // up to the STOP
+      elided += this->elideDelayLoop(0xFFFFFFFF);
+      this->execute();
+      ++this->instruction_count;
+    }
+    return elided;
+  }
+};
+
+typedef struct {
+  const char* name;
+  uint16_t    code[4];      // the loop; STOP #$2700 follows
+  uint32_t    code_words;
+  uint8_t     counter;      // data register counting down
+  uint32_t    start;        // its value going in (bits above the operation size must come through untouched)
+  uint32_t    loop_length;  // instructions per iteration
+  uint32_t    instructions; // executed by the whole loop
+} delay_loop_shape;
+
+static const delay_loop_shape shapes[] = {
+  { "DBF D0,*",             { 0x51C8, 0xFFFE },         2, 0, 0x5A000BB8, 1,  3001 },
+  { "DBEQ D1,*",            { 0x57C9, 0xFFFE },         2, 1, 0x5A0003E8, 1,  1001 }, // Z clear going in
+  { "SUBQ.B #1,D2; BNE.S",  { 0x5302, 0x66FC },         2, 2, 0x5A5A5AC8, 2,   400 },
+  { "SUBQ.W #2,D3; BNE.S",  { 0x5543, 0x66FC },         2, 3, 0x5A000FA0, 2,  4000 },
+  { "SUBQ.L #8,D4; BNE.W",  { 0x5184, 0x6600, 0xFFFC }, 3, 4, 0x00013880, 2, 20000 },
+};
+
+static void place(RoscoM68K* rosco, const delay_loop_shape* shape) {
+  uint16_t code[8];
+  memcpy(code, shape->code, shape->code_words * sizeof(uint16_t));
+  code[shape->code_words + 0] = 0x4E72; // STOP #$2700
+  code[shape->code_words + 1] = 0x2700;
+  rosco->reset();
+  testPoke(rosco, TEST_CODE_BASE, code, shape->code_words + 2);
+  rosco->debugger.jump(TEST_CODE_BASE);
+  rosco->setD(shape->counter, shape->start);
+  rosco->setSR(0x2700); // supervisor, interrupts masked, flags clear
+}
+
+int main(int argc, char** argv) {
+  for(const delay_loop_shape& shape : shapes) {
+    printf("%s\n", shape.name);
+
+    RoscoM68K* plain = new RoscoM68K(testRom());
+    plain->setDelayLoopElision(false);
+    place(plain, &shape);
+    int64_t clock_start = plain->getClock();
+    testRunInstructions(plain, shape.instructions, 1); // leaves the processor at the STOP (which, run, still takes cycles)
+    TEST_EQUAL(plain->getPC(), TEST_CODE_BASE + (shape.code_words * 2));
+
+    // whole run() slices, and slices that stop part way through iterations
+    for(uint32_t slice : { (uint32_t)TEST_RUN_SLICE, 7u }) {
+      RoscoM68K* elided = new RoscoM68K(testRom());
+      place(elided, &shape);
+      testRunInstructions(elided, shape.instructions, slice);
+      TEST_CHECK(testSameRegisters(plain, elided));
+      TEST_EQUAL(elided->getClock(), plain->getClock());
+      delete elided;
+    }
+
+    // all but the first (measured) and last (falling through) iterations are elided
+    DelayLoopProbe* probe = new DelayLoopProbe();
+    place(probe, &shape);
+    uint64_t elided_instructions = probe->runCountingElided();
+    TEST_EQUAL(elided_instructions, shape.instructions - (2 * shape.loop_length));
+    TEST_CHECK(testSameRegisters(plain, probe));
+    TEST_EQUAL(probe->getClock(), plain->getClock());
+    TEST_CHECK(plain->getClock() > clock_start);
+    TEST_EQUAL(plain->getD(shape.counter) & 0xFF000000, shape.start & 0xFF000000);
+
+    delete probe;
+    delete plain;
+  }
+  return testFinish("delay_loop");
+}
@@ -0,0 +1,56 @@
+#include "test.hpp"
+#include "../machine/spi_device.hpp"
+#include <vector>
+
+#define DUART_OPCR      0x0D
+#define DUART_OPR_SET   0x0E // pin low
+#define DUART_OPR_CLEAR 0x0F // pin high
+
+// notes whether it's selected, and keeps what it was sent
+class SelectDevice : public SpiDevice {
+public:
+  bool selected = false;
+  std::vector<uint8_t> received;
+  void    spiReset() override { this->received.clear(); }
+  void    spiSelect(bool selected) override { this->selected = selected; }
+  uint8_t spiOutput() override { return 0x5A; }
+  void    spiInput(uint8_t data) override { this->received.push_back(data); }
+};
+
+int main(int argc, char** argv) {
+  RoscoM68K* rosco = new RoscoM68K(testRom());
+  rosco->reset();
+  SelectDevice device;
+  rosco->duart->attachSpiDevice(SPI_BUS_SELECT_A, &device);
+  rosco->duart->busWrite(DUART_OPR_SET, SPI_BUS_PIN_CLOCK);    // SCK low
+  rosco->duart->busWrite(DUART_OPR_SET, SPI_BUS_PIN_SELECT_A); // OP2 low: select
+  TEST_CHECK(device.selected);
+
+  // OPCR bits 2-3 give OP3 to the counter/timer; OP2, chip select A, still follows OPR
+  printf("OP3 as counter/timer output\n");
+  rosco->duart->busWrite(DUART_OPCR, 0x04);
+  TEST_CHECK(device.selected);
+  uint8_t output = 0xC3, input = 0x00;
+  TEST_CHECK(rosco->duart->spiTransfer(&output, &input, 1));
+  TEST_EQUAL(input, 0x5A);
+  TEST_EQUAL(device.received.size(), 1);
+
+  // OPCR bits 0-1 give OP2 to a serial clock; it no longer selects anything
+  printf("OP2 as serial clock output\n");
+  rosco->duart->busWrite(DUART_OPCR, 0x01);
+  TEST_CHECK(!device.selected);
+  TEST_CHECK(!rosco->duart->spiTransfer(&output, &input, 1));
+
+  // OPCR bits 4-7 each give one of OP4-OP7 to an interrupt output (OP7 is chip select B)
+  printf("OP7 as interrupt output\n");
+  rosco->duart->busWrite(DUART_OPCR, 0x00);
+  TEST_CHECK(device.selected);
+  rosco->duart->busWrite(DUART_OPCR, 0x80);
+  TEST_CHECK(device.selected);
+  TEST_CHECK(!rosco->duart->spiTransfer(&output, &input, 1));
+  rosco->duart->busWrite(DUART_OPCR, 0x00);
+  TEST_CHECK(rosco->duart->spiTransfer(&output, &input, 1));
+
+  delete rosco;
+  return testFinish("duart_output_port");
+}
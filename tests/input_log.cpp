@@ -0,0 +1,138 @@
+#include "test.hpp"
+#include "../machine/input_log.hpp"
+#include <thread>
+#include <atomic>
+
+#define ECHO_BUFFER  0x010000
+#define FEED_BYTES   4000
+#define RECORD_RUNS  400
+
+// takes in port A a byte at a time, keeping every byte, and sums the input port as it goes
+static const uint16_t echo[] = {
+  0x13FC, 0x0005, 0x00F0, 0x0005, //       move.b #$05,CRA ; enable receiver and transmitter
+  0x41F9, 0x0001, 0x0000,         //       lea    ECHO_BUFFER,A0
+  0x0839, 0x0000, 0x00F0, 0x0003, // loop: btst.b #0,SRA
+  0x670A,                         //       beq.s  idle
+  0x1039, 0x00F0, 0x0007,         //       move.b RHRA,D0
+  0x10C0,                         //       move.b D0,(A0)+
+  0xD280,                         //       add.l  D0,D1
+  0x1439, 0x00F0, 0x001B,         // idle: move.b IP,D2
+  0xD682,                         //       add.l  D2,D3
+  0x60E2,                         //       bra.s  loop
+};
+
+// sends bytes in bursts, from another thread, as a bridge would: when they arrive depends on the host
+static void feed(RoscoM68K* rosco, std::atomic<bool>* stop) {
+  uint8_t  data[64];
+  uint32_t sent = 0;
+  uint32_t seed = (uint32_t)getpid();
+  while((sent < FEED_BYTES) && !stop->load()) {
+    uint32_t length = 1 + ((seed = (seed * 1103515245) + 12345) >> 16) % sizeof(data);
+    for(uint32_t index=0; index<length; ++index) { data[index] = (uint8_t)(sent + index); }
+    rosco->duart->serialPortQueue(DUART_68681_PORT_A, data, length);
+    sent += length;
+    usleep(50);
+  }
+}
+
+// replays a log on a fresh machine, until the log is over
+static RoscoM68K* replay(InputLog* log, bool* diverged) {
+  RoscoM68K* rosco = testMachine(echo, sizeof(echo) / sizeof(echo[0]));
+  rosco->replayInputs(log);
+  for(uint32_t run=0; (run < 100000) && !rosco->replayFinished(diverged); ++run) { rosco->run(997); }
+  rosco->replayInputs(NULL);
+  return rosco;
+}
+
+// copies a log, moving the clock of its n-th serial event on by a cycle
+static void tamper(const char* from_path, const char* to_path, uint32_t serial_event) {
+  FILE* from = fopen(from_path, "r");
+  FILE* to   = fopen(to_path, "w");
+  if(!from || !to) {
+    printf("error copying input log to %s\n", to_path);
+    exit(2);
+  }
+  char line[4096];
+  uint32_t serial_events = 0;
+  while(fgets(line, sizeof(line), from)) {
+    unsigned long long instruction;
+    long long clock;
+    int consumed = 0;
+    if(strstr(line, " serial ") && (sscanf(line, "%llu %lld %n", &instruction, &clock, &consumed) == 2) && (serial_events++ == serial_event)) {
+      fprintf(to, "%llu %lld %s", instruction, clock + 1, line + consumed);
+    } else {
+      fputs(line, to);
+    }
+  }
+  fclose(from);
+  fclose(to);
+}
+
+int main(int argc, char** argv) {
+  char log_path[64], tampered_path[64];
+  snprintf(log_path,      sizeof(log_path),      "/tmp/mremu-test-%d.inputs",          (int)getpid());
+  snprintf(tampered_path, sizeof(tampered_path), "/tmp/mremu-test-%d.tampered.inputs", (int)getpid());
+
+  // record: bytes from a thread, run() slices of changing length, the input port changed between slices, and a reset near the end
+  RoscoM68K* recorded = testMachine(echo, sizeof(echo) / sizeof(echo[0]));
+  InputLog* log = NULL;
+  try {
+    log = InputLog::create(log_path);
+  } catch(const char* error) {
+    printf("error creating input log: %s\n", error);
+    return 2;
+  }
+  recorded->recordInputs(log);
+  std::atomic<bool> stop(false);
+  std::thread feeder(feed, recorded, &stop);
+  uint32_t seed = 12345;
+  for(uint32_t run=0; run<RECORD_RUNS; ++run) {
+    seed = (seed * 1103515245) + 12345;
+    recorded->run(1 + ((seed >> 16) % 5000));
+    if(!(run % 37)) { recorded->duart->setInputPort((uint8_t)(seed >> 8)); }
+    if(run == (RECORD_RUNS - 20)) { recorded->reset(); }
+  }
+  stop.store(true);
+  feeder.join();
+  recorded->recordInputs(NULL); // logs the end
+  delete log;
+  TEST_EQUAL(recorded->ram[ECHO_BUFFER + 100], 100); // took bytes in
+
+  // replay: the same inputs at the same points, with nothing coming in from outside
+  InputLog* loaded = NULL;
+  try {
+    loaded = InputLog::load(log_path);
+  } catch(const char* error) {
+    printf("error loading input log: %s\n", error);
+    unlink(log_path);
+    return 2;
+  }
+  uint32_t serial_events = 0;
+  for(const input_log_event& event : loaded->events()) { serial_events += (event.kind == INPUT_LOG_SERIAL); }
+  TEST_CHECK(serial_events > 1);
+  TEST_EQUAL(loaded->events().back().kind, INPUT_LOG_END);
+
+  bool diverged = true;
+  RoscoM68K* replayed = replay(loaded, &diverged);
+  TEST_CHECK(!diverged);
+  TEST_CHECK(testSameRegisters(recorded, replayed));
+  TEST_EQUAL(replayed->getClock(), recorded->getClock());
+  TEST_CHECK(testSameRam(recorded, replayed));
+  delete replayed;
+  delete loaded;
+
+  // a machine that reaches an event at a different clock has left the recorded path
+  tamper(log_path, tampered_path, serial_events / 2);
+  InputLog* tampered = InputLog::load(tampered_path);
+  diverged = false;
+  replayed = replay(tampered, &diverged);
+  TEST_CHECK(diverged);
+  TEST_CHECK(replayed->getClock() < recorded->getClock());
+  delete replayed;
+  delete tampered;
+
+  unlink(log_path);
+  unlink(tampered_path);
+  delete recorded;
+  return testFinish("input_log");
+}
@@ -0,0 +1,167 @@
+#include "test.hpp"
+#include "../machine/program_image.hpp"
+
+// a minimal ELF: one PT_LOAD segment (a STOP), and a symbol table with two symbols
+#define ELF_PROGRAM_HEADERS 52
+#define ELF_SECTION_HEADERS (ELF_PROGRAM_HEADERS + 32)
+#define ELF_CODE            (ELF_SECTION_HEADERS + (3 * 40))
+#define ELF_SYMBOLS         (ELF_CODE + 4)
+#define ELF_STRINGS         (ELF_SYMBOLS + (3 * 16))
+#define ELF_LENGTH          (ELF_STRINGS + 16)
+
+static void put16(uint8_t* data, uint16_t value) {
+  data[0] = (uint8_t)(value >> 8);
+  data[1] = (uint8_t)value;
+}
+
+static void put32(uint8_t* data, uint32_t value) {
+  put16(data, (uint16_t)(value >> 16));
+  put16(data + 2, (uint16_t)value);
+}
+
+static void elfImage(uint8_t* elf) {
+  memset(elf, 0, ELF_LENGTH);
+  memcpy(elf, "\x7F" "ELF", 4);
+  elf[4] = 1; // 32 bit
+  elf[5] = 2; // big-endian
+  elf[6] = 1;
+  put16(elf + 16, 2); // executable
+  put16(elf + 18, 4); // m68k
+  put32(elf + 20, 1);
+  put32(elf + 24, TEST_CODE_BASE);
+  put32(elf + 28, ELF_PROGRAM_HEADERS);
+  put32(elf + 32, ELF_SECTION_HEADERS);
+  put16(elf + 40, 52);
+  put16(elf + 42, 32);
+  put16(elf + 44, 1);
+  put16(elf + 46, 40);
+  put16(elf + 48, 3);
+
+  uint8_t* header = elf + ELF_PROGRAM_HEADERS;
+  put32(header +  0, 1); // PT_LOAD
+  put32(header +  4, ELF_CODE);
+  put32(header +  8, TEST_CODE_BASE);
+  put32(header + 12, TEST_CODE_BASE);
+  put32(header + 16, 4);
+  put32(header + 20, 4);
+
+  uint8_t* symbols = elf + ELF_SECTION_HEADERS + 40;
+  put32(symbols +  4, 2); // SHT_SYMTAB
+  put32(symbols + 16, ELF_SYMBOLS);
+  put32(symbols + 20, 3 * 16);
+  put32(symbols + 24, 2);
+  put32(symbols + 36, 16);
+  uint8_t* strings = elf + ELF_SECTION_HEADERS + 80;
+  put32(strings +  4, 3); // SHT_STRTAB
+  put32(strings + 16, ELF_STRINGS);
+  put32(strings + 20, 16);
+
+  put32(elf + ELF_CODE, 0x4E722700); // STOP #$2700
+
+  uint8_t* symbol = elf + ELF_SYMBOLS + 16; // (entry 0 is reserved)
+  put32(symbol + 0, 1);
+  put32(symbol + 4, TEST_CODE_BASE);
+  put32(symbol + 8, 4);
+  symbol[12] = 0x12; // global function
+  put16(symbol + 14, 1);
+  symbol += 16;
+  put32(symbol + 0, 7);
+  put32(symbol + 4, TEST_CODE_BASE + 2);
+  symbol[12] = 0x10; // global, no type
+  put16(symbol + 14, 1);
+  memcpy(elf + ELF_STRINGS, "\0start\0middle\0", 14);
+}
+
+// writes an image out and loads it; NULL if loading threw
+static ProgramImage* loadElf(const uint8_t* elf, const char* path, const char** error) {
+  FILE* file = fopen(path, "wb");
+  if(!file || (fwrite(elf, 1, ELF_LENGTH, file) != ELF_LENGTH)) {
+    printf("error writing %s\n", path);
+    exit(2);
+  }
+  fclose(file);
+  *error = NULL;
+  try {
+    return ProgramImage::load(path);
+  } catch(const char* thrown) {
+    *error = thrown;
+    return NULL;
+  }
+}
+
+int main(int argc, char** argv) {
+  char elf_path[64];
+  snprintf(elf_path, sizeof(elf_path), "/tmp/mremu-test-%d.elf", (int)getpid());
+  uint8_t elf[ELF_LENGTH];
+  const char* error;
+
+  printf("well formed\n");
+  elfImage(elf);
+  ProgramImage* program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(program);
+  if(program) {
+    TEST_EQUAL(program->format(), PROGRAM_IMAGE_ELF);
+    TEST_EQUAL(program->entry(), TEST_CODE_BASE);
+    TEST_EQUAL(program->segments().size(), 1);
+    TEST_EQUAL(program->symbols().size(), 2);
+    if(program->symbols().size() == 2) {
+      TEST_CHECK(program->symbols()[0].name == "start");
+      TEST_CHECK(program->symbols()[0].function);
+      TEST_CHECK(program->symbols()[1].name == "middle");
+      TEST_EQUAL(program->symbols()[1].address, TEST_CODE_BASE + 2);
+    }
+    RoscoM68K* rosco = new RoscoM68K(testRom());
+    rosco->reset();
+    program->place(rosco);
+    TEST_EQUAL(rosco->getPC(), TEST_CODE_BASE);
+    TEST_EQUAL(rosco->ram[TEST_CODE_BASE], 0x4E);
+    delete rosco;
+    delete program;
+  }
+
+  // absolute symbols are constants (ex: sizes, register offsets), not addresses
+  printf("absolute symbol\n");
+  elfImage(elf);
+  put16(elf + ELF_SYMBOLS + 32 + 14, 0xFFF1); // SHN_ABS
+  program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(program);
+  if(program) {
+    TEST_EQUAL(program->symbols().size(), 1);
+    delete program;
+  }
+
+  // offset + size checks must hold where the sum doesn't fit in 32 bits
+  printf("symbol entry size wrapping the symbol offset\n");
+  elfImage(elf);
+  put32(elf + ELF_SECTION_HEADERS + 40 + 36, 0x80000000); // first entry at 0x80000000, which plus its size is 0
+  program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(program);
+  if(program) {
+    TEST_EQUAL(program->symbols().size(), 0);
+    delete program;
+  }
+
+  printf("symbol table offset wrapping\n");
+  elfImage(elf);
+  put32(elf + ELF_SECTION_HEADERS + 40 + 16, 0xFFFFFFF0);
+  program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(!program && error && !strcmp(error, "invalid ELF symbol table"));
+  delete program;
+
+  printf("segment offset wrapping\n");
+  elfImage(elf);
+  put32(elf + ELF_PROGRAM_HEADERS + 4, 0xFFFFFFFE);
+  program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(!program && error && !strcmp(error, "invalid ELF program segment"));
+  delete program;
+
+  printf("segment wrapping the bus\n");
+  elfImage(elf);
+  put32(elf + ELF_PROGRAM_HEADERS + 12, 0xFFFFFFFE);
+  program = loadElf(elf, elf_path, &error);
+  TEST_CHECK(!program && error && !strcmp(error, "ELF program segment outside of 24 bit bus"));
+  delete program;
+
+  unlink(elf_path);
+  return testFinish("program_image");
+}
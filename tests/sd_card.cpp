@@ -0,0 +1,212 @@
+#include "test.hpp"
+#include "../machine/sd_card.hpp"
+
+#define IMAGE_BLOCKS 2048
+
+// the SPI bus from the guest's side: each byte sent clocks in the one the card had ready
+class SdCardHost {
+public:
+  SdCardHost(SdCard* card) {
+    this->card = card;
+    this->card->spiSelect(true);
+    this->ready = this->card->spiOutput();
+  }
+
+  uint8_t exchange(uint8_t sent) {
+    uint8_t received = this->ready;
+    this->card->spiInput(sent);
+    this->ready = this->card->spiOutput();
+    return received;
+  }
+
+  // sends a command, and returns its R1 (0xFF if none came)
+  uint8_t command(uint8_t index, uint32_t argument) {
+    const uint8_t bytes[6] = { (uint8_t)(0x40 | index), (uint8_t)(argument >> 24), (uint8_t)(argument >> 16), (uint8_t)(argument >> 8), (uint8_t)argument, 0x01 };
+    for(uint8_t byte : bytes) { this->exchange(byte); }
+    for(uint32_t attempt=0; attempt<8; ++attempt) {
+      uint8_t r1 = this->exchange(0xFF);
+      if(r1 != 0xFF) { return r1; }
+    }
+    return 0xFF;
+  }
+
+  // waits for a data token, as program/sdcard.c does; returns it, and counts the bytes ahead of it
+  uint8_t token(uint32_t* waited) {
+    *waited = 0;
+    for(uint32_t attempt=0; attempt<4096; ++attempt) {
+      uint8_t token = this->exchange(0xFF);
+      if(token != 0xFF) { return token; }
+      ++*waited;
+    }
+    return 0xFF;
+  }
+
+  // reads a block after its data token, checking its CRC
+  bool block(uint8_t* data) {
+    for(uint32_t index=0; index<SD_CARD_BLOCK_SIZE; ++index) { data[index] = this->exchange(0xFF); }
+    uint16_t crc = (uint16_t)(this->exchange(0xFF) << 8);
+    crc |= this->exchange(0xFF);
+    uint16_t expected = 0;
+    for(uint32_t index=0; index<SD_CARD_BLOCK_SIZE; ++index) {
+      expected ^= (uint16_t)(data[index] << 8);
+      for(uint8_t bit=0; bit<8; ++bit) { expected = (expected & 0x8000) ? ((expected << 1) ^ 0x1021) : (expected << 1); }
+    }
+    return crc == expected;
+  }
+
+  // as program/sdcard.c's sdCard_readBlocks(): CMD18, a token and block for each, then CMD12 sent while the card is still streaming
+  bool readBlocks(uint32_t block, uint32_t count, uint8_t* data) {
+    if(this->command(18, block) != 0x00) { return false; }
+    bool success = true;
+    uint32_t waited;
+    for(; count; --count, data += SD_CARD_BLOCK_SIZE) {
+      if((this->token(&waited) != 0xFE) || !this->block(data)) { success = false; break; }
+    }
+    const uint8_t stop_transmission[6] = { 0x40 + 12, 0x00, 0x00, 0x00, 0x00, 0x61 };
+    for(uint8_t byte : stop_transmission) { this->exchange(byte); }
+    this->exchange(0xFF); // stuff byte
+    uint8_t r1 = 0xFF;
+    for(uint32_t attempt=0; (attempt < 8) && (r1 == 0xFF); ++attempt) { r1 = this->exchange(0xFF); }
+    for(uint32_t attempt=0; (attempt < 8192) && !this->exchange(0xFF); ++attempt) {} // busy
+    return success && (r1 == 0x00);
+  }
+
+  // as sdCard_writeBlocks(): CMD25, a start token and block for each (the card's CRC bytes are the first of the wait), then the stop token
+  bool writeBlocks(uint32_t block, uint32_t count, const uint8_t* data) {
+    if(this->command(25, block) != 0x00) { return false; }
+    bool success = true;
+    for(; count; --count, data += SD_CARD_BLOCK_SIZE) {
+      this->exchange(0xFC);
+      for(uint32_t index=0; index<SD_CARD_BLOCK_SIZE; ++index) { this->exchange(data[index]); }
+      if(!this->dataAccepted()) { success = false; break; }
+    }
+    this->exchange(0xFD);
+    this->exchange(0xFF);
+    uint8_t response = 0x00;
+    for(uint32_t attempt=0; (attempt < 8192) && !response; ++attempt) { response = this->exchange(0xFF); }
+    return success && (response != 0x00);
+  }
+
+  // after a block: the card's data response, then busy
+  bool dataAccepted() {
+    uint8_t response = 0xFF;
+    for(uint32_t attempt=0; (attempt < 8192) && (response == 0xFF); ++attempt) { response = this->exchange(0xFF); }
+    if((response & 0x1F) != 0x05) { return false; }
+    response = 0x00; // then busy until the block is written
+    for(uint32_t attempt=0; (attempt < 8192) && !response; ++attempt) { response = this->exchange(0xFF); }
+    return response != 0x00;
+  }
+
+  bool initialize() {
+    if(this->command(0, 0) != 0x01) { return false; }
+    for(uint32_t attempt=0; attempt<4; ++attempt) {
+      this->command(55, 0);
+      if(this->command(41, 0x40000000) == 0x00) { return true; }
+    }
+    return false;
+  }
+
+  SdCard* card;
+  uint8_t ready;
+};
+
+static uint8_t imageByte(uint32_t block, uint32_t index) {
+  return (uint8_t)((block * 7) + (index * 13) + (index >> 8));
+}
+
+static void imageCreate(const char* path) {
+  FILE* file = fopen(path, "wb");
+  uint8_t data[SD_CARD_BLOCK_SIZE];
+  for(uint32_t block=0; file && (block<IMAGE_BLOCKS); ++block) {
+    for(uint32_t index=0; index<SD_CARD_BLOCK_SIZE; ++index) { data[index] = imageByte(block, index); }
+    if(fwrite(data, 1, sizeof(data), file) != sizeof(data)) { break; }
+  }
+  if(!file || (ftell(file) != (IMAGE_BLOCKS * SD_CARD_BLOCK_SIZE))) {
+    printf("error creating %s\n", path);
+    exit(2);
+  }
+  fclose(file);
+}
+
+static bool blockMatches(const uint8_t* data, uint32_t block) {
+  for(uint32_t index=0; index<SD_CARD_BLOCK_SIZE; ++index) {
+    if(data[index] != imageByte(block, index)) { return false; }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  char image_path[64];
+  snprintf(image_path, sizeof(image_path), "/tmp/mremu-test-%d.img", (int)getpid());
+  imageCreate(image_path);
+  uint8_t data[SD_CARD_BLOCK_SIZE];
+  uint32_t waited;
+
+  // fixed timing: the token comes the same number of bytes after R1 every time, whatever the host
+  for(bool use_io_uring : { true, false }) {
+    printf("single block reads, fixed timing (%s)\n", use_io_uring ? "io_uring, if available" : "threads");
+    SdCard* card = new SdCard(image_path, use_io_uring);
+    card->setFixedTiming(true);
+    SdCardHost host(card);
+    TEST_CHECK(host.initialize());
+    for(uint32_t block : { 0u, 5u, 1000u, IMAGE_BLOCKS - 1u }) {
+      TEST_EQUAL(host.command(17, block), 0x00);
+      TEST_EQUAL(host.token(&waited), 0xFE);
+      TEST_EQUAL(waited, SD_CARD_READ_ACCESS + 1);
+      TEST_CHECK(host.block(data));
+      TEST_CHECK(blockMatches(data, block));
+    }
+    TEST_EQUAL(host.command(17, IMAGE_BLOCKS), 0x20); // address error
+    delete card;
+  }
+
+  // otherwise a host still reading holds the token back, for a bounded count of bytes; the guest carries on clocking
+  printf("single block reads, paced by the host\n");
+  SdCard* card = new SdCard(image_path);
+  SdCardHost host(card);
+  TEST_CHECK(host.initialize());
+  for(uint32_t block=0; block<64; ++block) {
+    TEST_EQUAL(host.command(17, block * 31), 0x00);
+    TEST_EQUAL(host.token(&waited), 0xFE);
+    TEST_CHECK((waited >= (SD_CARD_READ_ACCESS + 1)) && (waited <= (SD_CARD_READ_ACCESS + 1 + SD_CARD_READ_HOLD)));
+    TEST_CHECK(host.block(data));
+    TEST_CHECK(blockMatches(data, block * 31));
+  }
+  delete card;
+
+  // multiple block runs, as sdCard_readBlocks()/sdCard_writeBlocks() stream them
+  printf("multiple block reads and writes\n");
+  card = new SdCard(image_path);
+  card->setFixedTiming(true);
+  SdCardHost stream(card);
+  TEST_CHECK(stream.initialize());
+  uint8_t run[8 * SD_CARD_BLOCK_SIZE];
+  TEST_CHECK(stream.readBlocks(100, 8, run));
+  for(uint32_t block=0; block<8; ++block) { TEST_CHECK(blockMatches(run + (block * SD_CARD_BLOCK_SIZE), 100 + block)); }
+
+  // streamed off the end of the card: the blocks that exist, then an out of range error token
+  memset(run, 0x00, sizeof(run));
+  TEST_CHECK(!stream.readBlocks(IMAGE_BLOCKS - 2, 3, run));
+  TEST_CHECK(blockMatches(run, IMAGE_BLOCKS - 2));
+  TEST_CHECK(blockMatches(run + SD_CARD_BLOCK_SIZE, IMAGE_BLOCKS - 1));
+
+  for(uint32_t index=0; index<sizeof(run); ++index) { run[index] = (uint8_t)~imageByte(200 + (index / SD_CARD_BLOCK_SIZE), index % SD_CARD_BLOCK_SIZE); }
+  TEST_CHECK(stream.writeBlocks(200, 5, run));
+  uint8_t back[8 * SD_CARD_BLOCK_SIZE];
+  TEST_CHECK(stream.readBlocks(199, 7, back));
+  TEST_CHECK(blockMatches(back, 199));
+  TEST_CHECK(!memcmp(back + SD_CARD_BLOCK_SIZE, run, 5 * SD_CARD_BLOCK_SIZE));
+  TEST_CHECK(blockMatches(back + (6 * SD_CARD_BLOCK_SIZE), 205));
+  TEST_EQUAL(stream.command(13, 0), 0x00);
+  TEST_EQUAL(stream.exchange(0xFF), 0x00); // no write error
+  delete card;
+
+  // and the blocks are on the image
+  FILE* image = fopen(image_path, "rb");
+  TEST_CHECK(image && !fseek(image, 200 * SD_CARD_BLOCK_SIZE, SEEK_SET) && (fread(back, 1, 5 * SD_CARD_BLOCK_SIZE, image) == (5 * SD_CARD_BLOCK_SIZE)));
+  TEST_CHECK(!memcmp(back, run, 5 * SD_CARD_BLOCK_SIZE));
+  if(image) { fclose(image); }
+
+  unlink(image_path);
+  return testFinish("sd_card");
+}
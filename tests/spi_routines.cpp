@@ -0,0 +1,241 @@
+#include "test.hpp"
+#include "../machine/spi_device.hpp"
+#include <vector>
+
+#define TRANSFER_BYTE  0x003000
+#define READ_BUFFER    0x003100
+#define WRITE_BUFFER   0x003200
+#define SEND_DATA      0x004000
+#define RESULTS        0x004100
+#define RECEIVE_FIRST  0x005000
+#define RECEIVE_SECOND 0x005200
+#define BLOCK_DATA     0x006000
+#define WRITE_LENGTH   16
+#define READ_LENGTH    300
+#define SPI_BYTES      (1 + (2 * WRITE_LENGTH) + (2 * READ_LENGTH) + 1)
+#define COMMAND_LENGTH 6
+#define BLOCK_LENGTH   512
+
+// the first call to each routine is measured; the ones after it, of the same length, are moved on the host
+static const uint16_t program[] = {
+  0x13FC, 0x0010, 0x00F0, 0x001D, //   move.b #$10,OPR_SET       ; SCK low
+  0x13FC, 0x0080, 0x00F0, 0x001D, //   move.b #$80,OPR_SET       ; OP7 low: select the device on chip select B
+  0x4878, 0x00FF,                 //   pea    $FF.w
+  0x4EB9, 0x0000, TRANSFER_BYTE,  //   jsr    duartSpi_transferByte
+  0x588F,                         //   addq.l #4,SP
+  0x13C0, 0x0000, RESULTS,        //   move.b D0,RESULTS
+  0x4878, WRITE_LENGTH,           //   pea    WRITE_LENGTH.w
+  0x4879, 0x0000, SEND_DATA,      //   pea    SEND_DATA
+  0x4EB9, 0x0000, WRITE_BUFFER,   //   jsr    duartSpi_writeBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, WRITE_LENGTH,           //   pea    WRITE_LENGTH.w
+  0x4879, 0x0000, SEND_DATA,      //   pea    SEND_DATA
+  0x4EB9, 0x0000, WRITE_BUFFER,   //   jsr    duartSpi_writeBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, READ_LENGTH,            //   pea    READ_LENGTH.w
+  0x4879, 0x0000, RECEIVE_FIRST,  //   pea    RECEIVE_FIRST
+  0x4EB9, 0x0000, READ_BUFFER,    //   jsr    duartSpi_readBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, READ_LENGTH,            //   pea    READ_LENGTH.w
+  0x4879, 0x0000, RECEIVE_SECOND, //   pea    RECEIVE_SECOND
+  0x4EB9, 0x0000, READ_BUFFER,    //   jsr    duartSpi_readBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, 0x00A5,                 //   pea    $A5.w
+  0x4EB9, 0x0000, TRANSFER_BYTE,  //   jsr    duartSpi_transferByte
+  0x588F,                         //   addq.l #4,SP
+  0x13C0, 0x0000, RESULTS + 1,    //   move.b D0,RESULTS+1
+  0x4E72, 0x2700,                 //   stop   #$2700
+};
+
+// as sdCard_writeBlocks() sends a command frame and then blocks: writeBuffer is timed at two lengths, and then knows its cost per call
+static const uint16_t lengths_program[] = {
+  0x13FC, 0x0010, 0x00F0, 0x001D, //   move.b #$10,OPR_SET       ; SCK low
+  0x13FC, 0x0080, 0x00F0, 0x001D, //   move.b #$80,OPR_SET       ; OP7 low: select the device on chip select B
+  0x4878, COMMAND_LENGTH,         //   pea    COMMAND_LENGTH.w
+  0x4879, 0x0000, BLOCK_DATA,     //   pea    BLOCK_DATA
+  0x4EB9, 0x0000, WRITE_BUFFER,   //   jsr    duartSpi_writeBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, BLOCK_LENGTH,           //   pea    BLOCK_LENGTH.w
+  0x4879, 0x0000, BLOCK_DATA,     //   pea    BLOCK_DATA
+  0x4EB9, 0x0000, WRITE_BUFFER,   //   jsr    duartSpi_writeBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4878, BLOCK_LENGTH,           //   pea    BLOCK_LENGTH.w
+  0x4879, 0x0000, BLOCK_DATA,     //   pea    BLOCK_DATA
+  0x4EB9, 0x0000, WRITE_BUFFER,   //   jsr    duartSpi_writeBuffer
+  0x508F,                         //   addq.l #8,SP
+  0x4239, 0x0000, RESULTS + 1,    //   clr.b  RESULTS+1
+  0x4E72, 0x2700,                 //   stop   #$2700
+};
+
+// uint8_t duartSpi_transferByte(uint8_t send_byte), after program/duart.c: a bit at a time, MSB first
+static const uint16_t transfer_byte[] = {
+  0x2F02,                         //       move.l D2,-(SP)
+  0x222F, 0x0008,                 //       move.l 8(SP),D1
+  0x7000,                         //       moveq  #0,D0
+  0x7407,                         //       moveq  #7,D2
+  0xD000,                         // bit:  add.b  D0,D0
+  0x0801, 0x0007,                 //       btst   #7,D1
+  0x670A,                         //       beq.s  low
+  0x13FC, 0x0040, 0x00F0, 0x001F, //       move.b #$40,OPR_CLEAR ; MOSI high
+  0x6008,                         //       bra.s  clock
+  0x13FC, 0x0040, 0x00F0, 0x001D, // low:  move.b #$40,OPR_SET   ; MOSI low
+  0x13FC, 0x0010, 0x00F0, 0x001F, // clock:move.b #$10,OPR_CLEAR ; SCK high
+  0x0839, 0x0002, 0x00F0, 0x001B, //       btst.b #2,IP          ; MISO
+  0x6702,                         //       beq.s  next
+  0x5200,                         //       addq.b #1,D0
+  0xD201,                         // next: add.b  D1,D1
+  0x13FC, 0x0010, 0x00F0, 0x001D, //       move.b #$10,OPR_SET   ; SCK low
+  0x51CA, 0xFFC6,                 //       dbra   D2,bit
+  0x241F,                         //       move.l (SP)+,D2
+  0x4E75,                         //       rts
+};
+
+// void duartSpi_readBuffer(uint8_t* receive_buffer, uint32_t length)
+static const uint16_t read_buffer[] = {
+  0x2F0A,                         //       move.l A2,-(SP)
+  0x2F03,                         //       move.l D3,-(SP)
+  0x246F, 0x000C,                 //       movea.l 12(SP),A2
+  0x262F, 0x0010,                 //       move.l 16(SP),D3
+  0x4A83,                         // loop: tst.l  D3
+  0x6712,                         //       beq.s  done
+  0x4878, 0x00FF,                 //       pea    $FF.w
+  0x4EB9, 0x0000, TRANSFER_BYTE,  //       jsr    duartSpi_transferByte
+  0x588F,                         //       addq.l #4,SP
+  0x14C0,                         //       move.b D0,(A2)+
+  0x5383,                         //       subq.l #1,D3
+  0x60EA,                         //       bra.s  loop
+  0x261F,                         // done: move.l (SP)+,D3
+  0x245F,                         //       movea.l (SP)+,A2
+  0x4E75,                         //       rts
+};
+
+// void duartSpi_writeBuffer(uint8_t* send_buffer, uint32_t length)
+static const uint16_t write_buffer[] = {
+  0x2F0A,                         //       move.l A2,-(SP)
+  0x2F03,                         //       move.l D3,-(SP)
+  0x246F, 0x000C,                 //       movea.l 12(SP),A2
+  0x262F, 0x0010,                 //       move.l 16(SP),D3
+  0x4A83,                         // loop: tst.l  D3
+  0x6712,                         //       beq.s  done
+  0x7000,                         //       moveq  #0,D0
+  0x101A,                         //       move.b (A2)+,D0
+  0x2F00,                         //       move.l D0,-(SP)
+  0x4EB9, 0x0000, TRANSFER_BYTE,  //       jsr    duartSpi_transferByte
+  0x588F,                         //       addq.l #4,SP
+  0x5383,                         //       subq.l #1,D3
+  0x60EA,                         //       bra.s  loop
+  0x261F,                         // done: move.l (SP)+,D3
+  0x245F,                         //       movea.l (SP)+,A2
+  0x4E75,                         //       rts
+};
+
+// shifts out a pattern that depends on how many bytes it has taken in, and keeps everything it was sent
+class PatternDevice : public SpiDevice {
+public:
+  std::vector<uint8_t> received;
+  void    spiReset() override { this->received.clear(); }
+  void    spiSelect(bool selected) override {}
+  uint8_t spiOutput() override { return (uint8_t)((this->received.size() * 37) + 11); }
+  void    spiInput(uint8_t data) override { this->received.push_back(data); }
+};
+
+// always shifts out the same byte, so every byte sent costs the guest the same
+class ConstantDevice : public SpiDevice {
+public:
+  void    spiReset() override {}
+  void    spiSelect(bool selected) override {}
+  uint8_t spiOutput() override { return 0xFF; }
+  void    spiInput(uint8_t data) override {}
+};
+
+// counts reads of the input port (eight per byte moved by the guest's own code), and notes the clock when the last result is stored
+class SpiProbe : public RoscoM68K {
+public:
+  SpiProbe() : RoscoM68K(testRom()) {
+    this->input_reads  = 0;
+    this->finish_clock = 0;
+  }
+  uint32_t input_reads;
+  int64_t  finish_clock;
+protected:
+  uint8_t read8(uint32_t address) override {
+    if((address & 0xFFFFFF) == 0xF0001B) { ++this->input_reads; }
+    return RoscoM68K::read8(address);
+  }
+  void write8(uint32_t address, uint8_t value) override {
+    if((address & 0xFFFFFF) == (RESULTS + 1)) { this->finish_clock = this->clock; }
+    RoscoM68K::write8(address, value);
+  }
+};
+
+static SpiProbe* spiMachine(const uint16_t* code, uint32_t count, bool accelerated, SpiDevice* device) {
+  SpiProbe* rosco = new SpiProbe();
+  rosco->reset();
+  testPoke(rosco, TEST_CODE_BASE, code,          count);
+  testPoke(rosco, TRANSFER_BYTE,  transfer_byte, sizeof(transfer_byte) / sizeof(uint16_t));
+  testPoke(rosco, READ_BUFFER,    read_buffer,   sizeof(read_buffer)   / sizeof(uint16_t));
+  testPoke(rosco, WRITE_BUFFER,   write_buffer,  sizeof(write_buffer)  / sizeof(uint16_t));
+  for(uint32_t index=0; index<WRITE_LENGTH; ++index) { rosco->ram[SEND_DATA + index] = (uint8_t)(0xC3 ^ (index * 29)); }
+  rosco->debugger.jump(TEST_CODE_BASE);
+  rosco->duart->attachSpiDevice(SPI_BUS_SELECT_B, device);
+  if(accelerated) {
+    rosco->setSpiRoutine(ROSCO_M68K_SPI_TRANSFER_BYTE, TRANSFER_BYTE);
+    rosco->setSpiRoutine(ROSCO_M68K_SPI_READ_BUFFER,   READ_BUFFER);
+    rosco->setSpiRoutine(ROSCO_M68K_SPI_WRITE_BUFFER,  WRITE_BUFFER);
+  }
+  return rosco;
+}
+
+int main(int argc, char** argv) {
+  PatternDevice plain_device;
+  SpiProbe* plain = spiMachine(program, sizeof(program) / sizeof(uint16_t), false, &plain_device);
+  int64_t clock_start = plain->getClock();
+  TEST_CHECK(testRunToExit(plain, TEST_RUN_SLICE, 10000000));
+  int64_t plain_cycles = plain->finish_clock - clock_start;
+  TEST_EQUAL(plain_device.received.size(), SPI_BYTES);
+  TEST_EQUAL(plain->input_reads, SPI_BYTES * 8);
+
+  // whole slices, and slices small enough that buffers are moved a piece at a time
+  for(uint32_t slice : { (uint32_t)TEST_RUN_SLICE, 1000u }) {
+    printf("SPI routines on the host, slice %u\n", slice);
+    PatternDevice device;
+    SpiProbe* accelerated = spiMachine(program, sizeof(program) / sizeof(uint16_t), true, &device);
+    TEST_CHECK(testRunToExit(accelerated, slice, 10000000));
+
+    // the device sees the same bytes; memory gets the same results (the stack below SP is left out: the routines' own saves aren't made)
+    TEST_CHECK(device.received == plain_device.received);
+    TEST_CHECK(testSameRam(plain, accelerated, 0x000000, TEST_STACK_TOP - 0x100));
+    TEST_EQUAL(accelerated->getA(7), plain->getA(7));
+    for(uint32_t index=2; index<8; ++index) { TEST_EQUAL(accelerated->getD(index), plain->getD(index)); } // D0/D1 are scratch
+    TEST_EQUAL(accelerated->getPC(), plain->getPC());
+
+    // only the first (measured) transferByte call went a bit at a time; the buffer routines' first calls used the host transferByte
+    // (unless too little of the slice was left for a whole byte)
+    if(slice == TEST_RUN_SLICE) { TEST_EQUAL(accelerated->input_reads, 8); }
+    TEST_CHECK(accelerated->input_reads < (SPI_BYTES * 8 / 4));
+
+    // clock charged from the measured calls; bit patterns change the real cost a little
+    int64_t cycles = accelerated->finish_clock - clock_start;
+    TEST_CHECK((cycles > ((plain_cycles * 95) / 100)) && (cycles < ((plain_cycles * 105) / 100)));
+    delete accelerated;
+  }
+
+  delete plain;
+
+  // a short call and then long ones: the long calls that are moved on the host are charged just what they take
+  printf("SPI routine calls of two lengths\n");
+  ConstantDevice constant_device;
+  int64_t lengths_cycles[2];
+  for(bool accelerated : { false, true }) {
+    SpiProbe* rosco = spiMachine(lengths_program, sizeof(lengths_program) / sizeof(uint16_t), accelerated, &constant_device);
+    memset(rosco->ram + BLOCK_DATA, 0x00, BLOCK_LENGTH);
+    clock_start = rosco->getClock();
+    TEST_CHECK(testRunToExit(rosco, TEST_RUN_SLICE, 10000000));
+    lengths_cycles[accelerated] = rosco->finish_clock - clock_start;
+    TEST_EQUAL(rosco->input_reads, (COMMAND_LENGTH + BLOCK_LENGTH + (accelerated ? 0 : BLOCK_LENGTH)) * 8); // the two timed calls went a bit at a time
+    delete rosco;
+  }
+  TEST_EQUAL(lengths_cycles[1], lengths_cycles[0]);
+
+  return testFinish("spi_routines");
+}
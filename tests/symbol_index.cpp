@@ -0,0 +1,42 @@
+#include "test.hpp"
+#include "../machine/symbol_index.hpp"
+
+#define LOOKUPS 1003 // not a whole number of findMany() lanes
+
+int main(int argc, char** argv) {
+  SymbolIndex symbols;
+  symbols.add(0x001000, 0x100, "sized");
+  symbols.add(0x001000, 0x200, "same_address"); // first added wins
+  symbols.add(0x002000, 0,     "to_next");
+  symbols.add(0x002800, 0x80,  "inside");
+  symbols.add(0xE00000, 0,     "rom");
+  symbols.build();
+  TEST_EQUAL(symbols.count(), 4);
+
+  char location[64];
+  TEST_CHECK(!symbols.format(0x000FFF, location, sizeof(location)));
+  TEST_CHECK(symbols.format(0x001000, location, sizeof(location)) && !strcmp(location, "sized"));
+  TEST_CHECK(symbols.format(0x0010FF, location, sizeof(location)) && !strcmp(location, "sized+0xff"));
+  TEST_CHECK(!symbols.format(0x001100, location, sizeof(location)));
+  TEST_CHECK(symbols.format(0x0027FF, location, sizeof(location)) && !strcmp(location, "to_next+0x7ff"));
+  TEST_CHECK(symbols.format(0x002840, location, sizeof(location)) && !strcmp(location, "inside+0x40"));
+  TEST_CHECK(!symbols.format(0x002880, location, sizeof(location)));
+  TEST_CHECK(symbols.format(0xFFE00010, location, sizeof(location)) && !strcmp(location, "rom+0x10")); // 24 bit bus
+
+  // the batched lookup agrees with the single one
+  uint32_t addresses[LOOKUPS], indexes[LOOKUPS];
+  uint32_t seed = 1;
+  for(uint32_t index=0; index<LOOKUPS; ++index) {
+    seed = (seed * 1103515245) + 12345;
+    addresses[index] = (index & 1) ? (0x000F00 + ((seed >> 8) % 0x2000)) : seed;
+  }
+  symbols.findMany(addresses, LOOKUPS, indexes);
+  for(uint32_t index=0; index<LOOKUPS; ++index) { TEST_EQUAL(indexes[index], symbols.find(addresses[index])); }
+
+  SymbolIndex empty;
+  empty.build();
+  empty.findMany(addresses, LOOKUPS, indexes);
+  TEST_EQUAL(indexes[LOOKUPS - 1], SYMBOL_INDEX_NONE);
+
+  return testFinish("symbol_index");
+}
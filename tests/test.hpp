@@ -0,0 +1,167 @@
+#pragma once
+
+extern "C" {
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+}
+#include "../machine/rosco_m68k.hpp"
+
+#define TEST_CODE_BASE  0x002000 // where tests place their code
+#define TEST_STACK_TOP  0x100000 // top of on-board RAM
+#define TEST_RUN_SLICE  160000   // as the interface's free run
+
+// failed checks are reported and counted, and the test carries on, so one run shows everything that's wrong
+static uint32_t test_failures = 0;
+
+#define TEST_CHECK(condition) do { \
+  if(!(condition)) { printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); ++test_failures; } \
+} while(0)
+
+#define TEST_EQUAL(actual, expected) do { \
+  long long test_actual = (long long)(actual), test_expected = (long long)(expected); \
+  if(test_actual != test_expected) { \
+    printf("%s:%d: failed: %s == %s (0x%llX, expected 0x%llX)\n", __FILE__, __LINE__, #actual, #expected, test_actual, test_expected); \
+    ++test_failures; \
+  } \
+} while(0)
+
+static char test_rom_path[64] = { 0 };
+
+static inline void testRomRemove() {
+  unlink(test_rom_path);
+}
+
+/**
+ * Get the path to a minimal ROM: reset vectors (stack at the top of on-board RAM, PC at a BRA.S * just past them);
+ * tests place their own code in RAM (testPoke(), testMachine())
+ *
+ * @returns path to the ROM file; removed at exit
+ **/
+static inline const char* testRom() {
+  if(test_rom_path[0]) { return test_rom_path; }
+  snprintf(test_rom_path, sizeof(test_rom_path), "/tmp/mremu-test-%d.rom", (int)getpid());
+  const uint8_t rom[] = {
+    (TEST_STACK_TOP >> 24) & 0xFF, (TEST_STACK_TOP >> 16) & 0xFF, (TEST_STACK_TOP >> 8) & 0xFF, TEST_STACK_TOP & 0xFF,
+    0x00, 0xE0, 0x00, 0x08, // PC: 0xE00008
+    0x60, 0xFE,             // BRA.S *
+  };
+  FILE* rom_file = fopen(test_rom_path, "wb");
+  if(!rom_file || (fwrite(rom, 1, sizeof(rom), rom_file) != sizeof(rom))) {
+    printf("error creating test ROM %s\n", test_rom_path);
+    exit(2);
+  }
+  fclose(rom_file);
+  atexit(testRomRemove);
+  return test_rom_path;
+}
+
+/**
+ * Copy code (or data) into RAM
+ *
+ * @param rosco machine to write to
+ * @param address RAM address
+ * @param words big-endian 16 bit words, as the processor sees them
+ * @param count count of words
+ **/
+static inline void testPoke(RoscoM68K* rosco, uint32_t address, const uint16_t* words, uint32_t count) {
+  for(uint32_t index=0; index<count; ++index) {
+    rosco->ram[address + (index * 2) + 0] = (uint8_t)(words[index] >> 8);
+    rosco->ram[address + (index * 2) + 1] = (uint8_t)(words[index] & 0xFF);
+  }
+  rosco->ram_modified = true;
+}
+
+/**
+ * Create a machine, reset, with code placed at TEST_CODE_BASE and the processor about to run it
+ *
+ * @param code code words
+ * @param count count of code words
+ * @returns new machine
+ **/
+static inline RoscoM68K* testMachine(const uint16_t* code, uint32_t count) {
+  RoscoM68K* rosco = new RoscoM68K(testRom());
+  rosco->reset();
+  testPoke(rosco, TEST_CODE_BASE, code, count);
+  rosco->debugger.jump(TEST_CODE_BASE);
+  return rosco;
+}
+
+/**
+ * Run until the code exits (STOP #$2700), or an instruction limit is reached
+ *
+ * @param rosco machine to run
+ * @param slice instructions per run() call
+ * @param limit most instructions to run
+ * @returns whether the code exited
+ **/
+static inline bool testRunToExit(RoscoM68K* rosco, uint32_t slice, uint64_t limit) {
+  for(uint64_t run=0; (run < limit) && !rosco->hasExited(); run += slice) { rosco->run(slice); }
+  return rosco->hasExited();
+}
+
+/**
+ * Check two machines ended up with the same registers (and flags)
+ **/
+static inline bool testSameRegisters(RoscoM68K* expected, RoscoM68K* actual) {
+  m68k_registers registers_expected, registers_actual;
+  expected->getRegisters(&registers_expected);
+  actual->getRegisters(&registers_actual);
+  bool same = !memcmp(&registers_expected, &registers_actual, sizeof(m68k_registers));
+  if(!same) {
+    printf("  registers  pc %06X/%06X sr %04X/%04X\n", registers_expected.pc, registers_actual.pc, registers_expected.sr, registers_actual.sr);
+    for(uint32_t index=0; index<8; ++index) {
+      printf("  d%u %08X/%08X  a%u %08X/%08X\n", index, registers_expected.d[index], registers_actual.d[index],
+             index, registers_expected.a[index], registers_actual.a[index]);
+    }
+  }
+  return same;
+}
+
+/**
+ * Run an exact count of instructions (as the fast paths count them), in run() slices
+ *
+ * @param rosco machine to run
+ * @param instructions count of instructions
+ * @param slice most instructions per run() call
+ **/
+static inline void testRunInstructions(RoscoM68K* rosco, uint64_t instructions, uint32_t slice) {
+  while(instructions) {
+    uint32_t count = (instructions > slice) ? slice : (uint32_t)instructions;
+    rosco->run(count);
+    instructions -= count;
+  }
+}
+
+/**
+ * Check two machines ended up with the same RAM
+ *
+ * @param lowest lowest address to compare
+ * @param highest highest address to compare
+ **/
+static inline bool testSameRam(RoscoM68K* expected, RoscoM68K* actual, uint32_t lowest = 0x000000, uint32_t highest = TEST_STACK_TOP - 1) {
+  for(uint32_t address=lowest; address<=highest; ++address) {
+    if(expected->ram[address] != actual->ram[address]) {
+      printf("  ram differs at %06X: %02X/%02X\n", address, expected->ram[address], actual->ram[address]);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Report the result of a test program
+ *
+ * @param name test name
+ * @returns process exit code
+ **/
+static inline int testFinish(const char* name) {
+  if(test_failures) {
+    printf("%s: %u check(s) failed\n", name, test_failures);
+    return 1;
+  }
+  printf("%s: passed\n", name);
+  return 0;
+}
@@ -0,0 +1,155 @@
+#include "test.hpp"
+#include "../machine/trace_reader.hpp"
+#include <vector>
+
+#define SOURCE        0x010000
+#define DESTINATION   0x011000
+#define COUNTER       0x012000
+#define ITERATIONS    1000
+#define INSTRUCTIONS  (3 + (ITERATIONS * 4) + 1) // through the STOP
+#define CHUNK_SIZE    8192                      // small, so the trace spans several chunks
+
+static const uint16_t program[] = {
+  0x41F9, 0x0001, 0x0000,         //       lea    SOURCE,A0
+  0x43F9, 0x0001, 0x1000,         //       lea    DESTINATION,A1
+  0x303C, ITERATIONS - 1,         //       move.w #ITERATIONS-1,D0
+  0x12D8,                         // loop: move.b (A0)+,(A1)+
+  0xD280,                         //       add.l  D0,D1
+  0x33C0, 0x0001, 0x2000,         //       move.w D0,COUNTER
+  0x51C8, 0xFFF4,                 //       dbra   D0,loop
+  0x4E72, 0x2700,                 //       stop   #$2700
+};
+
+// state after each instruction, from a machine run a single step at a time
+typedef struct {
+  uint32_t pc;
+  uint16_t opcode;
+  uint16_t sr;
+  int64_t  clock;
+  uint32_t registers[16];
+  uint32_t registers_before[16];
+} reference_step;
+
+typedef struct {
+  const std::vector<reference_step>* reference;
+  uint64_t decoded;
+} decode_check;
+
+static RoscoM68K* traceMachine() {
+  RoscoM68K* rosco = testMachine(program, sizeof(program) / sizeof(program[0]));
+  for(uint32_t index=0; index<ITERATIONS; ++index) { rosco->ram[SOURCE + index] = (uint8_t)((index * 13) ^ 0x5A); }
+  return rosco;
+}
+
+static void registersOf(RoscoM68K* rosco, uint32_t* registers) {
+  for(uint32_t index=0; index<8; ++index) {
+    registers[index]     = rosco->getD(index);
+    registers[8 + index] = rosco->getA(index);
+  }
+}
+
+static bool checkStep(const trace_step* step, void* callback_data) {
+  decode_check* check = (decode_check*)callback_data;
+  TEST_EQUAL(step->instruction, check->decoded);
+  if(step->instruction >= check->reference->size()) { return false; }
+  const reference_step* expected = &((*(check->reference))[step->instruction]);
+  ++check->decoded;
+
+  TEST_EQUAL(step->pc,     expected->pc);
+  TEST_EQUAL(step->opcode, expected->opcode);
+  TEST_EQUAL(step->sr,     expected->sr);
+  TEST_EQUAL(step->clock,  expected->clock);
+  TEST_CHECK(!memcmp(step->registers, expected->registers, sizeof(step->registers)));
+
+  // data accesses (instruction fetches are left out)
+  const uint32_t* a = expected->registers_before + 8;
+  switch(step->opcode) {
+    case 0x12D8: // move.b (A0)+,(A1)+
+      TEST_EQUAL(step->access_count, 2);
+      if(step->access_count != 2) { break; }
+      TEST_EQUAL(step->accesses[0].kind,    0);
+      TEST_EQUAL(step->accesses[0].address, a[0]);
+      TEST_EQUAL(step->accesses[1].kind,    TRACE_ACCESS_WRITE);
+      TEST_EQUAL(step->accesses[1].address, a[1]);
+      TEST_EQUAL(step->accesses[0].value,   step->accesses[1].value);
+      break;
+    case 0x33C0: // move.w D0,COUNTER
+      TEST_EQUAL(step->access_count, 1);
+      if(step->access_count != 1) { break; }
+      TEST_EQUAL(step->accesses[0].kind,    TRACE_ACCESS_WRITE | TRACE_ACCESS_WORD);
+      TEST_EQUAL(step->accesses[0].address, COUNTER);
+      TEST_EQUAL(step->accesses[0].value,   expected->registers_before[0] & 0xFFFF);
+      break;
+    default:
+      TEST_EQUAL(step->access_count, 0);
+      break;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  char trace_path[64];
+  snprintf(trace_path, sizeof(trace_path), "/tmp/mremu-test-%d.trace", (int)getpid());
+
+  std::vector<reference_step> reference;
+  RoscoM68K* stepped = traceMachine();
+  for(uint32_t index=0; index<INSTRUCTIONS; ++index) {
+    reference_step step;
+    step.pc     = stepped->getPC();
+    step.opcode = (uint16_t)((stepped->busRead(step.pc) << 8) | stepped->busRead(step.pc + 1));
+    registersOf(stepped, step.registers_before);
+    stepped->run(1);
+    step.sr    = stepped->getSR();
+    step.clock = stepped->getClock();
+    registersOf(stepped, step.registers);
+    reference.push_back(step);
+  }
+  TEST_CHECK(stepped->hasExited());
+
+  // recorded in whole slices (the recorder takes the fast paths' place)
+  RoscoM68K* traced = traceMachine();
+  TraceRecorder* recorder = NULL;
+  try {
+    recorder = TraceRecorder::create(trace_path, ROSCO_M68K_CLOCK_HZ, CHUNK_SIZE);
+  } catch(const char* error) {
+    printf("error creating trace: %s\n", error);
+    return 2;
+  }
+  traced->setTraceRecorder(recorder);
+  testRunInstructions(traced, INSTRUCTIONS, TEST_RUN_SLICE);
+  traced->setTraceRecorder(NULL);
+  recorder->finish(); // seals the last chunk, and waits for it to be written
+  TEST_EQUAL(recorder->instructions(), INSTRUCTIONS);
+  TEST_EQUAL(recorder->accessesDropped(), 0);
+  TEST_CHECK(!recorder->failed());
+  delete recorder;
+  TEST_CHECK(testSameRam(stepped, traced));
+
+  TraceReader* reader = NULL;
+  try {
+    reader = TraceReader::open(trace_path);
+  } catch(const char* error) {
+    printf("error opening trace: %s\n", error);
+    unlink(trace_path);
+    return 2;
+  }
+  TEST_EQUAL(reader->clockHz(), ROSCO_M68K_CLOCK_HZ);
+  TEST_EQUAL(reader->instructions(), INSTRUCTIONS);
+  TEST_CHECK(reader->chunkCount() > 1);
+
+  // every chunk decodes on its own, picking up where the one before left off
+  decode_check check = { &reference, 0 };
+  for(uint32_t chunk=0; chunk<reader->chunkCount(); ++chunk) {
+    TEST_EQUAL(reader->chunk(chunk)->instruction, check.decoded);
+    TEST_EQUAL(reader->findChunk(check.decoded), chunk);
+    TEST_CHECK(reader->decodeChunk(chunk, checkStep, &check));
+  }
+  TEST_EQUAL(check.decoded, INSTRUCTIONS);
+  TEST_EQUAL(reader->findChunk(INSTRUCTIONS), reader->chunkCount());
+
+  delete reader;
+  unlink(trace_path);
+  delete traced;
+  delete stepped;
+  return testFinish("trace");
+}
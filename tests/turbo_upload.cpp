@@ -0,0 +1,73 @@
+#include "test.hpp"
+
+#define UPLOAD_LENGTH  3000
+#define UPLOAD_ADDRESS 0x010000
+
+// the loader's TRAP #1 read loop (rom/loader-startup.asm), reading UPLOAD_LENGTH bytes from port A to UPLOAD_ADDRESS
+static const uint16_t upload[] = {
+  0x13FC, 0x0005, 0x00F0, 0x0005, // move.b #$05,CRA   ; enable receiver and transmitter
+  0x203C, 0x0000, UPLOAD_LENGTH,  // move.l #UPLOAD_LENGTH,D0
+  0x41F9, 0x0001, 0x0000,         // lea    UPLOAD_ADDRESS,A0
+  0x4A80,                         // head: tst.l D0
+  0x6716,                         //       beq.s done
+  0x0839, 0x0000, 0x00F0, 0x0003, //       btst.b #0,SRA
+  0x67F6,                         //       beq.s *-8
+  0x1239, 0x00F0, 0x0007,         //       move.b RHRA,D1
+  0x10C1,                         //       move.b D1,(A0)+
+  0x5380,                         //       subq.l #1,D0
+  0x60E6,                         //       bra.s head
+  0x4E72, 0x2700,                 // done: stop #$2700
+};
+#define UPLOAD_SETUP        3
+#define UPLOAD_INSTRUCTIONS (UPLOAD_SETUP + (UPLOAD_LENGTH * 8) + 2) // with every byte already waiting
+
+static RoscoM68K* uploadMachine(bool turbo, const uint8_t* data) {
+  RoscoM68K* rosco = testMachine(upload, sizeof(upload) / sizeof(upload[0]));
+  rosco->setTurboUpload(turbo);
+  rosco->setDelayLoopElision(false);
+  rosco->run(1); // receiver enabled
+  rosco->duart->serialPortQueue(DUART_68681_PORT_A, data, UPLOAD_LENGTH);
+  return rosco;
+}
+
+int main(int argc, char** argv) {
+  uint8_t data[UPLOAD_LENGTH];
+  for(uint32_t index=0; index<UPLOAD_LENGTH; ++index) { data[index] = (uint8_t)((index * 73) ^ (index >> 5)); }
+
+  RoscoM68K* plain = uploadMachine(false, data);
+  testRunInstructions(plain, UPLOAD_INSTRUCTIONS - 1, 1);
+  TEST_EQUAL(plain->getPC(), TEST_CODE_BASE + sizeof(upload) - 4);
+  TEST_CHECK(!memcmp(plain->ram + UPLOAD_ADDRESS, data, UPLOAD_LENGTH));
+
+  // whole slices, and slices that cut the upload into pieces (which don't divide into whole bytes)
+  for(uint32_t slice : { (uint32_t)TEST_RUN_SLICE, 1001u }) {
+    printf("turbo upload, slice %u\n", slice);
+    RoscoM68K* turbo = uploadMachine(true, data);
+    testRunInstructions(turbo, UPLOAD_INSTRUCTIONS - 1, slice);
+    TEST_CHECK(testSameRegisters(plain, turbo));
+    TEST_CHECK(testSameRam(plain, turbo));
+    TEST_EQUAL(turbo->duart->serialPortQueueLength(DUART_68681_PORT_A), 0);
+    // the copy takes no emulated time; that's how we know it happened
+    TEST_CHECK(turbo->getClock() < plain->getClock());
+    delete turbo;
+  }
+
+  // with only part of the upload waiting, the rest goes through the loop as usual once it arrives
+  printf("turbo upload, arriving in two parts\n");
+  RoscoM68K* parts = testMachine(upload, sizeof(upload) / sizeof(upload[0]));
+  parts->setTurboUpload(true);
+  parts->setDelayLoopElision(false);
+  parts->run(1);
+  parts->duart->serialPortQueue(DUART_68681_PORT_A, data, UPLOAD_LENGTH / 2);
+  parts->run(TEST_RUN_SLICE);
+  TEST_CHECK(!parts->hasExited());
+  parts->duart->serialPortQueue(DUART_68681_PORT_A, data + (UPLOAD_LENGTH / 2), UPLOAD_LENGTH - (UPLOAD_LENGTH / 2));
+  TEST_CHECK(testRunToExit(parts, TEST_RUN_SLICE, 10000000));
+  TEST_CHECK(!memcmp(parts->ram + UPLOAD_ADDRESS, data, UPLOAD_LENGTH));
+  TEST_EQUAL(parts->getD(0), 0);
+  TEST_EQUAL(parts->getA(0), UPLOAD_ADDRESS + UPLOAD_LENGTH);
+  delete parts;
+
+  delete plain;
+  return testFinish("turbo_upload");
+}
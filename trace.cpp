@@ -0,0 +1,310 @@
+#include "machine/trace_reader.hpp"
+#include "machine/symbol_index.hpp"
+
+extern "C" {
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+}
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define TRACE_DEFAULT_TOP     20
+#define TRACE_DEFAULT_BUCKET  0x1000 // bytes per memory histogram bucket
+#define TRACE_DEFAULT_EXCERPT 32     // records
+#define TRACE_HISTOGRAM_WIDTH 40     // characters in the longest bar
+
+typedef struct {
+  uint64_t instructions;
+  uint64_t cycles;
+} trace_pc_total;
+
+typedef struct {
+  uint64_t reads;
+  uint64_t writes;
+} trace_bucket_total;
+
+// what one worker gathered, from the chunks it decoded
+typedef struct {
+  std::unordered_map<uint32_t, trace_pc_total>     pcs;
+  std::unordered_map<uint32_t, trace_bucket_total> buckets; // by address >> bucket_bits
+  uint32_t bucket_bits;
+  uint64_t instructions;
+  uint64_t cycles;
+  uint64_t reads;
+  uint64_t writes;
+  uint64_t word_accesses;
+  uint32_t malformed_chunks;
+} trace_totals;
+
+typedef struct {
+  const SymbolIndex* symbols;
+  uint64_t           first;
+  uint64_t           last; // exclusive
+} trace_excerpt;
+
+static void traceUsage(const char* name) {
+  printf("usage: %s [options] trace\n", name);
+  printf("  -s symbols  ELF file to take symbols from (ex: the program's, and the ROM's); may be repeated\n");
+  printf("  -n count    entries in each report (default %u)\n", TRACE_DEFAULT_TOP);
+  printf("  -b bytes    memory histogram bucket size, a power of two (default 0x%X)\n", TRACE_DEFAULT_BUCKET);
+  printf("  -e first[:count]  also print count records (default %u) from record first on, symbolized\n", TRACE_DEFAULT_EXCERPT);
+  printf("  -j threads  worker threads (default: one per hardware thread)\n");
+}
+
+static bool traceStepTotals(const trace_step* step, void* callback_data) {
+  trace_totals* totals = (trace_totals*)callback_data;
+  trace_pc_total* pc = &(totals->pcs[step->pc]);
+  ++pc->instructions;
+  pc->cycles += step->cycles;
+  ++totals->instructions;
+  totals->cycles += step->cycles;
+
+  for(uint32_t index=0; index<step->access_count; ++index) {
+    const trace_access* access = &(step->accesses[index]);
+    trace_bucket_total* bucket = &(totals->buckets[(access->address & 0xFFFFFF) >> totals->bucket_bits]);
+    if(access->kind & TRACE_ACCESS_WRITE) {
+      ++bucket->writes;
+      ++totals->writes;
+    } else {
+      ++bucket->reads;
+      ++totals->reads;
+    }
+    if(access->kind & TRACE_ACCESS_WORD) { ++totals->word_accesses; }
+  }
+  return true;
+}
+
+static bool traceStepExcerpt(const trace_step* step, void* callback_data) {
+  trace_excerpt* excerpt = (trace_excerpt*)callback_data;
+  if(step->instruction <  excerpt->first) { return true;  }
+  if(step->instruction >= excerpt->last)  { return false; }
+
+  char location[128];
+  excerpt->symbols->format(step->pc, location, sizeof(location));
+  printf("%12llu  %06X %-32s %04X %4lld", (unsigned long long)step->instruction, step->pc & 0xFFFFFF, location, step->opcode, (long long)step->cycles);
+  for(uint32_t index=0; index<16; ++index) {
+    if(step->changed & (1 << index)) { printf("  %c%u=%08X", (index < 8) ? 'D' : 'A', index & 7, step->registers[index]); }
+  }
+  if(step->sr_changed) { printf("  SR=%04X", step->sr); }
+  for(uint32_t index=0; index<step->access_count; ++index) {
+    const trace_access* access = &(step->accesses[index]);
+    const char* direction = (access->kind & TRACE_ACCESS_WRITE) ? "W" : "R";
+    if(access->kind & TRACE_ACCESS_WORD) {
+      printf("  %s.w %06X=%04X", direction, access->address & 0xFFFFFF, access->value);
+    } else {
+      printf("  %s.b %06X=%02X", direction, access->address & 0xFFFFFF, access->value);
+    }
+  }
+  printf("\n");
+  return true;
+}
+
+static void traceMerge(trace_totals* into, const trace_totals* from) {
+  for(const auto& entry : from->pcs) {
+    trace_pc_total* pc = &(into->pcs[entry.first]);
+    pc->instructions += entry.second.instructions;
+    pc->cycles       += entry.second.cycles;
+  }
+  for(const auto& entry : from->buckets) {
+    trace_bucket_total* bucket = &(into->buckets[entry.first]);
+    bucket->reads  += entry.second.reads;
+    bucket->writes += entry.second.writes;
+  }
+  into->instructions     += from->instructions;
+  into->cycles           += from->cycles;
+  into->reads            += from->reads;
+  into->writes           += from->writes;
+  into->word_accesses    += from->word_accesses;
+  into->malformed_chunks += from->malformed_chunks;
+}
+
+static double tracePercent(uint64_t part, uint64_t whole) {
+  return whole ? ((100.0 * part) / whole) : 0.0;
+}
+
+static void traceReportSymbols(const trace_totals* totals, const SymbolIndex* symbols, uint32_t top) {
+  // the last slot collects everything no symbol covers
+  std::vector<trace_pc_total> by_symbol(symbols->count() + 1, { 0, 0 });
+  std::vector<std::pair<uint32_t, trace_pc_total>> pcs(totals->pcs.begin(), totals->pcs.end());
+  std::vector<uint32_t> addresses(pcs.size());
+  std::vector<uint32_t> indexes(pcs.size());
+  for(size_t index=0; index<pcs.size(); ++index) { addresses[index] = pcs[index].first; }
+  symbols->findMany(addresses.data(), addresses.size(), indexes.data()); // every pc ever run may be a lot of lookups
+  for(size_t index=0; index<pcs.size(); ++index) {
+    trace_pc_total* total = &(by_symbol[(indexes[index] == SYMBOL_INDEX_NONE) ? symbols->count() : indexes[index]]);
+    total->instructions += pcs[index].second.instructions;
+    total->cycles       += pcs[index].second.cycles;
+  }
+  std::vector<uint32_t> order;
+  for(uint32_t index=0; index<by_symbol.size(); ++index) {
+    if(by_symbol[index].instructions) { order.push_back(index); }
+  }
+  // ties go to the lower address (symbols are indexed in address order), so the report doesn't depend on hash order
+  std::sort(order.begin(), order.end(), [&](uint32_t left, uint32_t right) {
+    return (by_symbol[left].cycles != by_symbol[right].cycles) ? (by_symbol[left].cycles > by_symbol[right].cycles) : (left < right);
+  });
+  if(order.size() > top) { order.resize(top); }
+
+  printf("\nhot spots, by symbol\n");
+  printf("  %7s %14s %14s  %s\n", "share", "cycles", "instructions", "symbol");
+  for(uint32_t index : order) {
+    const trace_pc_total* total = &(by_symbol[index]);
+    const char* name = (index == symbols->count()) ? "(no symbol)" : symbols->name(index);
+    printf("  %6.2f%% %14llu %14llu  %s\n", tracePercent(total->cycles, totals->cycles),
+           (unsigned long long)total->cycles, (unsigned long long)total->instructions, name);
+  }
+}
+
+static void traceReportInstructions(const trace_totals* totals, const SymbolIndex* symbols, uint32_t top) {
+  std::vector<std::pair<uint32_t, trace_pc_total>> order(totals->pcs.begin(), totals->pcs.end());
+  size_t count = (order.size() < top) ? order.size() : top;
+  std::partial_sort(order.begin(), order.begin() + count, order.end(), [](const auto& left, const auto& right) {
+    return (left.second.cycles != right.second.cycles) ? (left.second.cycles > right.second.cycles) : (left.first < right.first);
+  });
+
+  printf("\nhot spots, by instruction\n");
+  printf("  %7s %14s %14s  %-6s %s\n", "share", "cycles", "executed", "pc", "symbol");
+  for(size_t index=0; index<count; ++index) {
+    char location[128];
+    symbols->format(order[index].first, location, sizeof(location));
+    printf("  %6.2f%% %14llu %14llu  %06X %s\n", tracePercent(order[index].second.cycles, totals->cycles),
+           (unsigned long long)order[index].second.cycles, (unsigned long long)order[index].second.instructions, order[index].first & 0xFFFFFF, location);
+  }
+}
+
+static void traceReportMemory(const trace_totals* totals, const SymbolIndex* symbols, uint32_t top) {
+  std::vector<std::pair<uint32_t, trace_bucket_total>> order(totals->buckets.begin(), totals->buckets.end());
+  auto accesses = [](const trace_bucket_total& bucket) { return bucket.reads + bucket.writes; };
+  size_t count = (order.size() < top) ? order.size() : top;
+  std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](const auto& left, const auto& right) {
+    return (accesses(left.second) != accesses(right.second)) ? (accesses(left.second) > accesses(right.second)) : (left.first < right.first);
+  });
+
+  printf("\nmemory accesses: %llu reads, %llu writes (%llu words, %llu bytes)\n",
+         (unsigned long long)totals->reads, (unsigned long long)totals->writes, (unsigned long long)totals->word_accesses,
+         (unsigned long long)(totals->reads + totals->writes - totals->word_accesses));
+  if(!count) { return; }
+  uint64_t most = accesses(order[0].second);
+  printf("  %-13s %12s %12s  %-*s  %s\n", "addresses", "reads", "writes", TRACE_HISTOGRAM_WIDTH, "", "symbol");
+  for(size_t index=0; index<count; ++index) {
+    uint32_t first = order[index].first << totals->bucket_bits;
+    uint32_t last  = first + (1 << totals->bucket_bits) - 1;
+    char bar[TRACE_HISTOGRAM_WIDTH + 1];
+    uint32_t width = (uint32_t)((accesses(order[index].second) * TRACE_HISTOGRAM_WIDTH) / most);
+    memset(bar, '#', width);
+    bar[width] = 0x00;
+    char location[128];
+    symbols->format(first, location, sizeof(location));
+    printf("  %06X-%06X %12llu %12llu  %-*s  %s\n", first, last, (unsigned long long)order[index].second.reads, (unsigned long long)order[index].second.writes,
+           TRACE_HISTOGRAM_WIDTH, bar, location);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::vector<const char*> symbol_paths;
+  uint32_t    top           = TRACE_DEFAULT_TOP;
+  uint32_t    bucket_size   = TRACE_DEFAULT_BUCKET;
+  uint32_t    thread_count  = 0;
+  const char* excerpt_range = NULL;
+
+  int option;
+  while((option = getopt(argc, argv, "s:n:b:e:j:h")) != -1) {
+    switch(option) {
+      case 's': symbol_paths.push_back(optarg); break;
+      case 'n': top           = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'b': bucket_size   = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'e': excerpt_range = optarg; break;
+      case 'j': thread_count  = (uint32_t)strtoul(optarg, NULL, 0); break;
+      default:  traceUsage(argv[0]); return (option == 'h') ? 0 : 2;
+    }
+  }
+  if((optind != (argc - 1)) || !bucket_size || (bucket_size & (bucket_size - 1)) || (bucket_size > 0x1000000)) {
+    traceUsage(argv[0]);
+    return 2;
+  }
+  if(thread_count == 0) { thread_count = std::thread::hardware_concurrency(); }
+  if(thread_count == 0) { thread_count = 1; }
+
+  SymbolIndex symbols;
+  for(const char* symbol_path : symbol_paths) {
+    try {
+      ProgramImage* symbol_image = ProgramImage::load(symbol_path);
+      symbols.add(symbol_image);
+      delete symbol_image;
+    } catch(const char* error) {
+      printf("error loading symbols %s: %s\n", symbol_path, error);
+      return 1;
+    }
+  }
+  symbols.build();
+
+  TraceReader* reader;
+  try {
+    reader = TraceReader::open(argv[optind]);
+  } catch(const char* error) {
+    printf("error opening %s: %s\n", argv[optind], error);
+    return 1;
+  }
+
+  // chunks are dealt out one at a time; every worker keeps its own totals, merged once all are done
+  auto started = std::chrono::steady_clock::now();
+  uint32_t bucket_bits = 0;
+  while((1u << bucket_bits) < bucket_size) { ++bucket_bits; }
+  if(thread_count > reader->chunkCount()) { thread_count = reader->chunkCount() ? reader->chunkCount() : 1; }
+  std::vector<trace_totals> totals(thread_count);
+  for(trace_totals& worker_totals : totals) {
+    worker_totals.bucket_bits      = bucket_bits;
+    worker_totals.instructions     = 0;
+    worker_totals.cycles           = 0;
+    worker_totals.reads            = 0;
+    worker_totals.writes           = 0;
+    worker_totals.word_accesses    = 0;
+    worker_totals.malformed_chunks = 0;
+  }
+  std::atomic<uint32_t> next_chunk(0);
+  std::vector<std::thread> workers;
+  for(uint32_t index=0; index<thread_count; ++index) {
+    workers.emplace_back([&, index] {
+      trace_totals* worker_totals = &(totals[index]);
+      for(uint32_t chunk=next_chunk++; chunk<reader->chunkCount(); chunk=next_chunk++) {
+        if(!reader->decodeChunk(chunk, traceStepTotals, worker_totals)) { ++worker_totals->malformed_chunks; }
+      }
+    });
+  }
+  for(std::thread& worker : workers) { worker.join(); }
+  for(uint32_t index=1; index<thread_count; ++index) { traceMerge(&(totals[0]), &(totals[index])); }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  const trace_totals* total = &(totals[0]);
+  double clock_hz = reader->clockHz() ? reader->clockHz() : 1.0;
+  printf("%s: %llu instructions, %llu cycles (%.3f s at %.2f MHz), %u chunks\n", argv[optind],
+         (unsigned long long)total->instructions, (unsigned long long)total->cycles, total->cycles / clock_hz, clock_hz / 1000000.0, reader->chunkCount());
+  printf("decoded in %.3f s, on %u threads\n", elapsed, thread_count);
+  if(total->malformed_chunks) { printf("warning: %u malformed chunks (decoded up to the damage)\n", total->malformed_chunks); }
+
+  if(symbols.count()) { traceReportSymbols(total, &symbols, top); }
+  traceReportInstructions(total, &symbols, top);
+  traceReportMemory(total, &symbols, top);
+
+  if(excerpt_range) {
+    char* count_text = NULL;
+    trace_excerpt excerpt;
+    excerpt.symbols = &symbols;
+    excerpt.first   = strtoull(excerpt_range, &count_text, 0);
+    excerpt.last    = excerpt.first + ((count_text && (*count_text == ':')) ? strtoull(count_text + 1, NULL, 0) : TRACE_DEFAULT_EXCERPT);
+    printf("\nrecords %llu-%llu\n", (unsigned long long)excerpt.first, (unsigned long long)(excerpt.last - 1));
+    for(uint32_t chunk=reader->findChunk(excerpt.first); chunk<reader->chunkCount(); ++chunk) {
+      if(reader->chunk(chunk)->instruction >= excerpt.last) { break; }
+      reader->decodeChunk(chunk, traceStepExcerpt, &excerpt);
+    }
+  }
+
+  delete reader;
+  return total->malformed_chunks ? 1 : 0;
+}